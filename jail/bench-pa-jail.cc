@@ -0,0 +1,567 @@
+// bench-pa-jail.cc -- timing benchmarks for pa-jail population and teardown
+// Peteramati is Copyright (c) 2013-2026 Eddie Kohler and others
+// See LICENSE for open-source distribution terms
+//
+// Like test-pa-jail, this driver runs the real `./pa-jail` binary; it reports
+// wall-clock times instead of asserting behavior. It needs root on Linux and a
+// /etc/pa-jail.conf that enables the benchmark jails (`enablejail /jails/**`
+// covers the default `--jaildir`). It builds a synthetic source tree, writes a
+// manifest naming every file in it, and times `pa-jail` configurations against
+// each other on that one manifest. Every benchmark also compares the jails it
+// built, so a fast path cannot win by doing less (or different) work.
+//
+//   ./bench-pa-jail                 run every benchmark
+//   ./bench-pa-jail copy            run only the named benchmark(s)
+//   ./bench-pa-jail --files N       files in the synthetic tree [2000]
+//   ./bench-pa-jail --repeat N      runs per configuration; best time wins [3]
+//   ./bench-pa-jail --jaildir DIR   parent of the benchmark jails [/jails/bench]
+//   ./bench-pa-jail --srcdir DIR    where to build the source tree
+//                                   [/var/tmp/pa-jail-bench]
+
+#undef NDEBUG
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <algorithm>
+#include <format>
+#include <functional>
+#include <string>
+#include <vector>
+#include <utility>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+static int nfiles = 2000;
+static int nrepeat = 3;
+static std::string jailbase = "/jails/bench";
+static std::string srcdir = "/var/tmp/pa-jail-bench";
+static bool verbose = false;
+
+static std::string cwd() {
+    char buf[4096];
+    if (!getcwd(buf, sizeof(buf))) {
+        perror("getcwd");
+        exit(1);
+    }
+    return buf;
+}
+
+static std::string pajail_path() {
+    return cwd() + "/pa-jail";
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Run `args` (no shell), with stdout and stderr sent to `outfile` (or
+// discarded). Exit with a message if it fails. Returns elapsed seconds.
+static double run(const std::vector<std::string>& args,
+                  const std::string& outfile = std::string()) {
+    if (verbose) {
+        std::string s;
+        for (const auto& a : args) {
+            s += (s.empty() ? "" : " ") + a;
+        }
+        fprintf(stderr, "+ %s\n", s.c_str());
+    }
+    double t0 = now();
+    pid_t p = fork();
+    if (p == 0) {
+        int fd = open(outfile.empty() ? "/dev/null" : outfile.c_str(),
+                      O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+        }
+        std::vector<char*> argv;
+        for (const auto& a : args) {
+            argv.push_back(const_cast<char*>(a.c_str()));
+        }
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    int status;
+    if (p < 0 || waitpid(p, &status, 0) != p
+        || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "bench-pa-jail: `%s` failed\n", args[0].c_str());
+        exit(1);
+    }
+    return now() - t0;
+}
+
+static void write_file(const std::string& path, const std::string& data) {
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f || fwrite(data.data(), 1, data.size(), f) != data.size() || fclose(f) != 0) {
+        perror(path.c_str());
+        exit(1);
+    }
+}
+
+
+// the synthetic source tree
+
+struct source_tree {
+    std::vector<std::string> files;     // absolute source paths, manifest order
+    unsigned long long bytes = 0;
+    std::string manifest;               // manifest file naming every entry
+};
+
+// Build (or rebuild) a deterministic tree of `nfiles` entries under `srcdir`:
+// mostly small files in a two-level directory fan-out, some larger ones, a
+// sparse file, hard-linked pairs, symbolic links, set-id and non-root-owned
+// files -- the things `cp -p` must preserve.
+static source_tree make_source_tree() {
+    source_tree t;
+    run({"/bin/rm", "-rf", srcdir});
+    run({"/bin/mkdir", "-p", srcdir + "/tree"});
+    unsigned rnd = 61;
+    auto rand = [&] () {
+        rnd = rnd * 1103515245 + 12345;
+        return (rnd >> 16) & 0x7FFF;
+    };
+    std::string chunk(1 << 20, 'x');
+    for (size_t i = 0; i != chunk.size(); ++i) {
+        chunk[i] = 'a' + (i * 7 + i / 13) % 26;
+    }
+    for (int i = 0; i != nfiles; ++i) {
+        std::string dir = std::format("{}/tree/d{:02}/e{:02}", srcdir, i % 37, i % 11);
+        if (i < 37 * 11) {
+            run({"/bin/mkdir", "-p", dir});
+        }
+        std::string path = std::format("{}/f{:05}", dir, i);
+        if (i % 97 == 5 && i > 5) {
+            // symbolic link to an earlier file in the same directory
+            std::string target = std::format("f{:05}", i - 37 * 11);
+            if (access((dir + "/" + target).c_str(), F_OK) == 0
+                && symlink(target.c_str(), path.c_str()) == 0) {
+                t.files.push_back(path);
+                continue;
+            }
+        }
+        if (i % 89 == 7 && i > 7) {
+            // hard link to the previous regular file
+            std::string prev = t.files.back();
+            struct stat st;
+            if (lstat(prev.c_str(), &st) == 0 && S_ISREG(st.st_mode)
+                && link(prev.c_str(), path.c_str()) == 0) {
+                t.files.push_back(path);
+                continue;
+            }
+        }
+        size_t size = i % 50 == 0 ? (1 << 20) + rand() : rand() % 16384;
+        write_file(path, chunk.substr(i % 4096, std::min(size, chunk.size() - 4096)));
+        t.bytes += std::min(size, chunk.size() - 4096);
+        if (i % 13 == 3) {
+            chmod(path.c_str(), 04755);
+        } else if (i % 7 == 1) {
+            chmod(path.c_str(), 0640);
+        }
+        if (i % 11 == 2) {
+            lchown(path.c_str(), 1, 1);
+        }
+        t.files.push_back(path);
+    }
+    // one large sparse file: 64 MiB, mostly hole
+    std::string sparse = srcdir + "/tree/sparse";
+    int fd = open(sparse.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || pwrite(fd, chunk.data(), 65536, 0) != 65536
+        || pwrite(fd, chunk.data(), 65536, 32 << 20) != 65536
+        || ftruncate(fd, 64 << 20) != 0) {
+        perror(sparse.c_str());
+        exit(1);
+    }
+    close(fd);
+    t.files.push_back(sparse);
+    t.bytes += 131072;
+
+    std::string m;
+    for (const auto& f : t.files) {
+        m += f + "\n";
+    }
+    t.manifest = srcdir + "/manifest";
+    write_file(t.manifest, m);
+    return t;
+}
+
+
+// comparing jails
+
+static std::string read_file(const std::string& path) {
+    std::string s;
+    int fd = open(path.c_str(), O_RDONLY | O_NOFOLLOW);
+    if (fd >= 0) {
+        char buf[65536];
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) > 0) {
+            s.append(buf, n);
+        }
+        close(fd);
+    }
+    return s;
+}
+
+// Compare the trees at `a` and `b` entry by entry: type, mode, owner, size,
+// device, modification time, symbolic link text, and file contents. Append
+// differences to `diffs`.
+static void compare_trees(const std::string& a, const std::string& b,
+                          const std::string& sub, std::vector<std::string>& diffs) {
+    std::vector<std::string> names[2];
+    for (int i = 0; i != 2; ++i) {
+        if (DIR* d = opendir(((i ? b : a) + sub).c_str())) {
+            while (struct dirent* de = readdir(d)) {
+                if (strcmp(de->d_name, ".") != 0 && strcmp(de->d_name, "..") != 0) {
+                    names[i].push_back(de->d_name);
+                }
+            }
+            closedir(d);
+        }
+        std::sort(names[i].begin(), names[i].end());
+    }
+    if (names[0] != names[1]) {
+        diffs.push_back(sub + ": different entries");
+        return;
+    }
+    for (const auto& n : names[0]) {
+        std::string s = sub + "/" + n;
+        struct stat sa, sb;
+        if (lstat((a + s).c_str(), &sa) != 0 || lstat((b + s).c_str(), &sb) != 0) {
+            diffs.push_back(s + ": missing");
+            continue;
+        }
+        if (sa.st_mode != sb.st_mode || sa.st_uid != sb.st_uid
+            || sa.st_gid != sb.st_gid || sa.st_rdev != sb.st_rdev
+            || (!S_ISDIR(sa.st_mode) && sa.st_size != sb.st_size)
+            || (!S_ISDIR(sa.st_mode)
+                && (sa.st_mtim.tv_sec != sb.st_mtim.tv_sec
+                    || sa.st_mtim.tv_nsec != sb.st_mtim.tv_nsec))) {
+            diffs.push_back(std::format("{}: mode {:o}/{:o} owner {}:{}/{}:{} size {}/{}",
+                                        s, sa.st_mode, sb.st_mode, sa.st_uid, sa.st_gid,
+                                        sb.st_uid, sb.st_gid, sa.st_size, sb.st_size));
+        } else if (S_ISDIR(sa.st_mode)) {
+            compare_trees(a, b, s, diffs);
+        } else if (S_ISLNK(sa.st_mode)) {
+            char la[4096], lb[4096];
+            ssize_t na = readlink((a + s).c_str(), la, sizeof(la));
+            ssize_t nb = readlink((b + s).c_str(), lb, sizeof(lb));
+            if (na != nb || na < 0 || memcmp(la, lb, na) != 0) {
+                diffs.push_back(s + ": different link");
+            }
+        } else if (S_ISREG(sa.st_mode)) {
+            if (read_file(a + s) != read_file(b + s)) {
+                diffs.push_back(s + ": different contents");
+            } else if (sa.st_blocks > 2 * sb.st_blocks + 64
+                       || sb.st_blocks > 2 * sa.st_blocks + 64) {
+                diffs.push_back(std::format("{}: blocks {}/{} (holes not preserved)",
+                                            s, sa.st_blocks, sb.st_blocks));
+            }
+        }
+    }
+}
+
+static void expect_same_jails(const std::string& a, const std::string& b) {
+    std::vector<std::string> diffs;
+    compare_trees(a, b, "", diffs);
+    if (!diffs.empty()) {
+        for (size_t i = 0; i != diffs.size() && i != 10; ++i) {
+            fprintf(stderr, "  %s\n", diffs[i].c_str());
+        }
+        fprintf(stderr, "bench-pa-jail: %s and %s differ (%zu differences)\n",
+                a.c_str(), b.c_str(), diffs.size());
+        exit(1);
+    }
+    printf("  jails identical\n");
+}
+
+
+// timing
+
+// One `pa-jail` configuration under test: a name, and the extra arguments it
+// passes to `pa-jail add`.
+struct config {
+    std::string name;
+    std::vector<std::string> args;
+};
+
+static std::string jaildir_for(const config& c) {
+    return jailbase + "/" + c.name;
+}
+
+static void rm_jail(const std::string& dir) {
+    run({pajail_path(), "rm", "-f", dir});
+}
+
+// The `# ...` counter lines `pa-jail -V` printed to `outfile`, indented.
+static std::string counter_lines(const std::string& outfile) {
+    std::string out = read_file(outfile), r;
+    for (size_t pos = 0; pos < out.size(); ) {
+        size_t eol = std::min(out.find('\n', pos), out.size());
+        if (out[pos] == '#') {
+            r += "      " + out.substr(pos, eol - pos) + "\n";
+        }
+        pos = eol + 1;
+    }
+    return r;
+}
+
+// Time `pa-jail add -V -f MANIFEST` for configuration `c` into a fresh jail,
+// best of `nrepeat` runs. Leaves the last jail in place for comparison, and
+// its counters in `counters`.
+static double time_add(const config& c, const source_tree& t,
+                       std::string* counters = nullptr) {
+    std::string dir = jaildir_for(c), outfile = srcdir + "/" + c.name + ".out";
+    double best = 1e30;
+    for (int i = 0; i != nrepeat; ++i) {
+        rm_jail(dir);
+        std::vector<std::string> args{pajail_path(), "add", "-V"};
+        args.insert(args.end(), c.args.begin(), c.args.end());
+        args.insert(args.end(), {"-f", t.manifest, dir});
+        best = std::min(best, run(args, outfile));
+    }
+    if (counters) {
+        *counters = counter_lines(outfile);
+    }
+    return best;
+}
+
+// Time `pa-jail rm -V` for configuration `c` (whose arguments must suit `rm`
+// as well as `add`), best of `nrepeat` runs, each on a jail just built by
+// `add`.
+static double time_rm(const config& c, const source_tree& t,
+                      std::string* counters = nullptr) {
+    std::string dir = jaildir_for(c), outfile = srcdir + "/" + c.name + ".rm.out";
+    double best = 1e30;
+    for (int i = 0; i != nrepeat; ++i) {
+        rm_jail(dir);
+        run({pajail_path(), "add", "-f", t.manifest, dir});
+        std::vector<std::string> args{pajail_path(), "rm", "-V"};
+        args.insert(args.end(), c.args.begin(), c.args.end());
+        args.push_back(dir);
+        best = std::min(best, run(args, outfile));
+    }
+    if (counters) {
+        *counters = counter_lines(outfile);
+    }
+    return best;
+}
+
+// Time `pa-jail add -V -f MANIFEST` for configuration `c` into a jail that
+// the same command has already populated, best of `nrepeat` runs.
+static double time_readd(const config& c, const source_tree& t,
+                         std::string* counters = nullptr) {
+    std::string dir = jaildir_for(c), outfile = srcdir + "/" + c.name + ".readd.out";
+    std::vector<std::string> args{pajail_path(), "add", "-V"};
+    args.insert(args.end(), c.args.begin(), c.args.end());
+    args.insert(args.end(), {"-f", t.manifest, dir});
+    rm_jail(dir);
+    run(args);
+    double best = 1e30;
+    for (int i = 0; i != nrepeat; ++i) {
+        best = std::min(best, run(args, outfile));
+    }
+    if (counters) {
+        *counters = counter_lines(outfile);
+    }
+    return best;
+}
+
+static void print_time(const char* what, const config& c, double t, double base,
+                       const std::string& counters = std::string()) {
+    printf("  %-10s %-4s %8.3fs", c.name.c_str(), what, t);
+    if (base > 0 && t > 0) {
+        printf("   %5.2fx", base / t);
+    }
+    printf("\n%s", counters.c_str());
+}
+
+
+// benchmarks
+
+// Native copy vs. a forked `/bin/cp -p` per file (`--copy=cp`).
+static void bench_copy(const source_tree& t) {
+    config cp{"cp", {"--copy=cp", "--jobs", "1"}},
+        native{"native", {"--copy=native", "--jobs", "1"}};
+    printf("bench copy: %zu entries, %llu data bytes\n", t.files.size(), t.bytes);
+    double tcp = time_add(cp, t);
+    print_time("add", cp, tcp, 0);
+    double tnative = time_add(native, t);
+    print_time("add", native, tnative, tcp);
+    expect_same_jails(jaildir_for(cp), jaildir_for(native));
+    rm_jail(jaildir_for(cp));
+    rm_jail(jaildir_for(native));
+}
+
+// Reflink-first copying (`--copy=reflink`) vs. native byte copies. On a
+// copy-on-write file system (btrfs, XFS with reflink=1) every copy should be a
+// reflink; elsewhere each file falls back to a byte copy.
+static void bench_reflink(const source_tree& t) {
+    config native{"native", {"--copy=native", "--jobs", "1"}},
+        reflink{"reflink", {"--copy=reflink", "--jobs", "1"}};
+    printf("bench reflink: %zu entries, %llu data bytes\n", t.files.size(), t.bytes);
+    std::string nc, rc;
+    double tnative = time_add(native, t, &nc);
+    print_time("add", native, tnative, 0, nc);
+    double treflink = time_add(reflink, t, &rc);
+    print_time("add", reflink, treflink, tnative, rc);
+    expect_same_jails(jaildir_for(native), jaildir_for(reflink));
+    rm_jail(jaildir_for(native));
+    rm_jail(jaildir_for(reflink));
+}
+
+// Parallel population (`--jobs N`) vs. one copying thread. The gain depends on
+// storage latency more than on CPUs: network-backed storage gains even on a
+// single core.
+static void bench_jobs(const source_tree& t) {
+    printf("bench jobs: %zu entries, %llu data bytes\n", t.files.size(), t.bytes);
+    config serial{"jobs1", {"--jobs", "1"}};
+    double tserial = time_add(serial, t);
+    print_time("add", serial, tserial, 0);
+    for (const char* n : {"4", "8"}) {
+        config c{std::string("jobs") + n, {"--jobs", n}};
+        print_time("add", c, time_add(c, t), tserial);
+        expect_same_jails(jaildir_for(serial), jaildir_for(c));
+        rm_jail(jaildir_for(c));
+    }
+    rm_jail(jaildir_for(serial));
+}
+
+// Batched file system calls by io_uring (`--io=uring`) vs. one system call
+// at a time, for `add` and `rm`. The `# io:` counters compare system calls.
+static void bench_uring(const source_tree& t) {
+    config sync{"sync", {"--io=sync"}}, uring{"uring", {"--io=uring"}};
+    printf("bench uring: %zu entries, %llu data bytes\n", t.files.size(), t.bytes);
+    std::string sc, uc;
+    double tsync = time_add(sync, t, &sc);
+    print_time("add", sync, tsync, 0, sc);
+    double turing = time_add(uring, t, &uc);
+    print_time("add", uring, turing, tsync, uc);
+    expect_same_jails(jaildir_for(sync), jaildir_for(uring));
+    tsync = time_rm(sync, t, &sc);
+    print_time("rm", sync, tsync, 0, sc);
+    turing = time_rm(uring, t, &uc);
+    print_time("rm", uring, turing, tsync, uc);
+}
+
+// Parallel removal (`rm --jobs N`) vs. one removing thread. The `# rm:`
+// counters report files per second.
+static void bench_rm(const source_tree& t) {
+    printf("bench rm: %zu entries, %llu data bytes\n", t.files.size(), t.bytes);
+    config serial{"rm1", {"--jobs", "1"}};
+    std::string sc;
+    double tserial = time_rm(serial, t, &sc);
+    print_time("rm", serial, tserial, 0, sc);
+    for (const char* n : {"4", "8"}) {
+        config c{std::string("rm") + n, {"--jobs", n}};
+        std::string cc;
+        double tc = time_rm(c, t, &cc);
+        print_time("rm", c, tc, tserial, cc);
+    }
+}
+
+// Re-adding an unchanged manifest from its compiled cache (`--manifest-cache`)
+// vs. walking the manifest again. Both `lstat` every source and destination;
+// the cache skips parsing and symbolic link walks, and checks on `--jobs`
+// threads.
+static void bench_cache(const source_tree& t) {
+    std::string cachefile = srcdir + "/manifest.cache";
+    unlink(cachefile.c_str());
+    config walk{"walk", {}}, cache{"cache", {"--manifest-cache", cachefile}};
+    printf("bench cache: %zu entries, %llu data bytes\n", t.files.size(), t.bytes);
+    std::string wc, cc;
+    double twalk = time_readd(walk, t, &wc);
+    print_time("readd", walk, twalk, 0, wc);
+    double tcache = time_readd(cache, t, &cc);
+    print_time("readd", cache, tcache, twalk, cc);
+    expect_same_jails(jaildir_for(walk), jaildir_for(cache));
+    rm_jail(jaildir_for(walk));
+    rm_jail(jaildir_for(cache));
+    unlink(cachefile.c_str());
+}
+
+// Cloning a populated golden jail (`pa-jail clone`) vs. populating from the
+// manifest (`add -f`). Root-owned, read-only files are hard-linked; the rest
+// are reflinked or copied.
+static void bench_clone(const source_tree& t) {
+    config add{"add", {}}, golden{"golden", {}}, clone{"clone", {}};
+    printf("bench clone: %zu entries, %llu data bytes\n", t.files.size(), t.bytes);
+    std::string ac;
+    double tadd = time_add(add, t, &ac);
+    print_time("add", add, tadd, 0, ac);
+    time_add(golden, t);
+    std::string dir = jaildir_for(clone), outfile = srcdir + "/clone.out";
+    double tclone = 1e30;
+    for (int i = 0; i != nrepeat; ++i) {
+        rm_jail(dir);
+        tclone = std::min(tclone, run({pajail_path(), "clone", "-V",
+                                       jaildir_for(golden), dir}, outfile));
+    }
+    print_time("clone", clone, tclone, tadd, counter_lines(outfile));
+    expect_same_jails(jaildir_for(add), dir);
+    rm_jail(jaildir_for(add));
+    rm_jail(jaildir_for(golden));
+    rm_jail(dir);
+}
+
+struct benchmark {
+    const char* name;
+    std::function<void(const source_tree&)> f;
+};
+
+static const benchmark benchmarks[] = {
+    { "copy", bench_copy },
+    { "reflink", bench_reflink },
+    { "jobs", bench_jobs },
+    { "uring", bench_uring },
+    { "rm", bench_rm },
+    { "cache", bench_cache },
+    { "clone", bench_clone }
+};
+
+int main(int argc, char** argv) {
+    std::vector<std::string> which;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--files" && i + 1 < argc) {
+            nfiles = atoi(argv[++i]);
+        } else if (a == "--repeat" && i + 1 < argc) {
+            nrepeat = atoi(argv[++i]);
+        } else if (a == "--jaildir" && i + 1 < argc) {
+            jailbase = argv[++i];
+        } else if (a == "--srcdir" && i + 1 < argc) {
+            srcdir = argv[++i];
+        } else if (a == "--verbose" || a == "-V") {
+            verbose = true;
+        } else if (a[0] != '-') {
+            which.push_back(a);
+        } else {
+            fprintf(stderr, "usage: %s [--files N] [--repeat N] [--jaildir DIR] [--srcdir DIR] [BENCH...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (nfiles < 1 || nrepeat < 1 || srcdir.empty() || srcdir[0] != '/') {
+        fprintf(stderr, "bench-pa-jail: bad arguments\n");
+        return 1;
+    }
+    if (geteuid() != 0) {
+        fprintf(stderr, "bench-pa-jail: must run as root\n");
+        return 1;
+    }
+
+    source_tree t = make_source_tree();
+    for (const auto& b : benchmarks) {
+        if (which.empty() || std::find(which.begin(), which.end(), b.name) != which.end()) {
+            b.f(t);
+        }
+    }
+    run({"/bin/rm", "-rf", srcdir});
+    return 0;
+}
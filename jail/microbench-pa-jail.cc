@@ -0,0 +1,453 @@
+// microbench-pa-jail.cc -- in-process benchmarks for pa-jail data structures
+// Peteramati is Copyright (c) 2013-2026 Eddie Kohler and others
+// See LICENSE for open-source distribution terms
+//
+// Unlike bench-pa-jail, which times the real `./pa-jail` binary as root, this
+// driver links pa-jail's modules and times them directly against the code
+// they replaced, on a synthetic manifest. It counts heap allocations by
+// replacing the global `operator new`. Needs no privileges.
+//
+//   ./microbench-pa-jail                run every benchmark
+//   ./microbench-pa-jail paths manifest run only the named benchmark(s)
+//   ./microbench-pa-jail --lines N      manifest lines [20000]
+//   ./microbench-pa-jail --repeat N     runs per configuration; best time wins [5]
+
+#undef NDEBUG
+#include "pa-jpath.hh"
+#include "pa-jmanifest.hh"
+#include "pa-jutil.hh"
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <cctype>
+#include <algorithm>
+#include <atomic>
+#include <format>
+#include <functional>
+#include <new>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+
+static int nlines = 20000;
+static int nrepeat = 5;
+
+static std::atomic<unsigned long long> nallocs;
+
+// not inlined, so the compiler does not pair `free` with `new` at call sites
+__attribute__((noinline)) void* operator new(size_t n) {
+    ++nallocs;
+    if (void* p = malloc(n ? n : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Best time and the allocations of one run of `f`, over `nrepeat` runs.
+struct measurement {
+    double t = 1e30;
+    unsigned long long allocs = 0;
+};
+
+static measurement measure(const std::function<void()>& f) {
+    measurement m;
+    for (int i = 0; i != nrepeat; ++i) {
+        unsigned long long a0 = nallocs;
+        double t0 = now();
+        f();
+        m.t = std::min(m.t, now() - t0);
+        m.allocs = nallocs - a0;
+    }
+    return m;
+}
+
+static void print_measurement(const char* name, const measurement& m,
+                              const measurement* base = nullptr) {
+    printf("  %-10s %8.3fms %10llu allocations", name, m.t * 1000, m.allocs);
+    if (base && m.t > 0) {
+        printf("   %5.2fx", base->t / m.t);
+    }
+    printf("\n");
+}
+
+
+// the synthetic manifest
+
+// Destination paths in a library-like tree: a few hundred directories two
+// to four levels under `/usr/lib/x86_64-linux-gnu`, in directory order as a
+// generated manifest lists them, with every 16th line a hard link to the line
+// before.
+struct manifest_line {
+    std::string subdst;
+    dev_t dev;
+    ino_t ino;
+};
+
+static std::vector<manifest_line> make_manifest() {
+    std::vector<manifest_line> m;
+    for (int i = 0; i != nlines; ++i) {
+        int pkg = i / 60, sub = (i / 15) % 4;
+        std::string d = std::format("/usr/lib/x86_64-linux-gnu/pkg{:04}", pkg);
+        if (sub != 0) {
+            d += std::format("/sub{}/share", sub);
+        }
+        ino_t ino = i % 16 == 15 ? m.back().ino : 1000 + i;
+        m.push_back({std::format("{}/lib{:05}.so.{}", d, i, i % 7), 2049, ino});
+    }
+    return m;
+}
+
+
+// benchmarks
+
+typedef std::pair<dev_t, ino_t> devino;
+namespace std { template <> struct hash<devino> {
+    std::size_t operator()(const devino& di) const {
+        return di.second | (di.first << (sizeof(std::size_t) - 8));
+    }
+}; }
+
+static const std::string dstroot = "/jails/user/root";
+
+// The table work `handle_copy` and `do_copy` did per manifest line before
+// the path arena: fresh strings for the destination and its parent, node-based
+// maps keyed and valued by `std::string`.
+struct std_tables {
+    std::unordered_map<std::string, int> dst_table;
+    std::unordered_map<devino, std::string> devino_table;
+    std::string last_parentdir;
+    unsigned long long links = 0;
+
+    int handle(std::string subdst, const manifest_line* ml) {
+        std::string dst = dstroot + subdst;
+        if (dst_table.find(dst) != dst_table.end()) {
+            return 1;
+        }
+        dst_table[dst] = 1;
+        std::string dst_parentdir = path_noendslash(path_parentdir(dst));
+        if (dst_parentdir != last_parentdir
+            && dst_parentdir.length() > dstroot.length()) {
+            last_parentdir = dst_parentdir;
+            if (dst_table.find(last_parentdir) == dst_table.end()) {
+                handle(last_parentdir.substr(dstroot.length()), nullptr);
+            }
+        }
+        if (ml) {
+            auto di = std::make_pair(ml->dev, ml->ino);
+            auto it = devino_table.find(di);
+            if (it != devino_table.end()) {
+                links += it->second.length() != 0;
+            } else {
+                devino_table.insert(std::make_pair(di, dst));
+            }
+        }
+        return 0;
+    }
+};
+
+// The same work with `path_table`, `flat_table`, and a `path_arena`.
+struct arena_tables {
+    path_table<int> dst_table;
+    flat_table<devino, std::string_view> devino_table;
+    path_arena devino_paths;
+    std::string last_parentdir;
+    unsigned long long links = 0;
+
+    int handle(std::string subdst, const manifest_line* ml) {
+        std::string dst;
+        dst.reserve(dstroot.length() + subdst.length());
+        dst.append(dstroot).append(subdst);
+        if (!dst_table.insert(dst, 1).second) {
+            return 1;
+        }
+        std::string_view dst_parentdir(dst.data(), dst.rfind('/'));
+        if (dst_parentdir != last_parentdir
+            && dst_parentdir.length() > dstroot.length()) {
+            last_parentdir = dst_parentdir;
+            if (!dst_table.contains(last_parentdir)) {
+                handle(last_parentdir.substr(dstroot.length()), nullptr);
+            }
+        }
+        if (ml) {
+            auto [v, inserted] = devino_table.insert({ml->dev, ml->ino}, {});
+            if (!inserted) {
+                links += v->length() != 0;
+            } else {
+                *v = devino_paths.intern(dst);
+            }
+        }
+        return 0;
+    }
+};
+
+// Destination and hard link tables, as populated for each manifest line.
+static void bench_paths(const std::vector<manifest_line>& m) {
+    printf("bench paths: %zu lines\n", m.size());
+    size_t ndst = 0, nlinks = 0;
+    auto s = measure([&] {
+        std_tables t;
+        for (auto& ml : m) {
+            t.handle(ml.subdst, &ml);
+        }
+        ndst = t.dst_table.size();
+        nlinks = t.links;
+    });
+    print_measurement("std", s);
+    auto a = measure([&] {
+        arena_tables t;
+        for (auto& ml : m) {
+            t.handle(ml.subdst, &ml);
+        }
+        assert(t.dst_table.size() == ndst && t.links == nlinks);
+    });
+    print_measurement("arena", a, &s);
+    printf("  %zu destinations, %zu hard links\n", ndst, nlinks);
+}
+
+// The manifest text for the same lines, as a generator writes it: a `DIR:`
+// header per directory, names relative to it, and now and then an absolute
+// name, a renamed copy, or options.
+static std::string make_manifest_text(const std::vector<manifest_line>& m) {
+    std::string text = "# synthetic manifest\n/etc/passwd\n/bin/sh [cp]\n";
+    std::string_view lastdir;
+    for (size_t i = 0; i != m.size(); ++i) {
+        std::string_view p = m[i].subdst;
+        size_t slash = p.rfind('/');
+        if (i % 50 == 49) {
+            text.append(p).append(" <- /opt").append(p).push_back('\n');
+            continue;
+        } else if (p.substr(0, slash) != lastdir) {
+            lastdir = p.substr(0, slash);
+            text.append(lastdir).append(":\n");
+        }
+        text.append(p.substr(slash + 1));
+        text.append(i % 200 == 0 ? " [cp]\n" : "\n");
+    }
+    text.append("/proc [mount proc rw]\n/home/x [bind-ro t /home/x.files]\n");
+    return text;
+}
+
+// The parser `construct_jail` ran before pa-jmanifest: the same rules, with
+// a fresh `std::string` for every field of every entry.
+struct std_manifest_entry {
+    std::string src, dst;
+    int flags = 0;
+    std::string bind_tag, bind_files, mount_dst, mount_args;
+};
+
+static const char* std_wordskip(const char* s) {
+    while (*s != ']' && *s != ';' && !isspace((unsigned char) *s)) {
+        ++s;
+    }
+    return s;
+}
+
+static std::vector<std_manifest_entry> std_parse(const std::string& str) {
+    std::vector<std_manifest_entry> entries;
+    std::string cursrcdir("/"), curdstsubdir("/");
+    std::string bind_tag, bind_files, mount_dst, mount_args;
+    const char* pos = str.data(), *endpos = pos + str.length();
+    while (pos < endpos) {
+        while (pos < endpos && isspace((unsigned char) *pos)) {
+            ++pos;
+        }
+        const char* line = pos;
+        while (pos < endpos && *pos != '\n') {
+            ++pos;
+        }
+        const char* endline = pos;
+        while (line < endline && isspace((unsigned char) endline[-1])) {
+            --endline;
+        }
+        if (line == endline || line[0] == '#') {
+            continue;
+        }
+        if (endline[-1] == ':') {
+            if (line + 2 == endline && line[0] == '.') {
+                cursrcdir = std::string("/");
+            } else {
+                cursrcdir = std::string(line, endline - 1);
+            }
+            if (cursrcdir[0] != '/') {
+                cursrcdir = std::string("/") + cursrcdir;
+            }
+            while (cursrcdir.length() > 1
+                   && cursrcdir[cursrcdir.length() - 1] == '/'
+                   && cursrcdir[cursrcdir.length() - 2] == '/') {
+                cursrcdir = cursrcdir.substr(0, cursrcdir.length() - 1);
+            }
+            if (cursrcdir[cursrcdir.length() - 1] != '/') {
+                cursrcdir += '/';
+            }
+            curdstsubdir = cursrcdir;
+            continue;
+        }
+        int flags = 0;
+        if (endline[-1] == ']') {
+            for (--endline; line < endline && endline[-1] != '['; --endline) {
+            }
+            if (line == endline) {
+                continue;
+            }
+            const char* opts = endline;
+            do {
+                --endline;
+            } while (line < endline && isspace((unsigned char) endline[-1]));
+            while (true) {
+                while (isspace((unsigned char) *opts) || *opts == ';') {
+                    ++opts;
+                }
+                if (*opts == ']') {
+                    break;
+                }
+                const char* optstart = opts;
+                opts = std_wordskip(opts + 1);
+                std::string opt(optstart, opts);
+                int want = 0;
+                if (opt == "cp") {
+                    flags |= FLAG_CP;
+                } else if (opt == "bind" || opt == "bind-ro") {
+                    flags |= opt == "bind" ? FLAG_BIND : FLAG_BIND_RO;
+                    want = FLAG_BIND;
+                } else if (opt == "mount") {
+                    flags |= FLAG_MOUNT;
+                    want = FLAG_MOUNT;
+                }
+                if (want != 0) {
+                    while (isspace((unsigned char) *opts)) {
+                        ++opts;
+                    }
+                    const char* w = opts;
+                    opts = std_wordskip(opts);
+                    (want == FLAG_BIND ? bind_tag : mount_dst) = std::string(w, opts);
+                    while (isspace((unsigned char) *opts)) {
+                        ++opts;
+                    }
+                    w = opts;
+                    if (want == FLAG_BIND) {
+                        opts = std_wordskip(opts);
+                        bind_files = std::string(w, opts);
+                    } else {
+                        while (*opts != ']' && *opts != ';') {
+                            ++opts;
+                        }
+                        mount_args = std::string(w, opts);
+                    }
+                }
+                while (*opts != ']' && *opts != ';') {
+                    ++opts;
+                }
+            }
+        }
+        std_manifest_entry me;
+        const char* arrow = (const char*) memmem(line, endline - line, " <- ", 4);
+        if (arrow) {
+            me.src = std::string(arrow + 4, endline);
+        } else if (line[0] == '/') {
+            me.src = std::string(line, endline);
+        } else {
+            me.src = cursrcdir + std::string(line, endline);
+        }
+        if (!arrow) {
+            arrow = endline;
+        }
+        me.dst = curdstsubdir + std::string(line + (line[0] == '/'), arrow);
+        me.flags = flags;
+        if (flags & (FLAG_BIND | FLAG_BIND_RO)) {
+            me.bind_tag = bind_tag;
+            me.bind_files = bind_files;
+        } else if (flags & FLAG_MOUNT) {
+            me.mount_dst = mount_dst;
+            me.mount_args = mount_args;
+        }
+        entries.push_back(std::move(me));
+    }
+    return entries;
+}
+
+// Parsing the manifest text into entries.
+static void bench_manifest(const std::vector<manifest_line>& ml) {
+    std::string text = make_manifest_text(ml);
+    printf("bench manifest: %zu bytes\n", text.length());
+    std::vector<std_manifest_entry> se;
+    auto s = measure([&] {
+        se = std_parse(text);
+    });
+    print_measurement("std", s);
+    auto a = measure([&] {
+        manifest m;
+        m.parse(text);
+        assert(m.entries.size() == se.size());
+    });
+    manifest m;
+    m.parse(text);
+    for (size_t i = 0; i != se.size(); ++i) {
+        auto& e = m.entries[i];
+        assert(e.src == se[i].src && e.dst == se[i].dst
+               && e.flags == se[i].flags
+               && e.bind_tag == se[i].bind_tag
+               && e.bind_files == se[i].bind_files
+               && e.mount_dst == se[i].mount_dst
+               && e.mount_args == se[i].mount_args);
+    }
+    print_measurement("view", a, &s);
+    printf("  %zu entries, %.0f MB/s, %.2fM lines/s\n", se.size(),
+           text.length() / a.t / 1e6, se.size() / a.t / 1e6);
+}
+
+struct benchmark {
+    const char* name;
+    std::function<void(const std::vector<manifest_line>&)> f;
+};
+
+static const benchmark benchmarks[] = {
+    { "paths", bench_paths },
+    { "manifest", bench_manifest }
+};
+
+int main(int argc, char** argv) {
+    std::vector<std::string> which;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--lines" && i + 1 < argc) {
+            nlines = atoi(argv[++i]);
+        } else if (a == "--repeat" && i + 1 < argc) {
+            nrepeat = atoi(argv[++i]);
+        } else if (a[0] != '-') {
+            which.push_back(a);
+        } else {
+            fprintf(stderr, "usage: %s [--lines N] [--repeat N] [BENCH...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (nlines < 1 || nrepeat < 1) {
+        fprintf(stderr, "microbench-pa-jail: bad arguments\n");
+        return 1;
+    }
+
+    auto m = make_manifest();
+    for (const auto& b : benchmarks) {
+        if (which.empty() || std::find(which.begin(), which.end(), b.name) != which.end()) {
+            b.f(m);
+        }
+    }
+    return 0;
+}
@@ -28,13 +28,19 @@
 #include <utime.h>
 #include <getopt.h>
 #include <fnmatch.h>
+#include <spawn.h>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <format>
 #include <iostream>
 #include <list>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <sys/ioctl.h>
 #include <sys/file.h>
@@ -43,6 +49,7 @@
 #include <mntent.h>
 #include <sched.h>
 #include <linux/sched.h>        // struct clone_args, CLONE_INTO_CGROUP
+#include <sys/inotify.h>
 #include <sys/signalfd.h>
 #include <sys/sysmacros.h>
 #include <sys/syscall.h>
@@ -55,11 +62,14 @@
 #endif
 #include "pa-jailconf.hh"
 #include "pa-jutil.hh"
-
-#define FLAG_CP       1        // copy even if source is symlink
-#define FLAG_BIND     2
-#define FLAG_BIND_RO  4
-#define FLAG_MOUNT    8
+#include "pa-jbatch.hh"
+#include "pa-jdirfd.hh"
+#include "pa-jpath.hh"
+#include "pa-jmanifest.hh"
+#include "pa-jelf.hh"
+#include "pa-jfingerprint.hh"
+#include "pa-jpwcache.hh"
+#include "pa-jmountinfo.hh"
 
 #ifndef O_PATH
 #define O_PATH 0
@@ -67,6 +77,12 @@
 #ifndef MS_REMOUNT
 #define MS_REMOUNT 0
 #endif
+#ifndef RENAME_NOREPLACE
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+#ifndef RENAME_EXCHANGE
+#define RENAME_EXCHANGE (1 << 1)
+#endif
 
 typedef std::pair<dev_t, ino_t> devino;
 namespace std { template <> struct hash<devino> {
@@ -78,19 +94,24 @@ namespace std { template <> struct hash<devino> {
 static uid_t caller_owner;
 static gid_t caller_group;
 
-static std::unordered_map<std::string, int> dirtable;
-static std::unordered_map<std::string, int> dst_table;
-static std::unordered_map<devino, std::string> devino_table;
+static path_table<int> dirtable;
+static path_table<int> dst_table;
+static flat_table<devino, std::string_view> devino_table;
+static path_arena devino_paths;     // `devino_table` values
 static bool verbose = false;
 static bool dryrun = false;
 static bool quiet = false;
 static bool doforce = false;
 static bool opt_userns = false;     // `--userns`: run student in a user namespace
+static bool opt_overlay = false;    // `--overlay`: jail root overlays the skeleton
+static bool opt_idmap_home = false; // `--idmap-home`: home stays root-owned, mapped
 static bool no_onlcr = false;
 static long tsize[2] = {80, 25};
 static FILE* verbosefile = stdout;
 static std::string linkdir;
+static std::string linkstore;       // link store root (`linkstore` in the config)
 static std::string dstroot;
+static int dstrootfd = -1;          // `dstroot`, checked (see `jaildirinfo`)
 static int pidfd = -1;
 static std::string pidfilename;
 static std::string pidcontents;
@@ -107,8 +128,96 @@ static int sigpipe[2];
 #endif
 
 enum jailaction {
-    do_start, do_add, do_run, do_rm, do_mv, do_init
+    do_start, do_add, do_run, do_rm, do_mv, do_init, do_gc, do_fingerprint,
+    do_prepare, do_clone, do_reap, do_recycle
+};
+
+// Actions that create the jail directory and populate it.
+static inline bool action_populates(jailaction action) {
+    return action == do_add || action == do_run || action == do_prepare
+        || action == do_clone;
+}
+
+enum copymode {
+    copy_native, copy_cp, copy_reflink
+};
+static copymode opt_copy = copy_native;    // `--copy=MODE`
+static int opt_jobs = 0;                   // `--jobs N`; 0 means one per CPU, at most 8
+static double opt_rate = 0;                // `reap --rate N`: entries removed per second
+
+enum iomode {
+    iomode_sync, iomode_uring
+};
+static iomode opt_io = iomode_sync;        // `--io=MODE`
+static fsbatch fsb;                        // batched file system calls
+static dirfd_cache dst_dirs(128);          // jail directories, rooted at `dstroot`
+static dirfd_cache src_dirs(128);          // source directories
+
+// Population counters, reported under `-V` once the manifest is in place.
+struct populate_stats {
+    unsigned long long files_copied = 0;    // data copied byte by byte
+    unsigned long long bytes_copied = 0;
+    unsigned long long files_reflinked = 0; // extents shared (`--copy=reflink`)
+    unsigned long long bytes_reflinked = 0;
+    unsigned long long files_linked = 0;    // hard-linked from the link store
+    unsigned long long files_stored = 0;    // of those, newly added to it
+    unsigned long long bytes_stored = 0;
+    unsigned long long dir_lookups = 0;     // copy workers' `dirfd_cache`s
+    unsigned long long dirs_opened = 0;
+    unsigned long long symlinks = 0;        // symbolic link targets expanded
+    unsigned long long symlinks_memoized = 0;   // of those, from `symlink_memo`
+    unsigned long long symlinks_done = 0;   // of those, already populated
+
+    populate_stats& operator+=(const populate_stats& x);
+    void report() const;
+};
+static populate_stats pstats;
+
+// What populating decided for each destination. `add -V` reports the counts;
+// `add --plan=json` populates nothing and prints the counts and decisions.
+enum plan_op { plan_create, plan_replace, plan_skip };
+enum plan_type {
+    plan_file, plan_link, plan_store, plan_dir, plan_symlink, plan_node
 };
+struct populate_plan {
+    struct entry {
+        plan_op op;
+        plan_type type;
+        std::string dst;
+        std::string src;        // source file, link target, or symlink text
+        unsigned long long bytes;
+    };
+    unsigned long long create = 0;      // destinations that did not exist
+    unsigned long long replace = 0;     // differing destinations, made anew
+    unsigned long long skip = 0;        // destinations that already match
+    unsigned long long remove = 0;      // existing entries unlinked first
+    unsigned long long dirs = 0;        // directories created
+    unsigned long long copy_files = 0;  // regular files copied
+    unsigned long long copy_bytes = 0;
+    unsigned long long link_files = 0;  // regular files hard-linked, in the
+                                        // jail or from the link store
+    bool record = false;                // keep `entries` (`--plan=json`)
+    std::vector<entry> entries;
+
+    void add(plan_op op, plan_type type, const std::string& dst,
+             const std::string& src, unsigned long long bytes = 0);
+    void report() const;
+    void print_json(FILE* f) const;
+};
+static populate_plan pplan;
+static bool opt_plan = false;
+
+static plan_type plan_type_of(const struct stat& ss) {
+    if (S_ISDIR(ss.st_mode)) {
+        return plan_dir;
+    } else if (S_ISLNK(ss.st_mode)) {
+        return plan_symlink;
+    } else if (S_ISREG(ss.st_mode)) {
+        return plan_file;
+    } else {
+        return plan_node;
+    }
+}
 
 
 static const char* uid_to_name(uid_t u) {
@@ -177,22 +286,6 @@ static int x_fchown(int fd, uid_t owner, gid_t group, const std::string& path) {
     return 0;
 }
 
-static int x_fchown_path(int fd, uid_t owner, gid_t group, const std::string& path) {
-    if (verbose) {
-        fprintf(verbosefile, "chown -h %s:%s %s\n", uid_to_name(owner), gid_to_name(group), path.c_str());
-    }
-#if O_PATH != 0
-    if (!dryrun && fchownat(fd, "", owner, group, AT_EMPTY_PATH) != 0) {
-        return perror_fail("chown %s: %s\n", path.c_str());
-    }
-#else
-    if (!dryrun && fchown(fd, owner, group) != 0) {
-        return perror_fail("chown %s: %s\n", path.c_str());
-    }
-#endif
-    return 0;
-}
-
 static int v_mkdir(const char* pathname, mode_t mode) {
     if (verbose) {
         fprintf(verbosefile, "mkdir -m 0%o %s\n", mode, pathname);
@@ -222,9 +315,8 @@ static int v_mkdirat(int dirfd, const char* component, mode_t mode, const std::s
 // are also root-owned config.
 static int v_ensuredir(std::string pathname, mode_t mode) {
     pathname = path_noendslash(pathname);
-    auto it = dirtable.find(pathname);
-    if (it != dirtable.end()) {
-        return it->second;
+    if (int* v = dirtable.find(pathname)) {
+        return *v;
     }
     int r;
     struct stat st;
@@ -241,25 +333,10 @@ static int v_ensuredir(std::string pathname, mode_t mode) {
             r = v_mkdir(pathname.c_str(), mode) ? : 1;
         }
     }
-    dirtable.insert(std::make_pair(pathname, r == 1 ? 0 : r));
+    dirtable.insert(pathname, r == 1 ? 0 : r);
     return r;
 }
 
-static int x_link(const char* oldpath, const char* newpath) {
-    if (verbose) {
-        fprintf(verbosefile, "rm -f %s\nln %s %s\n", newpath, oldpath, newpath);
-    }
-    if (!dryrun) {
-        if (unlink(newpath) == -1 && errno != ENOENT) {
-            return perror_fail("rm %s: %s\n", newpath);
-        }
-        if (link(oldpath, newpath) != 0) {
-            return perror_fail("ln %s: %s\n", (std::string(oldpath) + " " + std::string(newpath)).c_str());
-        }
-    }
-    return 0;
-}
-
 static int x_chmod(const char* path, mode_t mode) {
     if (verbose) {
         fprintf(verbosefile, "chmod 0%o %s\n", mode, path);
@@ -292,18 +369,6 @@ static const char* dev_name(mode_t m, dev_t d) {
     return buf;
 }
 
-static int x_mknod(const char* path, mode_t mode, dev_t dev) {
-    if (verbose) {
-        fprintf(verbosefile, "mknod -m 0%o %s %s\n", mode, path, dev_name(mode, dev));
-    }
-    if (!dryrun
-        && mknod(path, mode, dev) != 0
-        && (errno != EEXIST || !x_mknod_eexist_ok(path, mode, dev))) {
-        return perror_fail("mknod %s: %s\n", path);
-    }
-    return 0;
-}
-
 // The only device nodes pa-jail will create, matched by major:minor (the kernel
 // driver, not the manifest path). `mknod` wields the setuid binary's root
 // authority, so an arbitrary manifest-named node (`/dev/mem`, a raw disk) would
@@ -351,25 +416,6 @@ static int x_symlink(const char* oldpath, const char* newpath) {
     return 0;
 }
 
-static int x_copy_utimes(const char* path, const struct stat& st) {
-    if (verbose) {
-        fprintf(verbosefile, "touch -m -d @%ld %s\n", st.st_mtime, path);
-    }
-    if (!dryrun) {
-        struct timespec ts[2];
-        ts[0].tv_nsec = UTIME_OMIT;
-#if __linux__
-        ts[1] = st.st_mtim;
-#else
-        ts[1] = st.st_mtimespec;
-#endif
-        if (utimensat(-1, path, ts, AT_SYMLINK_NOFOLLOW) != 0) {
-            return perror_fail("utimensat %s: %s\n", path);
-        }
-    }
-    return 0;
-}
-
 static std::pair<pid_t, int> x_waitpid(pid_t child, int flags) {
     int status;
     while (true) {
@@ -479,6 +525,26 @@ static const mountarg* find_mountarg(const char* name, int namelen) {
 }
 
 
+// The time each system call of one mount took, for `--verbose`.
+struct mount_timer {
+    struct timespec last;
+    std::string laps;
+    mount_timer() {
+        clock_gettime(CLOCK_MONOTONIC, &last);
+    }
+    void lap(const char* what);
+};
+
+void mount_timer::lap(const char* what) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double ms = (now.tv_sec - last.tv_sec) * 1e3 + (now.tv_nsec - last.tv_nsec) / 1e6;
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s%s %.3fms", laps.empty() ? "" : ", ", what, ms);
+    laps += buf;
+    last = now;
+}
+
 struct mountslot {
     std::string fsname;
     std::string type;
@@ -493,6 +559,7 @@ struct mountslot {
     const char* mount_data() const;
     bool mountable(std::string src, std::string dst) const;
     int x_mount(std::string dst, unsigned long opts);
+    int x_mount_api(const std::string& dst, unsigned long opts, mount_timer& mt);
 };
 
 mountslot::mountslot(const char* fsname_, const char* type_, const char* mopt)
@@ -614,39 +681,214 @@ int mountslot::x_mount(std::string dst, unsigned long opts) {
     return mount(fsname.c_str(), dst.c_str(), type.c_str(), opts, mount_data());
 }
 
+#if __linux__
+static constexpr unsigned long mount_propagation_mask =
+    MS_SHARED | MS_PRIVATE | MS_SLAVE | MS_UNBINDABLE;
+
+// The propagation type `opts` asks for, as one `MS_` flag, or 0. A mount
+// takes one type, so `unbindable` (which is also private) beats `private`,
+// which beats `slave`.
+static unsigned long mount_propagation_of(unsigned long opts) {
+    if (opts & MS_UNBINDABLE) {
+        return MS_UNBINDABLE;
+    } else if (opts & MS_PRIVATE) {
+        return MS_PRIVATE;
+    } else if (opts & MS_SLAVE) {
+        return MS_SLAVE;
+    }
+    return opts & MS_SHARED;
+}
+#endif
 
-typedef std::unordered_map<std::string, mountslot> mount_table_type;
-static mount_table_type mount_table;
+#if __linux__ && defined(SYS_fsopen) && defined(SYS_fsconfig) && defined(SYS_fsmount) \
+    && defined(SYS_open_tree) && defined(SYS_mount_setattr) && defined(SYS_move_mount)
+#define HAVE_MOUNT_API 1
 
-static int populate_mount_table() {
-    static bool mount_table_populated = false;
-    if (mount_table_populated) {
-        return 0;
+static unsigned mount_attr_of(unsigned long opts) {
+    unsigned attr = 0;
+    if (opts & MS_RDONLY) {
+        attr |= MOUNT_ATTR_RDONLY;
     }
-    mount_table_populated = true;
-#if __linux__
-    FILE* f = setmntent("/proc/mounts", "r");
-    if (!f) {
-        return perror_fail("open %s: %s\n", "/proc/mounts");
+    if (opts & MS_NOSUID) {
+        attr |= MOUNT_ATTR_NOSUID;
     }
-    while (struct mntent* me = getmntent(f)) {
-        mountslot ms(me->mnt_fsname, me->mnt_type, me->mnt_opts);
-        mount_table[me->mnt_dir] = ms;
+    if (opts & MS_NODEV) {
+        attr |= MOUNT_ATTR_NODEV;
     }
-    fclose(f);
-    return 0;
-#elif __APPLE__
-    struct statfs* mntbuf;
-    int nmntbuf = getmntinfo(&mntbuf, MNT_NOWAIT);
-    for (struct statfs* me = mntbuf; me != mntbuf + nmntbuf; ++me) {
-        mountslot ms(me->f_mntfromname, me->f_fstypename, "");
-        ms.opts = me->f_flags;
-        mount_table[me->f_mntonname] = ms;
+    if (opts & MS_NOEXEC) {
+        attr |= MOUNT_ATTR_NOEXEC;
+    }
+    if (opts & MS_NODIRATIME) {
+        attr |= MOUNT_ATTR_NODIRATIME;
+    }
+    if (opts & MS_NOATIME) {
+        attr |= MOUNT_ATTR_NOATIME;
+    } else if (opts & MS_STRICTATIME) {
+        attr |= MOUNT_ATTR_STRICTATIME;
+    }
+    return attr;
+}
+
+// Give `fsfd` each option in `data`, as `mount(2)` would.
+static int fsconfig_data(int fsfd, const std::string& data) {
+    size_t pos = 0;
+    while (pos < data.length()) {
+        size_t comma = std::min(data.find(',', pos), data.length());
+        std::string opt = data.substr(pos, comma - pos);
+        pos = comma + 1;
+        size_t eq = opt.find('=');
+        int r = 0;
+        if (eq != std::string::npos) {
+            opt[eq] = '\0';
+            r = syscall(SYS_fsconfig, fsfd, FSCONFIG_SET_STRING,
+                        opt.c_str(), opt.c_str() + eq + 1, 0);
+        } else if (!opt.empty()) {
+            r = syscall(SYS_fsconfig, fsfd, FSCONFIG_SET_FLAG,
+                        opt.c_str(), nullptr, 0);
+        }
+        if (r != 0) {
+            return -1;
+        }
     }
     return 0;
+}
+
+static void close_keep_errno(int fd) {
+    int e = errno;
+    close(fd);
+    errno = e;
+}
+#endif
+
+// Mount with the file descriptor mount API. A new file system instance is
+// configured with `fsopen` and `fsconfig` and gets its flags from `fsmount`;
+// a bind mount clones the source tree with `open_tree`, and `mount_setattr`
+// sets the flags of every mount in the clone at once. A propagation type is
+// set with `mount_setattr` too. Either way the mount is complete before
+// `move_mount` attaches it, so it is never visible without its hardening
+// flags, and no remount is needed. Returns -1 with `errno` set; if the first
+// call fails with `ENOSYS` or `EPERM` (an older kernel, or a seccomp filter),
+// `mt.laps` is empty, and the caller can use `mount(2)`.
+int mountslot::x_mount_api(const std::string& dst, unsigned long opts,
+                           mount_timer& mt) {
+#if HAVE_MOUNT_API
+    unsigned attr = mount_attr_of(opts);
+    unsigned long propagation = mount_propagation_of(opts);
+    int mfd;
+    if (opts & MS_BIND) {
+        unsigned recursive = opts & MS_REC ? AT_RECURSIVE : 0;
+        mfd = syscall(SYS_open_tree, AT_FDCWD, fsname.c_str(),
+                      OPEN_TREE_CLONE | OPEN_TREE_CLOEXEC | recursive);
+        if (mfd < 0) {
+            return -1;
+        }
+        mt.lap("open_tree");
+        if (verbose) {
+            fprintf(verbosefile, "%s\n", debug_mount_command(dst, opts).c_str());
+        }
+        struct mount_attr ma = {};
+        ma.attr_set = attr;
+        if (attr & MOUNT_ATTR__ATIME) {
+            ma.attr_clr = MOUNT_ATTR__ATIME;
+        }
+        ma.propagation = propagation;
+        if ((ma.attr_set || ma.propagation)
+            && syscall(SYS_mount_setattr, mfd, "", AT_EMPTY_PATH | recursive,
+                       &ma, sizeof(ma)) != 0) {
+            close_keep_errno(mfd);
+            return -1;
+        }
+        mt.lap("mount_setattr");
+    } else {
+        int fsfd = syscall(SYS_fsopen, type.c_str(), FSOPEN_CLOEXEC);
+        if (fsfd < 0) {
+            return -1;
+        }
+        mt.lap("fsopen");
+        if (verbose) {
+            fprintf(verbosefile, "%s\n", debug_mount_command(dst, opts).c_str());
+        }
+        if (syscall(SYS_fsconfig, fsfd, FSCONFIG_SET_STRING, "source",
+                    fsname.c_str(), 0) != 0
+            || fsconfig_data(fsfd, data) != 0
+            || ((opts & MS_RDONLY)
+                && syscall(SYS_fsconfig, fsfd, FSCONFIG_SET_FLAG, "ro", nullptr, 0) != 0)
+            || syscall(SYS_fsconfig, fsfd, FSCONFIG_CMD_CREATE, nullptr, nullptr, 0) != 0) {
+            close_keep_errno(fsfd);
+            return -1;
+        }
+        mt.lap("fsconfig");
+        mfd = syscall(SYS_fsmount, fsfd, FSMOUNT_CLOEXEC, attr);
+        close_keep_errno(fsfd);
+        if (mfd < 0) {
+            return -1;
+        }
+        mt.lap("fsmount");
+        if (propagation) {
+            struct mount_attr ma = {};
+            ma.propagation = propagation;
+            if (syscall(SYS_mount_setattr, mfd, "", AT_EMPTY_PATH,
+                        &ma, sizeof(ma)) != 0) {
+                close_keep_errno(mfd);
+                return -1;
+            }
+            mt.lap("mount_setattr");
+        }
+    }
+    int r = syscall(SYS_move_mount, mfd, "", AT_FDCWD, dst.c_str(),
+                    MOVE_MOUNT_F_EMPTY_PATH);
+    close_keep_errno(mfd);
+    mt.lap("move_mount");
+    return r;
+#else
+    (void) dst, (void) opts, (void) mt;
+    errno = ENOSYS;
+    return -1;
 #endif
 }
 
+
+// The host's mounts, and the `mountslot`s looked up so far. `mount_table`
+// also holds the mounts a manifest asks for, which take precedence. Keys have
+// no trailing slash.
+static mount_index mount_info;
+typedef std::unordered_map<std::string, mountslot> mount_table_type;
+static mount_table_type mount_table;
+
+static int populate_mount_table() {
+    if (!mount_info.load()) {
+        return perror_fail("open %s: %s\n", "/proc/self/mountinfo");
+    }
+    return 0;
+}
+
+static std::string mount_key(std::string path) {
+    while (path.length() > 1 && path.back() == '/') {
+        path.pop_back();
+    }
+    return path;
+}
+
+// Return the mount at `path`, or null.
+static mountslot* find_mount(const std::string& path) {
+    std::string key = mount_key(path);
+    auto it = mount_table.find(key);
+    if (it != mount_table.end()) {
+        return &it->second;
+    } else if (const mountinfo_entry* e = mount_info.find(key)) {
+        mountslot ms(e->source.c_str(), e->fstype.c_str(), e->options.c_str());
+        ms.opts |= e->flags;
+        return &mount_table.emplace(std::move(key), std::move(ms)).first->second;
+    }
+    return nullptr;
+}
+
+// Return true if something is mounted at `path`. Unlike `find_mount`, safe
+// to call from several threads at once.
+static bool is_mount_point(const std::string& path) {
+    return mount_info.contains(path) || mount_table.contains(mount_key(path));
+}
+
 // Hardening flags forced onto the jail's own mounts regardless of host config:
 // `nosuid` everywhere; `nodev` except on devpts, whose pty slaves are devices;
 // `noexec` only where nothing should run -- not /tmp, which executes student
@@ -664,36 +906,86 @@ static unsigned long jail_mount_hardening(const std::string& src, const std::str
 }
 #endif
 
+#if __linux__
+// `mount(2)` ignores a bind's propagation flags, and would take them on a new
+// mount as a request to change the type of the mount already at `dst`, so
+// the fallback sets the type of the new mount separately.
+static int x_mount_propagation(const std::string& dst, unsigned long flags) {
+    if (verbose) {
+        const char* what = flags & MS_UNBINDABLE ? "unbindable"
+            : flags & MS_PRIVATE ? "private"
+            : flags & MS_SLAVE ? "slave" : "shared";
+        fprintf(verbosefile, "mount --make-%s%s %s\n",
+                flags & MS_REC ? "r" : "", what, dst.c_str());
+    }
+    return dryrun ? 0 : mount("none", dst.c_str(), nullptr, flags, nullptr);
+}
+
+// A read-only remount of a recursive bind affects only its top mount. Remount
+// the mounts the bind at `dst` brought with it read-only too, keeping their
+// other flags, as the recursive `mount_setattr` does.
+static int remount_below_rdonly(const std::string& dst) {
+    mount_index mi;
+    const mountinfo_entry* top;
+    if (dryrun || !mi.load() || !(top = mi.find(dst))) {
+        return 0;
+    }
+    // skip mounts the bind covered up, which are not in its tree
+    std::vector<uint64_t> tree{top->id};
+    for (const mountinfo_entry* e : mi.below(path_endslash(dst))) {
+        if (std::find(tree.begin(), tree.end(), e->parent_id) == tree.end()) {
+            continue;
+        }
+        tree.push_back(e->id);
+        mountslot ms(e->source.c_str(), e->fstype.c_str(), e->options.c_str());
+        ms.data.clear();
+        unsigned long keep = MS_NOSUID | MS_NODEV | MS_NOEXEC | MS_NOATIME
+            | MS_NODIRATIME | MS_RELATIME | MS_STRICTATIME;
+        if (ms.x_mount(e->path, MS_BIND | MS_REMOUNT | MS_RDONLY
+                       | ((ms.opts | e->flags) & keep)) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+#endif
+
+static int populate_flush();
+static void report_fsbatch();
+
 static int handle_mount(std::string src, std::string dst, bool in_child) {
-    auto it = mount_table.find(src);
-    if (it == mount_table.end()
-        || !it->second.mountable(src, dst)) {
+    mountslot* ms = find_mount(src);
+    if (!ms || !ms->mountable(src, dst)) {
         return 0;
     }
 
-    auto dit = mount_table.find(dst);
-    if (dit != mount_table.end()
-        && dit->second.fsname == it->second.fsname
-        && dit->second.type == it->second.type
-        && dit->second.opts == it->second.opts
-        && dit->second.data == it->second.data
+    mountslot* dms = find_mount(dst);
+    if (dms
+        && dms->fsname == ms->fsname
+        && dms->type == ms->type
+        && dms->opts == ms->opts
+        && dms->data == ms->data
         && !in_child) {
         // already mounted
         return 0;
     }
 
-    auto xit = dst_table.find(dst);
-    if (xit != dst_table.end()
-        && xit->second > 1) {
+    int& dstv = dst_table[dst];
+    if (dstv > 1) {
         return 0;
     }
-    dst_table[dst] = 2;
+    dstv = 2;
 
     if (in_child) {
         v_ensuredir(dst, 0555);
     }
 
-    mountslot msx(it->second);
+    // queued copies under `dst` must land before it is mounted over
+    if (!in_child) {
+        populate_flush();
+    }
+
+    mountslot msx(*ms);
 #if __linux__
     if (in_child) {
         msx.opts |= jail_mount_hardening(src, msx.type);
@@ -706,59 +998,78 @@ static int handle_mount(std::string src, std::string dst, bool in_child) {
         msx.add_mountopt("slave");
     }
 #endif
-    int r = msx.x_mount(dst, msx.opts);
-    // if in child, try one more time with remount
-    if (!dryrun && r != 0 && errno == EBUSY && in_child) {
-        r = msx.x_mount(dst, msx.opts | MS_REMOUNT);
+    mount_timer mt;
+    int r = -1;
+    if (!dryrun) {
+        r = msx.x_mount_api(dst, msx.opts, mt);
     }
+    if (dryrun
+        || (r != 0 && mt.laps.empty() && (errno == ENOSYS || errno == EPERM))) {
+        unsigned long opts = msx.opts;
 #if __linux__
-    // if bind mount, need to remount as slave
-    if (r == 0 && (msx.opts & MS_BIND)) {
-        r = msx.x_mount(dst, msx.opts | MS_REMOUNT);
-    }
+        opts &= ~mount_propagation_mask;
 #endif
+        r = msx.x_mount(dst, opts);
+        mt.lap("mount");
+        // if in child, try one more time with remount
+        if (!dryrun && r != 0 && errno == EBUSY && in_child) {
+            r = msx.x_mount(dst, opts | MS_REMOUNT);
+            mt.lap("remount");
+        }
+#if __linux__
+        // a bind takes its flags only from a remount, and the mounts below
+        // a read-only recursive bind need one each
+        if (r == 0 && (opts & MS_BIND)) {
+            r = msx.x_mount(dst, opts | MS_REMOUNT);
+            mt.lap("remount");
+            if (r == 0 && (opts & MS_REC) && (opts & MS_RDONLY)) {
+                r = remount_below_rdonly(dst);
+                mt.lap("remount below");
+            }
+        }
+        if (r == 0 && mount_propagation_of(msx.opts)) {
+            r = x_mount_propagation(dst, mount_propagation_of(msx.opts)
+                                    | (opts & MS_REC));
+            mt.lap("propagation");
+        }
+#endif
+    }
     if (r != 0) {
         return perror_fail("%s: %s\n", msx.debug_mount_command(dst, msx.opts).c_str());
     }
+    if (verbose && !dryrun) {
+        fprintf(verbosefile, "# mount %s: %s\n", dst.c_str(), mt.laps.c_str());
+    }
     return 0;
 }
 
-static int handle_umount(const mount_table_type::iterator& it) {
+static int handle_umount(const std::string& path) {
     if (verbose) {
-        fprintf(verbosefile, "umount -i -n %s\n", it->first.c_str());
+        fprintf(verbosefile, "umount -i -n %s\n", path.c_str());
     }
-    if (!dryrun && umount(it->first.c_str()) != 0) {
-        fprintf(stderr, "umount %s: %s\n", it->first.c_str(), strerror(errno));
+    if (!dryrun && umount(path.c_str()) != 0) {
+        fprintf(stderr, "umount %s: %s\n", path.c_str(), strerror(errno));
         exit(1);
     }
     if (dryrun) {
-        dst_table[it->first.c_str()] = 3;
+        dst_table[path] = 3;
     }
     return 0;
 }
 
-static std::string unmounted(std::string dir, bool no_change = false) {
+static std::string unmounted(std::string dir) {
 #ifdef MS_BIND
-    auto it = mount_table.find(dir);
-    if (it != mount_table.end()) {
-        return it->second.opts & MS_BIND ? it->second.fsname : dir;
+    if (mountslot* ms = find_mount(dir)) {
+        return ms->opts & MS_BIND ? ms->fsname : dir;
     }
+    std::string key = mount_key(dir);
     for (auto dit = delayed_mounts.begin(); dit != delayed_mounts.end(); dit += 2) {
-        if (dit[1] == dir) {
-            it = mount_table.find(dit[0]);
-            return it->second.opts & MS_BIND ? dit[0] : dir;
+        if (mount_key(dit[1]) == key) {
+            return find_mount(dit[0])->opts & MS_BIND ? dit[0] : dir;
         }
     }
-    if (no_change || dir.empty()) {
-        return dir;
-    } else if (dir.back() == '/') {
-        return unmounted(dir.substr(0, dir.length() - 1), true);
-    }
-    return unmounted(dir + '/', true);
-#else
-    (void) no_change;
-    return dir;
 #endif
+    return dir;
 }
 
 
@@ -766,46 +1077,102 @@ static int handle_copy(std::string src, std::string subdst,
                        int flags, dev_t jaildev);
 static int construct_jail(dev_t jaildev, std::string& str, bool nomount);
 
-static void handle_symlink_dst(std::string dst, std::string src,
-                               std::string lnk, dev_t jaildev)
+// A relative link's target, as far as it depends on the link's source path
+// and text: the target's source path, how many directories to climb from the
+// link's destination, and where in the text the rest of the target starts.
+// A link whose target climbs above `/` has an empty `src`. Keyed by
+// `SRC\0LNK`; merged-/usr and alternatives links are expanded for the jail
+// and the skeleton, and by every link that shares a directory chain.
+struct symlink_expansion {
+    std::string_view src;
+    unsigned up = 0;
+    unsigned rest = 0;
+};
+static path_table<symlink_expansion> symlink_memo;
+static path_arena symlink_memo_paths;
+
+static const symlink_expansion& expand_symlink(const std::string& src,
+                                               const std::string& lnk) {
+    std::string key;
+    key.reserve(src.length() + lnk.length() + 1);
+    key.append(src).push_back('\0');
+    key.append(lnk);
+    auto [x, inserted] = symlink_memo.insert(key, {});
+    if (!inserted) {
+        ++pstats.symlinks_memoized;
+        return *x;
+    }
+
+    std::string_view s(src), l(lnk);
+    while (true) {
+        size_t slash;
+        if (s.length() == 1
+            || (slash = s.rfind('/', s.length() - 2)) == std::string_view::npos) {
+            return *x;
+        }
+        s = s.substr(0, slash + 1);
+        ++x->up;
+        if (l.length() > 3 && l.starts_with("../")) {
+            l.remove_prefix(3);
+        } else {
+            break;
+        }
+    }
+    x->rest = l.data() - lnk.data();
+    key.assign(s).append(l);
+    x->src = symlink_memo_paths.intern(key);
+    return *x;
+}
+
+static void handle_symlink_dst(const std::string& dst, const std::string& src,
+                               const std::string& lnk, dev_t jaildev)
 {
-    std::string root = dstroot;
+    std::string_view root = dstroot;
     if (!linkdir.empty() && dst.substr(0, dstroot.length()) != dstroot) {
         root = linkdir;
     }
 
-    // expand `lnk` into `dst`
+    // expand `lnk` into `tdst`
+    std::string tsrc, tdst;
     if (lnk[0] == '/') {
-        src = lnk;
-        dst = root + lnk;
+        tsrc = lnk;
+        tdst.append(root).append(lnk);
     } else {
-        while (true) {
-            if (src.length() == 1) {
-            give_up:
+        const symlink_expansion& x = expand_symlink(src, lnk);
+        if (x.src.empty()) {
+            return;
+        }
+        size_t dstend = dst.length();
+        for (unsigned i = 0; i != x.up; ++i) {
+            size_t dstslash = dst.rfind('/', dstend - 2);
+            if (dstslash == std::string::npos || dstslash < root.length()) {
                 return;
             }
-            size_t srcslash = src.rfind('/', src.length() - 2),
-                dstslash = dst.rfind('/', dst.length() - 2);
-            if (srcslash == std::string::npos || dstslash == std::string::npos
-                || dstslash < root.length()) {
-                goto give_up;
-            }
-            src = src.substr(0, srcslash + 1);
-            dst = dst.substr(0, dstslash + 1);
-            if (lnk.length() > 3 && lnk[0] == '.' && lnk[1] == '.'
-                && lnk[2] == '/') {
-                lnk = lnk.substr(3);
-            } else {
-                break;
-            }
+            dstend = dstslash + 1;
         }
-        src += lnk;
-        dst += lnk;
+        tsrc = x.src;
+        tdst.append(dst, 0, dstend).append(lnk, x.rest);
     }
 
-    if (dst.substr(root.length(), 6) != "/proc/") {
-        handle_copy(src, dst.substr(root.length()), 0, jaildev);
+    std::string_view subdst(tdst);
+    subdst.remove_prefix(root.length());
+    if (subdst.substr(0, 6) == "/proc/") {
+        return;
     }
+    ++pstats.symlinks;
+    // a chain already expanded stops here; `handle_copy` would find its
+    // destination in `dst_table`
+    std::string_view trimmed = subdst;
+    while (trimmed.length() > 1 && trimmed.back() == '/') {
+        trimmed.remove_suffix(1);
+    }
+    std::string jdst(dstroot);
+    jdst.append(trimmed);
+    if (dst_table.contains(jdst)) {
+        ++pstats.symlinks_done;
+        return;
+    }
+    handle_copy(std::move(tsrc), std::string(subdst), 0, jaildev);
 }
 
 static int x_rm_f(const std::string &dst) {
@@ -822,26 +1189,19 @@ static int x_rm_f(const std::string &dst) {
     return 0;
 }
 
-static int x_cp_p(const std::string& src, const std::string& dst) {
-    if (x_rm_f(dst)) {
-        return 1;
-    }
-    if (verbose) {
-        fprintf(verbosefile, "cp -p %s %s\n", src.c_str(), dst.c_str());
-    }
-    if (dryrun) {
-        return 0;
-    }
-
-    pid_t child = fork();
-    if (child == 0) {
-        const char* args[6] = {
-            "/bin/cp", "-p", src.c_str(), dst.c_str(), nullptr
-        };
-        execv("/bin/cp", (char**) args);
-        exit(1);
-    } else if (child < 0) {
-        return perror_fail("%s: %s\n", "fork");
+// Copy with `/bin/cp -p` (`--copy=cp`): the original method, kept as a
+// reference for the native copier and for benchmarks. Copies run on worker
+// threads, so the child is started with `posix_spawn`, not `fork`.
+static int x_cp_p_exec(const std::string& src, const std::string& dst) {
+    const char* args[6] = {
+        "/bin/cp", "-p", src.c_str(), dst.c_str(), nullptr
+    };
+    extern char** environ;
+    pid_t child;
+    if (int e = posix_spawn(&child, "/bin/cp", nullptr, nullptr,
+                            (char**) args, environ)) {
+        errno = e;
+        return perror_fail("%s: %s\n", "/bin/cp");
     }
 
     int status = x_waitpid(child, 0).second;
@@ -853,77 +1213,687 @@ static int x_cp_p(const std::string& src, const std::string& dst) {
     return perror_fail("/bin/cp %s: Did not exit\n", dst.c_str());
 }
 
-static inline int stat_mtimes_same(const struct stat& st1, const struct stat& st2) {
+// Deferred population work. The plan phase (`construct_jail` walking the
+// manifest) decides what each destination needs, printing the commands under
+// `-V`, and queues the work here; `dst_table` and `devino_table` are only
+// touched by the plan phase. The execute phase (`populate_flush`) then makes
+// the directories a level at a time, parents first; then device nodes and
+// symbolic links; then copies the regular files on `opt_jobs` threads (every
+// parent directory now exists, so the copies are independent); and last makes
+// the hard links, whose targets may be among those copies. Directory, symbolic
+// link, and hard link calls go through `fsb` in batches. Anything whose path
+// passes through a queued symbolic link (`lib` -> `usr/lib`, say) needs that
+// link made first, so queueing one flushes. Two manifest paths can then name
+// one jail file, and the hard link queued for the second finds it already
+// linked. Every
+// call is made relative to its parent directory's descriptor from a
+// `dirfd_cache` (`dst_dirs`, or one per copy thread), so a deep tree costs one
+// lookup per directory rather than one per file, and no path is resolved
+// through a symbolic link out of the jail.
+struct populate_queue {
+    struct job {
+        std::string dst;
+        std::string src;        // copies: source; symbolic links: link text
+        struct stat ss;         // `lstat` of the source
+        bool store = false;     // copies: link from the link store
+    };
+    std::vector<job> dirs;
+    std::vector<job> nodes;
+    std::vector<job> symlinks;
+    std::vector<job> copies;
+    std::vector<std::pair<std::string, std::string>> links;
+    std::unordered_set<std::string> symlink_dsts;
+
+    bool empty() const {
+        return dirs.empty() && nodes.empty() && symlinks.empty()
+            && copies.empty() && links.empty();
+    }
+};
+static populate_queue pqueue;
+
+// Source `lstat` results prefetched by `construct_jail`, each 0 or `-errno`
+// with the status.
+struct prestat {
+    int r;
+    struct stat st;
+};
+static std::unordered_map<std::string, prestat> src_stats;
+
+// `lstat(src)`, using (and consuming) a prefetched result if there is one.
+static int src_lstat(const std::string& src, struct stat& ss) {
+    auto it = src_stats.find(src);
+    if (it == src_stats.end()) {
+        int r = src_dirs.lstat(src, &ss);
+        src_dirs.release();
+        return r;
+    }
+    int r = it->second.r;
+    ss = it->second.st;
+    src_stats.erase(it);
+    if (r < 0) {
+        errno = -r;
+        return -1;
+    }
+    return 0;
+}
+
+static constexpr mode_t perm_mask = S_ISUID | S_ISGID | S_IRWXU | S_IRWXG | S_IRWXO;
+
+// True if a file with `lstat` `ss` may be shared through the link store. Every
+// jail linking an entry shares its inode, so an entry must not be writable by
+// anyone a jail runs as: only root-owned files without group or other write
+// permission qualify.
+static bool linkstore_eligible(const struct stat& ss) {
+    return !linkstore.empty()
+        && S_ISREG(ss.st_mode)
+        && ss.st_uid == ROOT
+        && (ss.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+// The link store entry for a source with `lstat` `ss`: a fan-out directory,
+// then the source's identity -- device, inode, size, change and modification
+// times -- and the mode and group its links carry.
+static std::string linkstore_entry(const struct stat& ss) {
 #if __linux__
-    return st1.st_mtim.tv_sec == st2.st_mtim.tv_sec && st1.st_mtim.tv_nsec == st2.st_mtim.tv_nsec;
+    const struct timespec& ct = ss.st_ctim, &mt = ss.st_mtim;
 #else
-    return st1.st_mtime == st2.st_mtime;
+    const struct timespec& ct = ss.st_ctimespec, &mt = ss.st_mtimespec;
 #endif
+    char buf[256];
+    snprintf(buf, sizeof(buf), "/%02x/%llx-%llx-%llx-%lld.%09ld-%lld.%09ld-%o-%u",
+             (unsigned) (ss.st_ino & 255), (unsigned long long) ss.st_dev,
+             (unsigned long long) ss.st_ino, (unsigned long long) ss.st_size,
+             (long long) ct.tv_sec, (long) ct.tv_nsec,
+             (long long) mt.tv_sec, (long) mt.tv_nsec,
+             (unsigned) (ss.st_mode & perm_mask), (unsigned) ss.st_gid);
+    return linkstore + buf;
 }
 
-static int do_copy(const std::string& dst, const std::string& src,
-                   const struct stat& ss, bool reuse_link, dev_t jaildev) {
-    // a manifest may name any path, but a device node is a root-authority
-    // capability, not data: refuse anything outside the allowlist before it can be
-    // created (or accepted as a pre-existing match below)
-    if ((S_ISCHR(ss.st_mode) || S_ISBLK(ss.st_mode))
-        && !dev_node_allowed(ss.st_mode, ss.st_rdev)) {
-        std::string what = src + " (" + dev_name(ss.st_mode, ss.st_rdev) + ")";
-        return perror_fail("%s: Device node not permitted in jail\n", what.c_str());
+// Queue a copy of `src` to `dst` like `cp -p`. `ss` is the `lstat` of `src`
+// that decided to copy it; the native copier refuses a source that has since
+// been replaced. If `store`, `dst` is instead hard-linked to the source's link
+// store entry, which is made first if need be.
+static int x_cp_p(const std::string& src, const std::string& dst,
+                  const struct stat& ss, bool store = false) {
+    if (verbose && store) {
+        std::string entry = linkstore_entry(ss);
+        fprintf(verbosefile, "rm -f %s\ntest -f %s || cp -p %s %s\nln %s %s\n",
+                dst.c_str(), entry.c_str(), src.c_str(), entry.c_str(),
+                entry.c_str(), dst.c_str());
+    } else if (verbose) {
+        fprintf(verbosefile, "rm -f %s\ncp -p %s %s\n",
+                dst.c_str(), src.c_str(), dst.c_str());
+    }
+    if (!dryrun) {
+        pqueue.copies.push_back({dst, src, ss, store});
     }
+    return 0;
+}
 
-    struct stat ds;
-    int r = lstat(dst.c_str(), &ds);
-    if (r == 0
-        && ss.st_mode == ds.st_mode
-        && ss.st_uid == ds.st_uid
-        && ss.st_gid == ds.st_gid
-        && ((!S_ISREG(ss.st_mode) && !S_ISLNK(ss.st_mode))
-            || ss.st_size == ds.st_size)
-        && ((!S_ISBLK(ss.st_mode) && !S_ISCHR(ss.st_mode))
-            || ss.st_rdev == ds.st_rdev)
-        && ((!S_ISREG(ss.st_mode) && !S_ISLNK(ss.st_mode))
-            || stat_mtimes_same(ss, ds))) {
-        if (S_ISREG(ss.st_mode)) {
-            auto di = std::make_pair(ss.st_dev, ss.st_ino);
-            devino_table.insert(std::make_pair(di, dst));
+// Queue a hard link from `newpath` to `oldpath`, replacing `newpath`.
+static int x_link_queued(const std::string& oldpath, const std::string& newpath) {
+    if (verbose) {
+        fprintf(verbosefile, "rm -f %s\nln %s %s\n",
+                newpath.c_str(), oldpath.c_str(), newpath.c_str());
+    }
+    if (!dryrun) {
+        pqueue.links.emplace_back(oldpath, newpath);
+    }
+    return 0;
+}
+
+// True if a parent of `dst` is a symbolic link queued but not yet made.
+static bool populate_under_symlink(const std::string& dst) {
+    if (pqueue.symlink_dsts.empty()) {
+        return false;
+    }
+    for (size_t slash = dst.find('/', 1); slash != std::string::npos;
+         slash = dst.find('/', slash + 1)) {
+        if (pqueue.symlink_dsts.contains(dst.substr(0, slash))) {
+            return true;
         }
-        return 0;
     }
+    return false;
+}
 
-    // check for hard link to already-created file
-    if (S_ISREG(ss.st_mode)) {
-        if (reuse_link) {
-            auto di = std::make_pair(ss.st_dev, ss.st_ino);
-            auto it = devino_table.find(di);
-            if (it != devino_table.end())
-                return x_link(it->second.c_str(), dst.c_str());
-            devino_table.insert(std::make_pair(di, dst));
+// Submit the batch if it is large. Its calls name directories by descriptors
+// from `dirs`, which must stay open until they run; submitting in bounded
+// batches bounds the descriptors evicted meanwhile.
+static void populate_submit_if_full(dirfd_cache& dirs) {
+    if (fsb.size() >= 256) {
+        fsb.submit();
+        dirs.release();
+    }
+}
+
+// Give a made directory, node, or symbolic link, `name` in `dirfd`, its
+// source's owner.
+static void populate_chown(const populate_queue::job& j, int dirfd,
+                           const std::string& name) {
+    if ((j.ss.st_uid != ROOT || j.ss.st_gid != ROOT)
+        && fchownat(dirfd, name.c_str(), j.ss.st_uid, j.ss.st_gid,
+                    AT_SYMLINK_NOFOLLOW) != 0) {
+        perror_fail("chown %s: %s\n", j.dst.c_str());
+    }
+}
+
+static void populate_dirs() {
+    auto& dirs = pqueue.dirs;
+    auto depth = [] (const std::string& s) {
+        return std::count(s.begin(), s.end(), '/');
+    };
+    std::vector<size_t> order(dirs.size());
+    for (size_t i = 0; i != order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&] (size_t a, size_t b) {
+        return depth(dirs[a].dst) < depth(dirs[b].dst);
+    });
+    std::vector<int> r(dirs.size());
+    std::string name;
+    for (size_t i = 0; i != order.size(); fsb.submit(), dst_dirs.release()) {
+        auto d = depth(dirs[order[i]].dst);
+        for (; i != order.size() && depth(dirs[order[i]].dst) == d; ++i) {
+            auto& j = dirs[order[i]];
+            int dirfd = dst_dirs.parent(j.dst, name);
+            if (dirfd == -1) {
+                r[order[i]] = -errno;
+            } else {
+                fsb.mkdirat(dirfd, name, j.ss.st_mode & perm_mask, &r[order[i]]);
+                populate_submit_if_full(dst_dirs);
+            }
         }
-        return x_cp_p(src, dst);
-    } else if (S_ISDIR(ss.st_mode)) {
-        mode_t perm = ss.st_mode & (S_ISUID | S_ISGID | S_IRWXU | S_IRWXG | S_IRWXO);
+    }
+    for (size_t i = 0; i != dirs.size(); ++i) {
+        // a directory made since the plan phase looked (by `v_ensuredir`,
+        // say) is left alone, as one that existed then would be
+        int dirfd;
+        if (r[i] == -EEXIST) {
+            continue;
+        } else if (r[i] < 0) {
+            errno = -r[i];
+            perror_fail("mkdir %s: %s\n", dirs[i].dst.c_str());
+        } else if ((dirfd = dst_dirs.parent(dirs[i].dst, name)) == -1) {
+            perror_fail("chown %s: %s\n", dirs[i].dst.c_str());
+        } else {
+            populate_chown(dirs[i], dirfd, name);
+        }
+    }
+    dst_dirs.release();
+}
+
+static void populate_special() {
+    std::string name;
+    for (auto& j : pqueue.nodes) {
+        // /dev/ptmx is mknod'd here like any other node; exec_go() later
+        // replaces it with the `pts/ptmx` symlink the newinstance devpts needs.
+        mode_t mode = j.ss.st_mode & (S_IFCHR | S_IFBLK | perm_mask);
+        int dirfd = dst_dirs.parent(j.dst, name);
+        if (dirfd == -1) {
+            perror_fail("mknod %s: %s\n", j.dst.c_str());
+        } else if (unlinkat(dirfd, name.c_str(), 0) != 0 && errno != ENOENT) {
+            perror_fail("rm %s: %s\n", j.dst.c_str());
+        } else if (mknodat(dirfd, name.c_str(), mode, j.ss.st_rdev) != 0
+                   && (errno != EEXIST || !x_mknod_eexist_ok(j.dst.c_str(), mode, j.ss.st_rdev))) {
+            perror_fail("mknod %s: %s\n", j.dst.c_str());
+        } else {
+            populate_chown(j, dirfd, name);
+        }
+    }
+
+    auto& symlinks = pqueue.symlinks;
+    std::vector<int> r(2 * symlinks.size());
+    for (size_t i = 0; i != symlinks.size(); ++i) {
+        int dirfd = dst_dirs.parent(symlinks[i].dst, name);
+        if (dirfd == -1) {
+            r[2 * i] = -errno;
+            continue;
+        }
+        fsb.unlinkat(dirfd, name, 0, &r[2 * i]);
+        fsb.then();
+        fsb.symlinkat(symlinks[i].src, dirfd, name, &r[2 * i + 1]);
+        populate_submit_if_full(dst_dirs);
+    }
+    fsb.submit();
+    dst_dirs.release();
+    for (size_t i = 0; i != symlinks.size(); ++i) {
+        auto& j = symlinks[i];
+        struct timespec ts[2];
+        ts[0].tv_nsec = UTIME_OMIT;
+#if __linux__
+        ts[1] = j.ss.st_mtim;
+#else
+        ts[1] = j.ss.st_mtimespec;
+#endif
+        int dirfd = dst_dirs.parent(j.dst, name);
+        if (dirfd == -1) {
+            perror_fail("symlink %s: %s\n", (j.src + " " + j.dst).c_str());
+        } else if (r[2 * i] < 0 && r[2 * i] != -ENOENT) {
+            errno = -r[2 * i];
+            perror_fail("rm %s: %s\n", j.dst.c_str());
+        } else if (r[2 * i + 1] < 0
+                   && (r[2 * i + 1] != -EEXIST
+                       || !x_symlink_eexist_ok(j.src.c_str(), j.dst.c_str()))) {
+            errno = -r[2 * i + 1];
+            perror_fail("symlink %s: %s\n", (j.src + " " + j.dst).c_str());
+        } else if (utimensat(dirfd, name.c_str(), ts, AT_SYMLINK_NOFOLLOW) != 0) {
+            perror_fail("utimensat %s: %s\n", j.dst.c_str());
+        } else {
+            populate_chown(j, dirfd, name);
+        }
+    }
+    dst_dirs.release();
+}
+
+// Add copy `j`'s source to the link store as `entry`: copy it to a temporary
+// name beside `entry`, then link that into place. A concurrent population may
+// add the same entry first; either copy serves. Returns 0 on success.
+static int linkstore_add(const populate_queue::job& j, const std::string& entry,
+                         populate_stats& st) {
+    static std::atomic<unsigned> tmpcounter;
+    std::string tmp = entry + "." + std::to_string(getpid())
+        + "." + std::to_string(tmpcounter++) + ".tmp";
+    std::string dir = path_noendslash(path_parentdir(entry));
+    copy_result cr;
+    if ((mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST)
+        || copy_file_at(AT_FDCWD, j.src.c_str(), AT_FDCWD, tmp.c_str(),
+                        &j.ss, cr, opt_copy == copy_reflink) != 0) {
+        return -1;
+    }
+    int r = link(tmp.c_str(), entry.c_str());
+    if (r != 0 && errno == EEXIST) {
+        r = 0;
+    }
+    unlink(tmp.c_str());
+    if (r == 0) {
+        ++st.files_stored;
+        st.bytes_stored += cr.bytes;
+    }
+    return r;
+}
+
+// Hard-link copy `j`, `name` in `dirfd`, from the link store, adding its
+// source to the store if need be. Returns -1, leaving `j` to be copied, if the
+// store cannot serve it (on another file system, say, or at its link limit).
+static int populate_store_link(const populate_queue::job& j, int dirfd,
+                               const std::string& name, populate_stats& st) {
+    std::string entry = linkstore_entry(j.ss);
+    for (int tries = 0; tries != 2; ++tries) {
+        if (linkat(AT_FDCWD, entry.c_str(), dirfd, name.c_str(), 0) == 0) {
+            ++st.files_linked;
+            return 0;
+        } else if (errno != ENOENT || linkstore_add(j, entry, st) != 0) {
+            break;
+        }
+    }
+    return -1;
+}
+
+// Run one queued copy; may be called from any worker thread, with that
+// thread's directory caches.
+static int populate_copy(const populate_queue::job& j, populate_stats& st,
+                         dirfd_cache& dsts, dirfd_cache& srcs) {
+    std::string dname, sname;
+    int dstdirfd = dsts.parent(j.dst, dname);
+    if (dstdirfd == -1) {
+        return perror_fail("cp %s: %s\n", (j.src + " " + j.dst).c_str());
+    }
+    if (unlinkat(dstdirfd, dname.c_str(), 0) == -1 && errno != ENOENT) {
+        return perror_fail("rm %s: %s\n", j.dst.c_str());
+    }
+    if (j.store && populate_store_link(j, dstdirfd, dname, st) == 0) {
+        return 0;
+    }
+    if (opt_copy == copy_cp) {
+        if (x_cp_p_exec(j.src, j.dst)) {
+            return 1;
+        }
+        st.bytes_copied += j.ss.st_size;
+    } else {
+        copy_result cr;
+        int srcdirfd = srcs.parent(j.src, sname);
+        if (srcdirfd == -1
+            || copy_file_at(srcdirfd, sname.c_str(), dstdirfd, dname.c_str(),
+                            &j.ss, cr, opt_copy == copy_reflink) != 0) {
+            return perror_fail("cp %s: %s\n", (j.src + " " + j.dst).c_str());
+        }
+        if (cr.method == COPY_REFLINK) {
+            ++st.files_reflinked;
+            st.bytes_reflinked += cr.bytes;
+            return 0;
+        }
+        st.bytes_copied += cr.bytes;
+    }
+    ++st.files_copied;
+    return 0;
+}
+
+static unsigned populate_jobs() {
+    if (opt_jobs > 0) {
+        return opt_jobs;
+    }
+    return std::clamp(std::thread::hardware_concurrency(), 1U, 8U);
+}
+
+static void populate_copies() {
+    auto& copies = pqueue.copies;
+    // copy a directory's files together, so a thread's small directory
+    // caches serve runs of them
+    std::stable_sort(copies.begin(), copies.end(), [] (auto& a, auto& b) {
+        return a.dst < b.dst;
+    });
+    unsigned njobs = std::min<size_t>(populate_jobs(), copies.size());
+    std::vector<populate_stats> wstats(std::max(njobs, 1U));
+    std::atomic<size_t> next = 0;
+    auto work = [&] (populate_stats* st) {
+        // the calling thread shares the main caches; the others start afresh
+        dirfd_cache dsts(16), srcs(16);
+        bool main = st == &wstats[0];
+        if (!main) {
+            dsts.set_root(dst_dirs.root(), dst_dirs.root_fd());
+        }
+        dirfd_cache& d = main ? dst_dirs : dsts;
+        dirfd_cache& s = main ? src_dirs : srcs;
+        size_t i;
+        while ((i = next++) < copies.size()) {
+            populate_copy(copies[i], *st, d, s);
+            d.release();
+            s.release();
+        }
+        st->dir_lookups += dsts.nlookups + srcs.nlookups;
+        st->dirs_opened += dsts.nopens + srcs.nopens;
+    };
+    // the calling thread is a worker too; if a thread cannot start, the
+    // others pick up its share
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < njobs; ++t) {
+        try {
+            threads.emplace_back(work, &wstats[t]);
+        } catch (std::system_error&) {
+            break;
+        }
+    }
+    work(&wstats[0]);
+    for (auto& th : threads) {
+        th.join();
+    }
+    for (auto& st : wstats) {
+        pstats += st;
+    }
+}
+
+static void populate_links() {
+    auto& links = pqueue.links;
+    std::vector<int> r(2 * links.size());
+    std::string oldname, newname;
+    for (size_t i = 0; i != links.size(); ++i) {
+        int olddirfd = dst_dirs.parent(links[i].first, oldname);
+        int newdirfd = olddirfd == -1 ? -1 : dst_dirs.parent(links[i].second, newname);
+        if (newdirfd == -1) {
+            r[2 * i + 1] = -errno;
+            continue;
+        }
+        // unlinking `newname` would remove the file to link to
+        struct stat os, ns;
+        if (fstatat(olddirfd, oldname.c_str(), &os, AT_SYMLINK_NOFOLLOW) == 0
+            && fstatat(newdirfd, newname.c_str(), &ns, AT_SYMLINK_NOFOLLOW) == 0
+            && os.st_dev == ns.st_dev && os.st_ino == ns.st_ino) {
+            continue;
+        }
+        fsb.unlinkat(newdirfd, newname, 0, &r[2 * i]);
+        fsb.then();
+        fsb.linkat(olddirfd, oldname, newdirfd, newname, &r[2 * i + 1]);
+        populate_submit_if_full(dst_dirs);
+    }
+    fsb.submit();
+    dst_dirs.release();
+    for (size_t i = 0; i != links.size(); ++i) {
+        if (r[2 * i] < 0 && r[2 * i] != -ENOENT) {
+            errno = -r[2 * i];
+            perror_fail("rm %s: %s\n", links[i].second.c_str());
+        } else if (r[2 * i + 1] < 0) {
+            errno = -r[2 * i + 1];
+            perror_fail("ln %s: %s\n", (links[i].first + " " + links[i].second).c_str());
+        }
+    }
+}
+
+// Execute the queued work and empty the queue. Errors are reported via
+// `::exit_status`, as in the plan phase.
+static int populate_flush() {
+    if (!pqueue.empty()) {
+        populate_dirs();
+        populate_special();
+        populate_copies();
+        populate_links();
+        pqueue = populate_queue();
+    }
+    return ::exit_status;
+}
+
+// `path` with symbolic links resolved, as far as it exists, ending in `/`.
+static std::string path_resolved(const std::string& path) {
+    char* r = realpath(path.c_str(), nullptr);
+    std::string result = path_endslash(r ? std::string(r) : path);
+    free(r);
+    return result;
+}
+
+// Prepare link store `store` for a jail on device `jaildev`. The store must be
+// a directory that only root may write, and must not overlap any of `trees`
+// (the jail and its skeleton): the jail's own files would otherwise pass for
+// store entries. On another file system, out of reach of hard links, it is
+// ignored and files are copied as usual.
+static void linkstore_init(const std::string& store, dev_t jaildev,
+                           std::initializer_list<std::string> trees) {
+    std::string dir = path_noendslash(store);
+    std::string rdir = path_resolved(dir);
+    for (auto& tree : trees) {
+        std::string rtree = tree.empty() ? tree : path_resolved(tree);
+        if (!rtree.empty()
+            && (rdir.starts_with(rtree) || rtree.starts_with(rdir))) {
+            die("%s: Link store must lie outside %s\n", dir.c_str(), tree.c_str());
+        }
+    }
+    struct stat st;
+    if (v_ensuredir(dir, 0700) < 0) {
+        perror_die(dir);
+    } else if (dryrun) {
+        linkstore = dir;
+    } else if (lstat(dir.c_str(), &st) != 0) {
+        perror_die(dir);
+    } else if (!S_ISDIR(st.st_mode)
+               || st.st_uid != ROOT
+               || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        die("%s: Link store must be a directory writable only by root\n", dir.c_str());
+    } else if (st.st_dev != jaildev) {
+        if (verbose) {
+            fprintf(verbosefile, "# %s: link store on another file system, copying\n",
+                    dir.c_str());
+        }
+    } else {
+        linkstore = dir;
+    }
+}
+
+// Remove the entries of link store `store` that no jail links any more (link
+// count 1), and temporary files abandoned by interrupted populations. An entry
+// removed just as a population links it stays in that jail; the next
+// population to want it adds it again.
+static int linkstore_gc(const std::string& store) {
+    if (store.empty()) {
+        if (verbose) {
+            fprintf(verbosefile, "# no link store\n");
+        }
+        return 0;
+    }
+    std::string dir = path_noendslash(store);
+    int dirfd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+    struct stat st;
+    if (dirfd == -1 && errno == ENOENT) {
+        return 0;
+    } else if (dirfd == -1 || fstat(dirfd, &st) != 0) {
+        perror_die(dir);
+    } else if (st.st_uid != ROOT || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        die("%s: Link store must be a directory writable only by root\n", dir.c_str());
+    }
+    DIR* d = fdopendir(dirfd);
+    if (!d) {
+        perror_die(dir);
+    }
+
+    time_t now = time(nullptr);
+    unsigned long long nremoved = 0, nbytes = 0;
+    while (struct dirent* de = readdir(d)) {
+        int subfd;
+        DIR* sd;
+        if (de->d_name[0] == '.'
+            || (subfd = openat(dirfd, de->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW)) == -1) {
+            continue;
+        } else if (!(sd = fdopendir(subfd))) {
+            close(subfd);
+            continue;
+        }
+        std::string subdir = dir + "/" + de->d_name + "/";
+        std::vector<std::string> names;
+        while (struct dirent* e = readdir(sd)) {
+            size_t len = strlen(e->d_name);
+            if (e->d_name[0] == '.'
+                || fstatat(subfd, e->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0
+                || !S_ISREG(st.st_mode)
+                || st.st_nlink != 1
+                // a temporary file may be mid-copy
+                || (len > 4 && strcmp(e->d_name + len - 4, ".tmp") == 0
+                    && st.st_ctime > now - 3600)) {
+                continue;
+            }
+            if (verbose) {
+                fprintf(verbosefile, "rm -f %s%s\n", subdir.c_str(), e->d_name);
+            }
+            names.push_back(e->d_name);
+            nbytes += st.st_size;
+        }
+        if (!dryrun) {
+            std::vector<int> r(names.size());
+            for (size_t i = 0; i != names.size(); ++i) {
+                fsb.unlinkat(subfd, names[i], 0, &r[i]);
+            }
+            fsb.submit();
+            for (size_t i = 0; i != names.size(); ++i) {
+                if (r[i] < 0 && r[i] != -ENOENT) {
+                    errno = -r[i];
+                    perror_fail("rm %s: %s\n", (subdir + names[i]).c_str());
+                }
+            }
+        }
+        nremoved += names.size();
+        closedir(sd);
+    }
+    closedir(d);
+    if (verbose) {
+        fprintf(verbosefile, "# gc: %llu entries removed, %llu bytes\n", nremoved, nbytes);
+        report_fsbatch();
+    }
+    return ::exit_status;
+}
+
+static inline int stat_mtimes_same(const struct stat& st1, const struct stat& st2) {
+#if __linux__
+    return st1.st_mtim.tv_sec == st2.st_mtim.tv_sec && st1.st_mtim.tv_nsec == st2.st_mtim.tv_nsec;
+#else
+    return st1.st_mtime == st2.st_mtime;
+#endif
+}
+
+// True if destination `ds` already is a copy of source `ss`.
+static bool dst_matches(const struct stat& ss, const struct stat& ds) {
+    return ss.st_mode == ds.st_mode
+        && ss.st_uid == ds.st_uid
+        && ss.st_gid == ds.st_gid
+        && ((!S_ISREG(ss.st_mode) && !S_ISLNK(ss.st_mode))
+            || ss.st_size == ds.st_size)
+        && ((!S_ISBLK(ss.st_mode) && !S_ISCHR(ss.st_mode))
+            || ss.st_rdev == ds.st_rdev)
+        && ((!S_ISREG(ss.st_mode) && !S_ISLNK(ss.st_mode))
+            || stat_mtimes_same(ss, ds));
+}
+
+static int do_copy(const std::string& dst, const std::string& src,
+                   const struct stat& ss, bool reuse_link, dev_t jaildev) {
+    // a manifest may name any path, but a device node is a root-authority
+    // capability, not data: refuse anything outside the allowlist before it can be
+    // created (or accepted as a pre-existing match below)
+    if ((S_ISCHR(ss.st_mode) || S_ISBLK(ss.st_mode))
+        && !dev_node_allowed(ss.st_mode, ss.st_rdev)) {
+        std::string what = src + " (" + dev_name(ss.st_mode, ss.st_rdev) + ")";
+        return perror_fail("%s: Device node not permitted in jail\n", what.c_str());
+    }
+
+    struct stat ds;
+    int r = dst_dirs.lstat(dst, &ds);
+    dst_dirs.release();
+    if (r == 0 && dst_matches(ss, ds)) {
+        if (S_ISREG(ss.st_mode)) {
+            auto di = std::make_pair(ss.st_dev, ss.st_ino);
+            if (auto [v, inserted] = devino_table.insert(di, {}); inserted) {
+                *v = devino_paths.intern(dst);
+            }
+        }
+        pplan.add(plan_skip, plan_type_of(ss), dst, std::string());
+        return 0;
+    }
+    plan_op op = r == 0 ? plan_replace : plan_create;
+
+    // check for hard link to already-created file
+    if (S_ISREG(ss.st_mode)) {
+        if (!dryrun && populate_under_symlink(dst)) {
+            populate_flush();
+        }
+        if (reuse_link) {
+            auto di = std::make_pair(ss.st_dev, ss.st_ino);
+            auto [v, inserted] = devino_table.insert(di, {});
+            if (!inserted) {
+                std::string linkdst(*v);
+                pplan.add(op, plan_link, dst, linkdst);
+                return x_link_queued(linkdst, dst);
+            }
+            *v = devino_paths.intern(dst);
+        }
+        bool store = reuse_link && linkstore_eligible(ss);
+        pplan.add(op, store ? plan_store : plan_file, dst, src, ss.st_size);
+        return x_cp_p(src, dst, ss, store);
+    } else if (S_ISDIR(ss.st_mode)) {
         if (r == 0 && !S_ISDIR(ds.st_mode)) {
             errno = ENOTDIR;
             return perror_fail("%s: %s\n", dst.c_str());
         }
-        if (v_mkdir(dst.c_str(), perm) != 0) {
+        pplan.add(r == 0 ? plan_skip : plan_create, plan_dir, dst, std::string());
+        if (verbose) {
+            fprintf(verbosefile, "mkdir -m 0%o %s\n", ss.st_mode & perm_mask, dst.c_str());
+        }
+        if (r == 0 && !dryrun) {
+            // `mkdir` would fail
             return 1;
         }
+        if (!dryrun) {
+            if (populate_under_symlink(dst)) {
+                populate_flush();
+            }
+            pqueue.dirs.push_back({dst, std::string(), ss});
+        }
     } else if (S_ISCHR(ss.st_mode) || S_ISBLK(ss.st_mode)) {
-        if (x_rm_f(dst)) {
-            return 1;
+        pplan.add(op, plan_node, dst, std::string());
+        if (verbose) {
+            fprintf(verbosefile, "rm -f %s\nmknod -m 0%o %s %s\n", dst.c_str(),
+                    ss.st_mode & perm_mask, dst.c_str(), dev_name(ss.st_mode, ss.st_rdev));
         }
-        // /dev/ptmx is mknod'd here like any other node; exec_go() later replaces
-        // it with the `pts/ptmx` symlink the newinstance devpts needs.
-        mode_t mode = ss.st_mode & (S_IFREG | S_IFCHR | S_IFBLK | S_IFIFO | S_IFSOCK | S_ISUID | S_ISGID | S_IRWXU | S_IRWXG | S_IRWXO);
-        if (x_mknod(dst.c_str(), mode, ss.st_rdev)) {
-            return 1;
+        if (!dryrun) {
+            if (populate_under_symlink(dst)) {
+                populate_flush();
+            }
+            pqueue.nodes.push_back({dst, std::string(), ss});
         }
     } else if (S_ISLNK(ss.st_mode)) {
-        if (x_rm_f(dst)) {
-            return 1;
-        }
         char lnkbuf[4096];
         ssize_t r = readlink(src.c_str(), lnkbuf, sizeof(lnkbuf));
         if (r == -1) {
@@ -932,10 +1902,17 @@ static int do_copy(const std::string& dst, const std::string& src,
             return perror_fail("%s: Symbolic link too long\n", src.c_str());
         }
         lnkbuf[r] = 0;
-        if (x_symlink(lnkbuf, dst.c_str())) {
-            return 1;
-        } else if (x_copy_utimes(dst.c_str(), ss)) {
-            return 1;
+        pplan.add(op, plan_symlink, dst, std::string(lnkbuf));
+        if (verbose) {
+            fprintf(verbosefile, "rm -f %s\nln -s %s %s\ntouch -m -d @%ld %s\n",
+                    dst.c_str(), lnkbuf, dst.c_str(), (long) ss.st_mtime, dst.c_str());
+        }
+        if (!dryrun) {
+            if (populate_under_symlink(dst)) {
+                populate_flush();
+            }
+            pqueue.symlinks.push_back({dst, std::string(lnkbuf), ss});
+            pqueue.symlink_dsts.insert(dst);
         }
         handle_symlink_dst(dst, src, std::string(lnkbuf), jaildev);
     } else {
@@ -943,12 +1920,69 @@ static int do_copy(const std::string& dst, const std::string& src,
         return perror_fail("%s: Odd file type\n", src.c_str());
     }
 
-    if (ss.st_uid != ROOT || ss.st_gid != ROOT) {
-        return x_lchown(dst.c_str(), ss.st_uid, ss.st_gid);
+    if ((ss.st_uid != ROOT || ss.st_gid != ROOT) && verbose) {
+        fprintf(verbosefile, "chown -h %s:%s %s\n",
+                uid_to_name(ss.st_uid), gid_to_name(ss.st_gid), dst.c_str());
     }
     return 0;
 }
 
+// `--manifest-cache FILE`: a compiled manifest. Populating from the manifest
+// text parses it, follows symbolic links, and checks every source and
+// destination; the cache records the outcome -- each entry copied, with the
+// `lstat` of its source, and each bind or mount entry -- keyed by the manifest
+// text and the jail and skeleton roots. A later population with the same key
+// first checks every copied entry's source and destination against its
+// recorded `lstat`. If nothing changed, it only redoes the mounts; otherwise
+// it populates from the text and records afresh.
+//
+// The file is opened as the caller, who could as well have written a
+// manifest, and it is trusted no more than one: destinations are recorded
+// relative to the jail or skeleton root, and every source is checked anew.
+struct manifest_cache {
+    struct record {
+        char kind;              // 'c' copy, 's' skeleton copy, 'm' mount entry
+        manifest_entry me;      // `src`, and `dst` relative to the root
+        struct stat ss;         // copies: `lstat` of `src`
+    };
+    std::string filename;
+    int fd = -1;
+    bool recording = false;
+    std::array<unsigned char, 32> key;
+    std::vector<record> records;
+    path_arena strings;         // every string in `records`, NUL-terminated
+
+    record& add(char kind, const manifest_entry& me) {
+        record& rec = records.emplace_back();
+        rec.kind = kind;
+        rec.me.src = strings.intern(me.src);
+        rec.me.dst = strings.intern(me.dst);
+        rec.me.flags = me.flags;
+        rec.me.bind_tag = strings.intern(me.bind_tag);
+        rec.me.bind_files = strings.intern(me.bind_files);
+        rec.me.mount_dst = strings.intern(me.mount_dst);
+        rec.me.mount_args = strings.intern(me.mount_args);
+        return rec;
+    }
+    void add_copy(char kind, const std::string& src,
+                  const std::string& subdst, const struct stat& ss) {
+        manifest_entry me;
+        me.src = src;
+        me.dst = subdst;
+        add(kind, me).ss = ss;
+    }
+    void clear() {
+        records.clear();
+        strings.clear();
+    }
+    void make_key(const std::string& manifest);
+    bool load();
+    bool unchanged();
+    void replay(dev_t jaildev);
+    void save();
+};
+static manifest_cache mcache;
+
 // Populate one manifest entry into the jail. `construct_jail` ignores the return
 // value and reports failure via the global `::exit_status`, so any error path here
 // (and in `do_copy`) must set `::exit_status = 1`, not merely return nonzero.
@@ -964,25 +1998,26 @@ static int handle_copy(std::string src, std::string subdst,
     // do not end in slash. lstat() on a symlink path actually follows the
     // symlink if the path ends in slash
     while (src.length() > 1 && src.back() == '/') {
-        src = src.substr(0, src.length() - 1);
+        src.pop_back();
     }
     while (subdst.length() > 1 && subdst.back() == '/') {
-        subdst = subdst.substr(0, subdst.length() - 1);
+        subdst.pop_back();
     }
 
-    std::string dst = dstroot + subdst;
-    if (dst_table.find(dst) != dst_table.end()) {
+    std::string dst;
+    dst.reserve(dstroot.length() + subdst.length());
+    dst.append(dstroot).append(subdst);
+    if (!dst_table.insert(dst, 1).second) {
         return 1;
     }
-    dst_table[dst] = 1;
 
     struct stat ss;
 
-    std::string dst_parentdir = path_noendslash(path_parentdir(dst));
+    std::string_view dst_parentdir(dst.data(), dst.rfind('/'));
     if (dst_parentdir != last_parentdir
         && dst_parentdir.length() > dstroot.length()) {
         last_parentdir = dst_parentdir;
-        if (dst_table.find(last_parentdir) == dst_table.end()) {
+        if (!dst_table.contains(last_parentdir)) {
             int r = handle_copy(path_noendslash(path_parentdir(src)),
                                 last_parentdir.substr(dstroot.length()),
                                 0, jaildev);
@@ -992,18 +2027,34 @@ static int handle_copy(std::string src, std::string subdst,
         }
     }
 
-    if (lstat(src.c_str(), &ss) != 0) {
+    if (src_lstat(src, ss) != 0) {
         return perror_fail("lstat %s: %s\n", src.c_str());
     }
 
     // set up skeleton directory version
-    if (!linkdir.empty()) {
-        do_copy(linkdir + subdst, src, ss, true, jaildev);
+    if (opt_overlay) {
+        // the skeleton is the jail root's lower layer, so it gets exactly
+        // what the jail would, and nothing is copied into the jail
+        if (do_copy(linkdir + subdst, src, ss, !(flags & FLAG_CP), jaildev)) {
+            return 1;
+        }
+        if (mcache.recording) {
+            mcache.add_copy('s', src, subdst, ss);
+        }
+        return S_ISDIR(ss.st_mode) ? handle_mount(src, dst, false) : 0;
+    }
+    if (!linkdir.empty()
+        && do_copy(linkdir + subdst, src, ss, true, jaildev) == 0
+        && mcache.recording) {
+        mcache.add_copy('s', src, subdst, ss);
     }
 
     if (do_copy(dst, src, ss, !(flags & FLAG_CP), jaildev)) {
         return 1;
     }
+    if (mcache.recording) {
+        mcache.add_copy('c', src, subdst, ss);
+    }
 
     if (S_ISDIR(ss.st_mode)) {
         return handle_mount(src, dst, false);
@@ -1011,22 +2062,33 @@ static int handle_copy(std::string src, std::string subdst,
     return 0;
 }
 
-inline const char* opt_wordskip(const char* s) {
-    while (*s != ']' && *s != ';' && !isspace((unsigned char) *s)) {
-        ++s;
-    }
-    return s;
-}
-
-inline bool opt_eq(const char* opt, const char* endopt,
-                   const char* def, unsigned len) {
-    return endopt - opt == len && memcmp(opt, def, len) == 0;
+// Shared by `[libs]` and fingerprints; made on first use, since it reads
+// `/etc/ld.so.conf`.
+static elf_resolver& the_elf_resolver() {
+    static elf_resolver elfres;
+    return elfres;
 }
 
+// `[bind TAG FILES]`: rebuild the scaffold `src` from manifest `FILES` unless
+// its `.pa-jail-bindtag` says `TAG`. The tag `auto` means the manifest's
+// fingerprint, so the scaffold is rebuilt when the manifest or any file it
+// names changes; `.pa-jail-bindtag.cache` keeps that cheap.
 static void fix_jail_bind_src(dev_t jaildev,
                               std::string src, std::string want_tag,
                               std::string want_files) {
     std::string srcx = path_endslash(src) + ".pa-jail-bindtag";
+    if (want_tag == "auto") {
+        manifest_fingerprint fp(the_elf_resolver());
+        if (!fp.compute(want_files, dryrun ? std::string() : srcx + ".cache")) {
+            perror_die(want_files);
+        }
+        want_tag = fp.hex;
+        if (verbose) {
+            fprintf(verbosefile, "# fingerprint %s: %s (%zu files checked%s)\n",
+                    want_files.c_str(), want_tag.c_str(), fp.nfiles,
+                    fp.cached ? ", cached" : "");
+        }
+    }
     if (verbose) {
         fprintf(verbosefile, "test %s = `cat %s`\n", shell_quote(want_tag).c_str(), shell_quote(srcx).c_str());
     }
@@ -1037,9 +2099,16 @@ static void fix_jail_bind_src(dev_t jaildev,
     if (got_tag != want_tag) {
         std::string contents = file_get_contents(want_files, 2);
         std::string old_dstroot = dstroot;
+        int old_dstrootfd = dstrootfd;
+        bool old_recording = mcache.recording;
         dstroot = path_noendslash(src);
+        dstrootfd = -1;
+        mcache.recording = false;
         construct_jail(jaildev, contents, true);
         dstroot = old_dstroot;
+        dstrootfd = old_dstrootfd;
+        dst_dirs.set_root(dstroot, dstrootfd);
+        mcache.recording = old_recording;
         if (verbose) {
             fprintf(verbosefile, "echo %s > %s\n", shell_quote(want_tag).c_str(), srcx.c_str());
         }
@@ -1055,6 +2124,97 @@ static void fix_jail_bind_src(dev_t jaildev,
     }
 }
 
+// With io_uring, `lstat` every source to be copied, and the directories above
+// it, in one batch; `handle_copy` uses each result once.
+static void prefetch_src_stats(const std::vector<manifest_entry>& entries) {
+    for (auto& me : entries) {
+        if (!me.is_copy()) {
+            continue;
+        }
+        std::string src(path_noendslash(me.src)), name;
+        while (src.length() > 1 && !src_stats.contains(src)) {
+            auto& ps = src_stats[src];
+            int dirfd = src_dirs.parent(src, name);
+            if (dirfd == -1) {
+                ps.r = -errno;
+            } else {
+                fsb.lstat(dirfd, name, &ps.st, &ps.r);
+                populate_submit_if_full(src_dirs);
+            }
+            src = path_noendslash(path_parentdir(src));
+        }
+    }
+    fsb.submit();
+    src_dirs.release();
+}
+
+// Act on a `[bind]` or `[mount]` manifest entry.
+static void handle_mount_entry(const manifest_entry& me, dev_t jaildev) {
+    std::string src(me.src), dst(me.dst);
+    populate_flush();
+    if (me.flags & (FLAG_BIND | FLAG_BIND_RO)) {
+        if (me.flags & FLAG_MOUNT) {
+            fprintf(stderr, "%s: [mount] option ignored\n", src.c_str());
+        }
+        if (!me.bind_tag.empty() && !me.bind_files.empty()) {
+            fix_jail_bind_src(jaildev, src, std::string(me.bind_tag),
+                              std::string(me.bind_files));
+        }
+        // not `unbindable`: the jail root is bound recursively at run time,
+        // and that would leave an unbindable mount behind
+        mountslot ms(src.c_str(), "none",
+                     me.flags & FLAG_BIND_RO ? "bind,rec,ro" : "bind,rec");
+        ms.wanted = true;
+        mount_table[mount_key(src)] = ms;
+    } else {
+        mountslot ms(src.c_str(), std::string(me.mount_dst).c_str(),
+                     std::string(me.mount_args).c_str());
+        ms.wanted = true;
+        mount_table[mount_key(src)] = ms;
+    }
+    v_ensuredir(dstroot + dst, 0555);
+    handle_mount(src, dstroot + dst, false);
+}
+
+// `[libs]`: add an entry for each file an entry's binary needs to run -- its
+// interpreter and shared libraries, transitively -- at its host path.
+static void add_manifest_libs(manifest& m) {
+    elf_resolver& elfres = the_elf_resolver();
+    std::vector<std::string> libs, missing;
+    size_t nbinaries = 0;
+    for (size_t i = 0, n = m.entries.size(); i != n; ++i) {
+        const manifest_entry& me = m.entries[i];
+        if (!(me.flags & FLAG_LIBS) || !me.is_copy()) {
+            continue;
+        }
+        ++nbinaries;
+        std::string src(path_noendslash(me.src));
+        missing.clear();
+        // a source that cannot be opened is reported when copied
+        elfres.closure(src, libs, missing);
+        for (auto& lib : missing) {
+            ::exit_status = 1;
+            fprintf(stderr, "%s: %s: shared library not found\n",
+                    src.c_str(), lib.c_str());
+        }
+    }
+    if (nbinaries == 0) {
+        return;
+    }
+    path_table<int> seen;
+    size_t nlibs = 0;
+    for (auto& lib : libs) {
+        if (seen.insert(lib, 1).second) {
+            m.add(lib, lib);
+            ++nlibs;
+        }
+    }
+    if (verbose) {
+        fprintf(verbosefile, "# libs: %zu binaries need %zu files (%llu read, %llu cached)\n",
+                nbinaries, nlibs, elfres.nread, elfres.ncached);
+    }
+}
+
 static int construct_jail(dev_t jaildev, std::string& str, bool nomount) {
     // prepare root
     if (x_chmod(dstroot.c_str(), 0755)
@@ -1062,178 +2222,399 @@ static int construct_jail(dev_t jaildev, std::string& str, bool nomount) {
         return 1;
     }
     dst_table[dstroot + "/"] = 1;
+    dst_dirs.set_root(dstroot, dstrootfd);
 
     // Mounts
     populate_mount_table();
 
-    // Read a line at a time
-    std::string cursrcdir("/"), curdstsubdir("/");
-    std::string bind_tag, bind_files, mount_dst, mount_args;
-    int base_flags = 0;
-
-    const char* pos = str.data(), *endpos = pos + str.length();
-    while (pos < endpos) {
-        while (pos < endpos && isspace((unsigned char) *pos)) {
-            ++pos;
-        }
-        const char* line = pos;
-        while (pos < endpos && *pos != '\n') {
-            ++pos;
-        }
-        const char* endline = pos;
-        while (line < endline && isspace((unsigned char) endline[-1])) {
-            --endline;
-        }
-        if (line == endline || line[0] == '#') {
-            continue;
-        }
-
-        // 'directory:'
-        if (endline[-1] == ':') {
-            if (line + 2 == endline && line[0] == '.') {
-                cursrcdir = std::string("/");
-            } else if (line + 2 > endline && line[0] == '.' && line[1] == '/') {
-                cursrcdir = std::string(line + 1, endline - 1);
-            } else {
-                cursrcdir = std::string(line, endline - 1);
-            }
-            if (cursrcdir[0] != '/') {
-                cursrcdir = std::string("/") + cursrcdir;
-            }
-            while (cursrcdir.length() > 1
-                   && cursrcdir[cursrcdir.length() - 1] == '/'
-                   && cursrcdir[cursrcdir.length() - 2] == '/') {
-                cursrcdir = cursrcdir.substr(0, cursrcdir.length() - 1);
-            }
-            if (cursrcdir[cursrcdir.length() - 1] != '/') {
-                cursrcdir += '/';
-            }
-            curdstsubdir = cursrcdir;
-            assert(curdstsubdir.back() == '/');
-            continue;
+    // A compiled manifest whose entries are all unchanged needs only its
+    // mounts redone
+    if (!nomount && mcache.fd >= 0) {
+        mcache.make_key(str);
+        if (mcache.load() && mcache.unchanged()) {
+            mcache.replay(jaildev);
+            return populate_flush();
         }
+        mcache.clear();
+        mcache.recording = true;
+    }
 
-        // '[FLAGS]'
-        int flags = base_flags;
-        if (endline[-1] == ']') {
-            // skip ' [FLAGS]'
-            for (--endline; line < endline && endline[-1] != '['; --endline) {
-                // do nothing
-            }
-            if (line == endline) {
-                continue;
-            }
-            const char* opts = endline;
-            do {
-                --endline;
-            } while (line < endline && isspace((unsigned char) endline[-1]));
-            // parse flags
-            while (true) {
-                while (isspace((unsigned char) *opts) || *opts == ';') {
-                    ++opts;
-                }
-                if (*opts == ']') {
-                    break;
-                }
-                // read first option word
-                const char* optstart = opts;
-                opts = opt_wordskip(opts + 1);
-                // process option
-                int want = 0;
-                if (opt_eq(optstart, opts, "cp", 2)) {
-                    flags |= FLAG_CP;
-                } else if (opt_eq(optstart, opts, "bind", 4)) {
-                    flags |= FLAG_BIND;
-                    want = FLAG_BIND;
-                } else if (opt_eq(optstart, opts, "bind-ro", 7)) {
-                    flags |= FLAG_BIND_RO;
-                    want = FLAG_BIND;
-                } else if (opt_eq(optstart, opts, "mount", 5)) {
-                    flags |= FLAG_MOUNT;
-                    want = FLAG_MOUNT;
-                }
-                if (want == FLAG_BIND) {
-                    while (isspace((unsigned char) *opts)) {
-                        ++opts;
-                    }
-                    const char* tagstart = opts;
-                    opts = opt_wordskip(opts);
-                    bind_tag = std::string(tagstart, opts);
+    manifest m;
+    m.parse(str);
+    add_manifest_libs(m);
+    const auto& entries = m.entries;
 
-                    while (isspace((unsigned char) *opts)) {
-                        ++opts;
-                    }
-                    tagstart = opts;
-                    opts = opt_wordskip(opts);
-                    bind_files = std::string(tagstart, opts);
-                } else if (want == FLAG_MOUNT) {
-                    while (isspace((unsigned char) *opts)) {
-                        ++opts;
-                    }
-                    const char* mountstart = opts;
-                    opts = opt_wordskip(opts);
-                    mount_dst = std::string(mountstart, opts);
+    if (fsb.uring()) {
+        prefetch_src_stats(entries);
+    }
 
-                    while (isspace((unsigned char) *opts)) {
-                        ++opts;
-                    }
-                    mountstart = opts;
-                    while (*opts != ']' && *opts != ';') {
-                        ++opts;
-                    }
-                    mount_args = std::string(mountstart, opts);
-                }
-                // skip to next option word
-                while (*opts != ']' && *opts != ';') {
-                    ++opts;
-                }
+    // act on entries
+    for (auto& me : entries) {
+        if (me.is_copy()) {
+            handle_copy(std::string(me.src), std::string(me.dst), me.flags, jaildev);
+        } else if (!nomount) {
+            if (mcache.recording) {
+                mcache.add('m', me);
             }
+            handle_mount_entry(me, jaildev);
         }
+    }
 
-        std::string src, dst;
-        const char* arrow = (const char*) memmem(line, endline - line, " <- ", 4);
-        if (arrow) {
-            src = std::string(arrow + 4, endline);
-        } else if (line[0] == '/') {
-            src = std::string(line, endline);
-        } else {
-            src = cursrcdir + std::string(line, endline);
+    src_stats.clear();
+    int r = populate_flush();
+    if (mcache.recording) {
+        mcache.recording = false;
+        if (r == 0) {
+            mcache.save();
         }
-        if (!arrow) {
-            arrow = endline;
-        }
-        dst = curdstsubdir + std::string(line + (line[0] == '/'), arrow);
+    }
+    return r;
+}
 
-        // act on flags
-        if (flags & (FLAG_BIND | FLAG_BIND_RO)) {
-            if (!nomount) {
-                if (flags & FLAG_MOUNT) {
-                    fprintf(stderr, "%s: [mount] option ignored\n", src.c_str());
-                }
-                if (!bind_tag.empty() && !bind_files.empty()) {
-                    fix_jail_bind_src(jaildev, src, bind_tag, bind_files);
-                }
-                mountslot ms(src.c_str(), "none",
-                             flags & FLAG_BIND_RO ? "bind,rec,unbindable,ro" : "bind,rec,unbindable");
-                ms.wanted = true;
-                mount_table[src] = ms;
-                v_ensuredir(dstroot + dst, 0555);
-                handle_mount(src, dstroot + dst, false);
+static constexpr std::string_view mcache_magic = "pa-jail manifest cache 1\n";
+
+void manifest_cache::make_key(const std::string& manifest) {
+    sha256 h;
+    h.update(mcache_magic);
+    h.update(dstroot.c_str(), dstroot.length() + 1);
+    h.update(linkdir.c_str(), linkdir.length() + 1);
+    if (opt_overlay) {
+        h.update("overlay\n");
+    }
+    h.update(manifest);
+    key = h.digest();
+}
+
+// File format: `mcache_magic`, the 32-byte key, a record count, and the
+// records. Integers are native-endian 64-bit; strings are a length and bytes.
+// The cache is a per-machine file; a torn write fails to parse.
+namespace {
+struct mcache_writer {
+    std::string buf;
+    void u64(uint64_t x) {
+        buf.append(reinterpret_cast<const char*>(&x), sizeof(x));
+    }
+    void str(std::string_view s) {
+        u64(s.length());
+        buf.append(s);
+    }
+};
+
+struct mcache_reader {
+    const char* p;
+    const char* end;
+    bool ok = true;
+    uint64_t u64() {
+        uint64_t x = 0;
+        if (end - p < (ptrdiff_t) sizeof(x)) {
+            ok = false;
+        } else {
+            memcpy(&x, p, sizeof(x));
+            p += sizeof(x);
+        }
+        return x;
+    }
+    std::string_view str() {
+        uint64_t n = u64();
+        if (!ok || (uint64_t) (end - p) < n) {
+            ok = false;
+            return std::string_view();
+        }
+        p += n;
+        return std::string_view(p - n, n);
+    }
+};
+}
+
+bool manifest_cache::load() {
+    std::string data;
+    char buf[65536];
+    ssize_t n;
+    for (off_t off = 0; (n = pread(fd, buf, sizeof(buf), off)) > 0; off += n) {
+        data.append(buf, n);
+    }
+    size_t hdr = mcache_magic.length() + key.size();
+    if (n < 0 || data.length() < hdr
+        || !std::string_view(data).starts_with(mcache_magic)
+        || memcmp(data.data() + mcache_magic.length(), key.data(), key.size()) != 0) {
+        return false;
+    }
+
+    mcache_reader r{data.data() + hdr, data.data() + data.length()};
+    clear();
+    for (uint64_t i = 0, nrec = r.u64(); r.ok && i != nrec; ++i) {
+        manifest_entry me;
+        char kind = r.u64();
+        me.src = r.str();
+        me.dst = r.str();
+        if (kind == 'm') {
+            me.flags = r.u64();
+            me.bind_tag = r.str();
+            me.bind_files = r.str();
+            me.mount_dst = r.str();
+            me.mount_args = r.str();
+        }
+        record& rec = add(kind, me);
+        if (rec.kind == 'c' || rec.kind == 's') {
+            memset(&rec.ss, 0, sizeof(rec.ss));
+            rec.ss.st_dev = r.u64();
+            rec.ss.st_ino = r.u64();
+            rec.ss.st_mode = r.u64();
+            rec.ss.st_uid = r.u64();
+            rec.ss.st_gid = r.u64();
+            rec.ss.st_rdev = r.u64();
+            rec.ss.st_size = r.u64();
+#if __linux__
+            rec.ss.st_mtim.tv_sec = r.u64();
+            rec.ss.st_mtim.tv_nsec = r.u64();
+#else
+            rec.ss.st_mtimespec.tv_sec = r.u64();
+            rec.ss.st_mtimespec.tv_nsec = r.u64();
+#endif
+        } else if (rec.kind != 'm') {
+            r.ok = false;
+        }
+        // destinations are relative to a root, as in a manifest
+        if (rec.me.dst.empty() || rec.me.dst[0] != '/'
+            || (rec.kind == 's' && linkdir.empty())) {
+            r.ok = false;
+        }
+    }
+    return r.ok && r.p == r.end;
+}
+
+// Check every recorded copy against its source and destination. The `lstat`s
+// are independent, so they run on the `--jobs` threads; `statx` by io_uring
+// goes to kernel worker threads anyway, and measured slower. Destinations are
+// resolved as population resolves them, within the jail (or link store), so a
+// symbolic link in the tree cannot point the check at some other file.
+bool manifest_cache::unchanged() {
+    auto check = [&] (const record& rec, dirfd_cache& dsts, dirfd_cache& links) {
+        if (rec.kind == 'm') {
+            return true;
+        }
+        dirfd_cache& dirs = rec.kind == 'c' ? dsts : links;
+        struct stat ss, ds;
+        // `strings` are NUL-terminated
+        return lstat(rec.me.src.data(), &ss) == 0
+            && ss.st_dev == rec.ss.st_dev && ss.st_ino == rec.ss.st_ino
+            && dst_matches(rec.ss, ss)
+            && dirs.lstat(std::string(dirs.root()).append(rec.me.dst), &ds) == 0
+            && dst_matches(rec.ss, ds);
+    };
+    std::atomic<size_t> next = 0;
+    std::atomic<bool> changed = false;
+    const size_t stride = 64;
+    auto work = [&] (bool main) {
+        // the calling thread shares `dst_dirs`; the others start afresh
+        dirfd_cache dsts(16), links(16);
+        if (!main) {
+            dsts.set_root(dst_dirs.root(), dst_dirs.root_fd());
+        }
+        if (!linkdir.empty()) {
+            links.set_root(linkdir);
+        }
+        dirfd_cache& d = main ? dst_dirs : dsts;
+        size_t i;
+        while (!changed && (i = next.fetch_add(stride)) < records.size()) {
+            for (size_t e = std::min(i + stride, records.size()); i != e; ++i) {
+                if (!check(records[i], d, links)) {
+                    changed = true;
+                    if (verbose) {
+                        fprintf(verbosefile, "# manifest cache: %s changed\n",
+                                records[i].me.src.data());
+                    }
+                    break;
+                }
             }
-        } else if (flags & FLAG_MOUNT) {
-            if (!nomount) {
-                mountslot ms(src.c_str(), mount_dst.c_str(), mount_args.c_str());
-                ms.wanted = true;
-                mount_table[src] = ms;
-                v_ensuredir(dstroot + dst, 0555);
-                handle_mount(src, dstroot + dst, false);
+            d.release();
+            links.release();
+        }
+    };
+    unsigned njobs = std::min<size_t>(populate_jobs(), records.size() / stride + 1);
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < njobs; ++t) {
+        try {
+            threads.emplace_back(work, false);
+        } catch (std::system_error&) {
+            break;
+        }
+    }
+    work(true);
+    for (auto& th : threads) {
+        th.join();
+    }
+    if (!changed && verbose) {
+        fprintf(verbosefile, "# manifest cache: %zu entries unchanged\n",
+                records.size());
+    }
+    return !changed;
+}
+
+// Redo what populating an unchanged manifest would: note the destinations,
+// and mount file systems and bind entries.
+void manifest_cache::replay(dev_t jaildev) {
+    for (auto& rec : records) {
+        if (rec.kind == 'm') {
+            handle_mount_entry(rec.me, jaildev);
+        } else if (rec.kind == 'c' || (rec.kind == 's' && opt_overlay)) {
+            std::string dst = std::string(dstroot).append(rec.me.dst);
+            dst_table[dst] = 1;
+            pplan.add(plan_skip, plan_type_of(rec.ss), dst, std::string());
+            if (S_ISDIR(rec.ss.st_mode)) {
+                handle_mount(std::string(rec.me.src), dst, false);
             }
+        }
+    }
+}
+
+void manifest_cache::save() {
+    mcache_writer w;
+    w.buf.append(mcache_magic);
+    w.buf.append(reinterpret_cast<const char*>(key.data()), key.size());
+    w.u64(records.size());
+    for (auto& rec : records) {
+        w.u64(rec.kind);
+        w.str(rec.me.src);
+        w.str(rec.me.dst);
+        if (rec.kind == 'm') {
+            w.u64(rec.me.flags);
+            w.str(rec.me.bind_tag);
+            w.str(rec.me.bind_files);
+            w.str(rec.me.mount_dst);
+            w.str(rec.me.mount_args);
         } else {
-            handle_copy(src, dst, flags, jaildev);
+            w.u64(rec.ss.st_dev);
+            w.u64(rec.ss.st_ino);
+            w.u64(rec.ss.st_mode);
+            w.u64(rec.ss.st_uid);
+            w.u64(rec.ss.st_gid);
+            w.u64(rec.ss.st_rdev);
+            w.u64(rec.ss.st_size);
+#if __linux__
+            w.u64(rec.ss.st_mtim.tv_sec);
+            w.u64(rec.ss.st_mtim.tv_nsec);
+#else
+            w.u64(rec.ss.st_mtimespec.tv_sec);
+            w.u64(rec.ss.st_mtimespec.tv_nsec);
+#endif
         }
     }
 
-    return ::exit_status;
+    if (verbose) {
+        fprintf(verbosefile, "# manifest cache: %zu records written to %s\n",
+                records.size(), filename.c_str());
+    }
+    size_t off = 0;
+    ssize_t n = 0;
+    if (ftruncate(fd, 0) == 0) {
+        while (off != w.buf.length()
+               && ((n = pwrite(fd, w.buf.data() + off, w.buf.length() - off, off)) > 0
+                   || (n == -1 && errno == EINTR))) {
+            off += std::max(n, ssize_t(0));
+        }
+    }
+    if (off != w.buf.length()) {
+        // a failed cache costs only time
+        fprintf(stderr, "%s: %s\n", filename.c_str(), strerror(errno));
+        if (ftruncate(fd, 0) != 0) {
+            // nothing more to do
+        }
+    }
+}
+
+populate_stats& populate_stats::operator+=(const populate_stats& x) {
+    files_copied += x.files_copied;
+    bytes_copied += x.bytes_copied;
+    files_reflinked += x.files_reflinked;
+    bytes_reflinked += x.bytes_reflinked;
+    files_linked += x.files_linked;
+    files_stored += x.files_stored;
+    bytes_stored += x.bytes_stored;
+    dir_lookups += x.dir_lookups;
+    dirs_opened += x.dirs_opened;
+    symlinks += x.symlinks;
+    symlinks_memoized += x.symlinks_memoized;
+    symlinks_done += x.symlinks_done;
+    return *this;
+}
+
+void populate_plan::add(plan_op op, plan_type type, const std::string& dst,
+                        const std::string& src, unsigned long long bytes) {
+    if (op == plan_skip) {
+        ++skip;
+    } else {
+        ++(op == plan_create ? create : replace);
+        // populate never deletes entries the manifest does not name; it
+        // removes only what a replacement overwrites
+        remove += op == plan_replace;
+        if (type == plan_dir) {
+            ++dirs;
+        } else if (type == plan_file) {
+            ++copy_files;
+            copy_bytes += bytes;
+        } else if (type == plan_link || type == plan_store) {
+            ++link_files;
+        }
+    }
+    if (record) {
+        entries.push_back({op, type, dst, src, bytes});
+    }
+}
+
+void populate_plan::report() const {
+    fprintf(verbosefile, "# plan: %llu created, %llu replaced, %llu skipped, %llu removed\n",
+            create, replace, skip, remove);
+    fprintf(verbosefile, "# plan: %llu directories, %llu files copied, %llu bytes, %llu files linked\n",
+            dirs, copy_files, copy_bytes, link_files);
+}
+
+void populate_plan::print_json(FILE* f) const {
+    static const char* const op_names[] = { "create", "replace", "skip" };
+    static const char* const type_names[] = {
+        "file", "link", "store", "dir", "symlink", "node"
+    };
+    fprintf(f, "{\"create\": %llu, \"replace\": %llu, \"skip\": %llu, \"remove\": %llu,\n"
+            " \"dirs\": %llu, \"copy_files\": %llu, \"copy_bytes\": %llu, \"link_files\": %llu,\n"
+            " \"entries\": [",
+            create, replace, skip, remove, dirs, copy_files, copy_bytes, link_files);
+    const char* sep = "\n  ";
+    for (auto& e : entries) {
+        fprintf(f, "%s{\"op\": \"%s\", \"type\": \"%s\", \"dst\": %s",
+                sep, op_names[e.op], type_names[e.type], json_quote(e.dst).c_str());
+        if (!e.src.empty()) {
+            fprintf(f, ", \"src\": %s", json_quote(e.src).c_str());
+        }
+        if (e.type == plan_file) {
+            fprintf(f, ", \"bytes\": %llu", e.bytes);
+        }
+        fputc('}', f);
+        sep = ",\n  ";
+    }
+    fprintf(f, "%s]}\n", entries.empty() ? "" : "\n");
+}
+
+static void report_fsbatch() {
+    fprintf(verbosefile, "# io: %llu batched calls in %llu system calls (%s)\n",
+            fsb.nops, fsb.nsyscalls, fsb.uring() ? "io_uring" : "synchronous");
+    fprintf(verbosefile, "# io: %llu directory lookups, %llu directories opened\n",
+            dst_dirs.nlookups + src_dirs.nlookups + pstats.dir_lookups,
+            dst_dirs.nopens + src_dirs.nopens + pstats.dirs_opened);
+}
+
+void populate_stats::report() const {
+    fprintf(verbosefile, "# populate: %llu files copied, %llu bytes\n",
+            files_copied, bytes_copied);
+    if (opt_copy == copy_reflink) {
+        fprintf(verbosefile, "# populate: %llu files reflinked, %llu bytes\n",
+                files_reflinked, bytes_reflinked);
+    }
+    if (!linkstore.empty()) {
+        fprintf(verbosefile, "# populate: %llu files linked from %s, %llu newly stored, %llu bytes\n",
+                files_linked, linkstore.c_str(), files_stored, bytes_stored);
+    }
+    fprintf(verbosefile, "# populate: %llu symbolic link targets, %llu memoized, %llu already populated\n",
+            symlinks, symlinks_memoized, symlinks_done);
 }
 
 
@@ -1260,19 +2641,22 @@ struct jaildirinfo {
     std::string parent;
     int parentfd = -1;
     std::string component;
+    int rootfd = -1;                    // `O_PATH`, the checked jail directory
     dev_t dev = -1;
 
     jaildirinfo(const char* str, const std::string& skeletondir,
                 jailaction action, pajailconf& jailconf);
     void check();
-    void chown_home();
-    void chown_recursive(const std::string& dir, uid_t owner, gid_t group);
+    int open_root() const;
+    void reopen_root();
+    void chown_home(const std::string& skip = std::string());
+    void chown_recursive(std::vector<std::string> paths, uid_t owner, gid_t group,
+                         bool strip_setid = false);
+    void ensure_overlay();
     void remove();
 
 private:
-    void chown_recursive(int dirfd, std::string& dirbuf, uid_t owner,
-                         gid_t group, bool ishome, dev_t dev);
-    void remove_recursive(int dirfd, std::string component, std::string name);
+    int chown_open_parent(const std::string& path);
 };
 
 jaildirinfo::jaildirinfo(const char* dirstr, const std::string& skeletonstr,
@@ -1308,8 +2692,26 @@ jaildirinfo::jaildirinfo(const char* dirstr, const std::string& skeletonstr,
 
     size_t last_pos = 0;
     int fd = -1;
-    bool dryrunning = false;
+    bool dryrunning = false, below_permdir = false;
     while (last_pos != perm.dir.size()) {
+        // Components below the permission directory are not checked, so from
+        // there, resolve all but the last in one `openat2` that refuses
+        // symbolic links and `..`. Without it, or if something is missing,
+        // the walk goes on one component at a time.
+        if (below_permdir && fd >= 0) {
+            below_permdir = false;
+            size_t final_pos = perm.dir.rfind('/', perm.dir.size() - 2) + 1;
+            if (final_pos > last_pos) {
+                std::string rest = perm.dir.substr(last_pos, final_pos - last_pos);
+                int nfd = openat_beneath(fd, rest.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+                if (nfd >= 0) {
+                    close(fd);
+                    fd = nfd;
+                    last_pos = final_pos;
+                }
+            }
+        }
+
         // extract component
         size_t next_pos = last_pos;
         while (next_pos
@@ -1332,6 +2734,7 @@ jaildirinfo::jaildirinfo(const char* dirstr, const std::string& skeletonstr,
         bool allowed_here = !perm.permdir.empty()
             && last_pos >= perm.permdir.length()
             && perm.dir.substr(0, perm.permdir.length()) == perm.permdir;
+        below_permdir = allowed_here;
 
         // open it and swap it in
         if (parentfd >= 0) {
@@ -1345,7 +2748,7 @@ jaildirinfo::jaildirinfo(const char* dirstr, const std::string& skeletonstr,
             // creating actions this is fatal: we must not let later code
             // (`v_ensuredir`) `mkdir -p` it unchecked, outside the boundary.
             // For `rm`/`mv` there is nothing to create, so stop the walk.
-            if (action == do_add || action == do_run) {
+            if (action_populates(action) || action == do_recycle) {
                 die("%s: Required parent directory does not exist\n",
                     thisdir.c_str());
             }
@@ -1355,12 +2758,12 @@ jaildirinfo::jaildirinfo(const char* dirstr, const std::string& skeletonstr,
             && (dryrunning
                 || (allowed_here
                     && errno == ENOENT
-                    && (action == do_add || action == do_run)))) {
+                    && action_populates(action)))) {
             if (v_mkdirat(parentfd, component.c_str(), 0755, thisdir) != 0) {
                 fprintf(stderr, "mkdir %s: %s\n", thisdir.c_str(), strerror(errno));
                 exit(1);
             }
-            dirtable.insert(std::make_pair(thisdir, 0));
+            dirtable.insert(thisdir, 0);
             fd = openat(parentfd, component.c_str(), O_CLOEXEC | O_NOFOLLOW);
             // turn off suid+sgid on created root directory
             if (last_pos == perm.dir.size() && (fd >= 0 || dryrun)
@@ -1375,6 +2778,10 @@ jaildirinfo::jaildirinfo(const char* dirstr, const std::string& skeletonstr,
         }
         if (fd == -1 && errno == ENOENT && action == do_rm && doforce) {
             exit(0);
+        } else if (fd == -1 && errno == ENOENT && action == do_recycle
+                   && last_pos == perm.dir.size()) {
+            // `recycle` may put a jail where there was none
+            break;
         } else if (fd == -1) {
             fprintf(stderr, "%s: %s\n", thisdir.c_str(), strerror(errno));
             exit(1);
@@ -1395,7 +2802,7 @@ jaildirinfo::jaildirinfo(const char* dirstr, const std::string& skeletonstr,
         // A root-created root (the `mkdir` branch above) is 0755 root:root and
         // passes; this only rejects a loosely-permissioned pre-existing root.
         bool check_owner = (!allowed_here && !final_target)
-            || (final_target && (action == do_add || action == do_run));
+            || (final_target && action_populates(action));
         if (!S_ISDIR(s.st_mode)) {
             errno = ENOTDIR;
             perror_die(thisdir);
@@ -1409,7 +2816,10 @@ jaildirinfo::jaildirinfo(const char* dirstr, const std::string& skeletonstr,
         }
         dev = s.st_dev;
     }
-    if (fd >= 0) {
+    // later operations start from the checked directory
+    if (last_pos == perm.dir.size()) {
+        rootfd = fd;
+    } else if (fd >= 0) {
         close(fd);
     }
 }
@@ -1419,40 +2829,415 @@ void jaildirinfo::check() {
     assert(perm.dir.starts_with(perm.permdir));
 }
 
+// Return a new descriptor for the jail directory, or -1 with `errno` set.
+int jaildirinfo::open_root() const {
+    if (rootfd >= 0) {
+        return fcntl(rootfd, F_DUPFD_CLOEXEC, 0);
+    }
+    return openat(parentfd, component.c_str(), O_PATH | O_CLOEXEC | O_NOFOLLOW);
+}
+
+// Open `rootfd` again, after something (a claimed pool jail) replaced the
+// jail directory.
+void jaildirinfo::reopen_root() {
+    if (rootfd >= 0) {
+        close(rootfd);
+    }
+    rootfd = openat(parentfd, component.c_str(), O_PATH | O_CLOEXEC | O_NOFOLLOW);
+    struct stat st;
+    if (rootfd == -1 || fstat(rootfd, &st) != 0) {
+        perror_die(perm.dir);
+    } else if (!S_ISDIR(st.st_mode)) {
+        errno = ENOTDIR;
+        perror_die(perm.dir);
+    }
+}
+
+// Changing ownership in a jail. A pool of threads shares a stack of
+// directories, as in removal (`jail_remover`). Each entry is `stat`ed once --
+// a directory when opened, anything else by `fstatat` -- and chowned only if
+// its owner or group differs, so an unchanged inode keeps its change time. A
+// walk stays on its root's file system: a mount point, or a directory on
+// another file system, is not entered, though a root may be one. A file
+// linked from the link store -- a root-owned regular file with several links
+// whose inode is a store entry's -- is shared with other jails and keeps its
+// owner. With `strip_setid`, setuid and setgid bits are cleared from
+// everything but directories. A verbose walk runs on one thread, so its output
+// stays in order.
+struct jail_chowner {
+    struct ch_dir {
+        ch_dir* parent;
+        int parentfd;           // for a walk's roots
+        std::string component;  // name in the parent
+        std::string path;       // ends in `/`
+        uid_t uid;
+        gid_t gid;
+        bool home;              // entries owned by the users they name
+        int fd = -1;
+        dev_t dev = 0;          // the walk's file system, once opened
+        std::atomic<unsigned> pending = 1;     // its own read, and subdirectories
+    };
+    using ug_t = std::pair<uid_t, gid_t>;
+
+    std::unordered_map<std::string, ug_t> home_owners;
+    std::string skip;           // a directory not to enter
+    bool strip_setid = false;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<ch_dir*> stack;
+    size_t nlive = 0;           // directories pushed and not yet read
+    std::atomic<unsigned long long> nchanged = 0, nunchanged = 0, nshared = 0,
+        ndirs = 0, nstripped = 0;
+    std::once_flag store_once;
+    dev_t store_dev = 0;
+    std::unordered_set<ino_t> store_inos;       // read on first need
+
+    void add_home(int parentfd, const std::string& path, passwd_cache& pwc);
+    void add(int parentfd, const std::string& component, const std::string& path,
+             uid_t uid, gid_t gid);
+    void run();
+
+  private:
+    void work(dir_reader& reader);
+    void read(ch_dir* d, dir_reader& reader);
+    void finish(ch_dir* d);
+    void chown_entry(ch_dir* d, const char* name, uid_t uid, gid_t gid);
+    bool in_linkstore(const struct stat& st);
+};
+
+// Walk `home/` (`path`, in `parentfd`): it is owned by root, and each
+// directory under it by the user whose home it is. Only the names present are
+// looked up, so the cost follows the jail, not the user database.
+void jail_chowner::add_home(int parentfd, const std::string& path,
+                            passwd_cache& pwc) {
+    int fd = openat(parentfd, "home", O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd >= 0) {
+        dir_reader reader(4096);
+        reader.open(fd);
+        unsigned char type;
+        while (const char* name = reader.next(&type)) {
+            ug_t ug;
+            if (pwc.lookup(name, &ug.first, &ug.second)) {
+                home_owners[name] = ug;
+            }
+        }
+        close(fd);
+    }
+    stack.push_back(new ch_dir{nullptr, parentfd, "home", path, ROOT, ROOT, true});
+}
+
+// Walk directory `component` of `parentfd` (path `path`), owned by
+// `uid:gid`.
+void jail_chowner::add(int parentfd, const std::string& component,
+                       const std::string& path, uid_t uid, gid_t gid) {
+    stack.push_back(new ch_dir{nullptr, parentfd, component, path_endslash(path),
+                               uid, gid, false});
+}
+
+void jail_chowner::run() {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    nlive = stack.size();
+    // `uid_to_name` is not thread-safe, and verbose output is read in order
+    unsigned njobs = verbose ? 1 : populate_jobs();
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < njobs; ++t) {
+        try {
+            threads.emplace_back([&] () {
+                dir_reader reader;
+                work(reader);
+            });
+        } catch (std::system_error&) {
+            break;
+        }
+    }
+    dir_reader reader;
+    work(reader);
+    for (auto& th : threads) {
+        th.join();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (verbose) {
+        double dt = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        fprintf(verbosefile, "# chown: %llu changed, %llu unchanged, %llu shared, %llu directories, %u jobs, %.3fs\n",
+                nchanged.load(), nunchanged.load(), nshared.load(), ndirs.load(),
+                njobs, dt);
+        if (strip_setid) {
+            fprintf(verbosefile, "# chown: %llu setuid or setgid bits cleared\n",
+                    nstripped.load());
+        }
+    }
+}
+
+void jail_chowner::work(dir_reader& reader) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cond.wait(lock, [&] { return !stack.empty() || nlive == 0; });
+        if (stack.empty()) {
+            break;
+        }
+        ch_dir* d = stack.back();
+        stack.pop_back();
+        lock.unlock();
+        read(d, reader);
+        lock.lock();
+    }
+}
+
+void jail_chowner::read(ch_dir* d, dir_reader& reader) {
+    std::vector<ch_dir*> subdirs;
+    int parentfd = d->parent ? d->parent->fd : d->parentfd;
+    d->fd = openat(parentfd, d->component.c_str(),
+                   O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    struct stat st;
+    if (d->fd >= 0 && fstat(d->fd, &st) == 0
+        && (!d->parent || st.st_dev == d->parent->dev)) {
+        d->dev = st.st_dev;
+        ++ndirs;
+        if (st.st_uid == d->uid && st.st_gid == d->gid) {
+            ++nunchanged;
+        } else if (x_fchown(d->fd, d->uid, d->gid, d->path)) {
+            exit(::exit_status);
+        } else {
+            ++nchanged;
+        }
+
+        reader.open(d->fd);
+        unsigned char type;
+        while (const char* name = reader.next(&type)) {
+            uid_t u = d->uid;
+            gid_t g = d->gid;
+            if (d->home) {
+                if (auto it = home_owners.find(name); it != home_owners.end()) {
+                    u = it->second.first;
+                    g = it->second.second;
+                }
+            }
+            if (type == DT_UNKNOWN) {
+                struct stat est;
+                if (fstatat(d->fd, name, &est, AT_SYMLINK_NOFOLLOW) == 0
+                    && S_ISDIR(est.st_mode)) {
+                    type = DT_DIR;
+                }
+            }
+            if (type == DT_DIR) {
+                std::string path = d->path + name;
+                if (!is_mount_point(path) && path != skip) {
+                    subdirs.push_back(new ch_dir{d, -1, name, path + "/", u, g, false});
+                    ++d->pending;
+                }
+            } else if (type == DT_LNK) {
+                // don't follow symbolic links
+                chown_entry(d, name, d->uid, d->gid);
+            } else {
+                chown_entry(d, name, u, g);
+            }
+        }
+        if (errno != 0) {
+            perror_die(d->path);
+        }
+    } else if (!d->parent) {
+        perror_die(d->path);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stack.insert(stack.end(), subdirs.begin(), subdirs.end());
+        nlive += subdirs.size();
+        --nlive;
+    }
+    cond.notify_all();
+    finish(d);
+}
+
+void jail_chowner::chown_entry(ch_dir* d, const char* name, uid_t uid, gid_t gid) {
+    struct stat st;
+    if (fstatat(d->fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        if (errno != ENOENT) {
+            perror_fail("%s: %s\n", (d->path + name).c_str());
+        }
+        return;
+    }
+    if (strip_setid && !S_ISDIR(st.st_mode) && !S_ISLNK(st.st_mode)
+        && (st.st_mode & (S_ISUID | S_ISGID))
+        && !(st.st_nlink > 1 && in_linkstore(st))) {
+        mode_t mode = st.st_mode & 07777 & ~(S_ISUID | S_ISGID);
+        if (verbose) {
+            fprintf(verbosefile, "chmod 0%o %s%s\n", mode, d->path.c_str(), name);
+        }
+        if (!dryrun && fchmodat(d->fd, name, mode, AT_SYMLINK_NOFOLLOW) != 0) {
+            perror_fail("chmod %s: %s\n", (d->path + name).c_str());
+            exit(::exit_status);
+        }
+        ++nstripped;
+    }
+    if (st.st_uid == uid && st.st_gid == gid) {
+        ++nunchanged;
+    } else if (S_ISREG(st.st_mode) && st.st_nlink > 1 && st.st_uid == ROOT
+               && in_linkstore(st)) {
+        // linked from the link store, and so shared with other jails:
+        // chowning it would chown them all
+        if (verbose) {
+            fprintf(verbosefile, "# %s%s: shared file, owner unchanged\n",
+                    d->path.c_str(), name);
+        }
+        ++nshared;
+    } else if (x_lchownat(d->fd, name, uid, gid, d->path)) {
+        exit(::exit_status);
+    } else {
+        ++nchanged;
+    }
+}
+
+// True if `st` is the inode of a link store entry. The store's inodes are
+// collected once, when the first candidate turns up.
+bool jail_chowner::in_linkstore(const struct stat& st) {
+    if (linkstore.empty()) {
+        return false;
+    }
+    std::call_once(store_once, [&] {
+        int dirfd = open(linkstore.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+        DIR* dir;
+        struct stat sst;
+        if (dirfd == -1) {
+            return;
+        } else if (fstat(dirfd, &sst) != 0 || !(dir = fdopendir(dirfd))) {
+            close(dirfd);
+            return;
+        }
+        store_dev = sst.st_dev;
+        while (struct dirent* de = readdir(dir)) {
+            int subfd;
+            DIR* sd;
+            if (de->d_name[0] == '.'
+                || (subfd = openat(dirfd, de->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW)) == -1) {
+                continue;
+            } else if (!(sd = fdopendir(subfd))) {
+                close(subfd);
+                continue;
+            }
+            while (struct dirent* e = readdir(sd)) {
+                if (e->d_name[0] != '.'
+                    && fstatat(subfd, e->d_name, &sst, AT_SYMLINK_NOFOLLOW) == 0
+                    && S_ISREG(sst.st_mode)) {
+                    store_inos.insert(sst.st_ino);
+                }
+            }
+            closedir(sd);
+        }
+        closedir(dir);
+    });
+    return st.st_dev == store_dev && store_inos.count(st.st_ino) != 0;
+}
+
+// Drop `d`'s own count; if that was its last, close it, and repeat for its
+// parent.
+void jail_chowner::finish(ch_dir* d) {
+    while (d && --d->pending == 0) {
+        if (d->fd >= 0) {
+            close(d->fd);
+        }
+        ch_dir* parent = d->parent;
+        delete d;
+        d = parent;
+    }
+}
+
 // Chown `{dir}/home/` to be owned by root, and `{dir}/home/{user}`
-// to be owned by `user:user`.
-void jaildirinfo::chown_home() {
+// to be owned by `user:user`. Directory `skip`, if any, is left alone.
+void jaildirinfo::chown_home(const std::string& skip) {
     populate_mount_table();
-    std::string dirbuf = perm.dir + "home/";
-    int dirfd = openat(parentfd, (component + "/home").c_str(),
-                       O_CLOEXEC | O_NOFOLLOW);
-    struct stat dirst;
-    if (dirfd == -1 || fstat(dirfd, &dirst) != 0) {
-        perror_die(dirbuf);
-    }
-    chown_recursive(dirfd, dirbuf, ROOT, ROOT, true, dirst.st_dev);
+    int dirfd = open_root();
+    if (dirfd == -1) {
+        perror_die(perm.dir);
+    }
+    passwd_cache pwc;
+    if (!perm.pwcache.empty()) {
+        pwc.open(perm.pwcache, perm.pwcache_ttl);
+    }
+    jail_chowner chowner;
+    chowner.skip = skip;
+    chowner.add_home(dirfd, perm.dir + "home/", pwc);
+    if (verbose) {
+        fprintf(verbosefile, "# passwd: %llu names, %llu cached\n",
+                pwc.nlookups, pwc.ncached);
+    }
+    if (!dryrun) {
+        pwc.save();
+    }
+    chowner.run();
     close(dirfd);
 }
 
-// Chown `path` and directories under it to be owned by `owner:group`. `path`
-// must be located under the jail’s `dir`. Refuses to cross symbolic links in
-// the path. The final file may be a regular file or symbolic link (the link
-// or file is chown'd) or a directory (it and its children are chown'd
-// recursively).
-void jaildirinfo::chown_recursive(const std::string& path,
-                                  uid_t owner, gid_t group) {
+// Chown each of `paths`, and everything under it, to be owned by
+// `owner:group`. Each path must be located under the jail’s `dir`. Refuses
+// to cross symbolic links in a path. A final file may be a regular file or
+// symbolic link (the link or file is chown'd) or a directory (it and its
+// children are chown'd recursively). The directories are walked together, in
+// parallel, and a path under another is not walked twice. With
+// `strip_setid`, setuid and setgid bits are cleared along the way.
+void jaildirinfo::chown_recursive(std::vector<std::string> paths,
+                                  uid_t owner, gid_t group, bool strip_setid) {
     populate_mount_table();
+    // shorter paths first, so a directory is seen before anything under it
+    std::stable_sort(paths.begin(), paths.end(), [] (const std::string& a, const std::string& b) {
+        return a.length() < b.length();
+    });
+    jail_chowner chowner;
+    chowner.strip_setid = strip_setid;
+    std::vector<int> fds;
+    std::vector<std::string> dirs;
+    for (const auto& path : paths) {
+        if (std::any_of(dirs.begin(), dirs.end(), [&] (const std::string& d) {
+                return path.starts_with(d) || path + "/" == d;
+            })) {
+            continue;
+        }
+        int dirfd = chown_open_parent(path);
+        fds.push_back(dirfd);
+        size_t lastpos = path.size() - (path.back() == '/');
+        size_t dirpos = path.rfind('/', lastpos - 1);
+        std::string last_component(path.substr(dirpos + 1, lastpos - dirpos - 1));
+        assert(!last_component.empty() && last_component.find('/') == std::string::npos);
+        struct stat st;
+        if (fstatat(dirfd, last_component.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            perror_die(path);
+        } else if (S_ISDIR(st.st_mode)) {
+            chowner.add(dirfd, last_component, path, owner, group);
+            dirs.push_back(path_endslash(path));
+        } else if ((st.st_uid != owner || st.st_gid != group)
+                   && x_lchownat(dirfd, last_component.c_str(), owner, group,
+                                 path.substr(0, dirpos + 1))) {
+            exit(::exit_status);
+        }
+    }
+    chowner.run();
+    for (int fd : fds) {
+        close(fd);
+    }
+}
+
+// Return an `O_PATH` descriptor for the directory containing `path`, which
+// must be located under the jail’s `dir`, refusing to cross symbolic links.
+int jaildirinfo::chown_open_parent(const std::string& path) {
     assert(path.starts_with(perm.dir) && path.size() > perm.dir.size());
-    int dirfd = openat(parentfd, component.c_str(),
-                       O_PATH | O_CLOEXEC | O_NOFOLLOW);
+    int dirfd = open_root();
     if (dirfd == -1) {
         perror_die(perm.dir);
     }
-    // walk down to parent directory of `path`
+    // walk down to parent directory of `path`, in one `openat2` if possible
     size_t pos = perm.dir.size();
     size_t lastpos = path.size() - (path.back() == '/');
     size_t dirpos = path.rfind('/', lastpos - 1);
     assert(pos > 0 && dirpos >= pos - 1 && dirpos < lastpos);
+    if (pos < dirpos) {
+        std::string rest = path.substr(pos, dirpos - pos);
+        int nextfd = openat_beneath(dirfd, rest.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (nextfd >= 0) {
+            close(dirfd);
+            return nextfd;
+        }
+    }
     struct stat st;
     while (pos < dirpos) {
         size_t nextpos = path.find('/', pos);
@@ -1468,169 +3253,995 @@ void jaildirinfo::chown_recursive(const std::string& path,
         dirfd = nextfd;
         pos = nextpos + 1;
     }
-    // open `path` itself
-    std::string last_component(path.substr(dirpos + 1, lastpos - dirpos - 1));
-    assert(!last_component.empty() && last_component.find('/') == std::string::npos);
-    int lastfd = openat(dirfd, last_component.c_str(),
-                        O_PATH | O_CLOEXEC | O_NOFOLLOW);
-    if (lastfd == -1 || fstat(lastfd, &st) != 0) {
+    return dirfd;
+}
+
+// Return an `O_PATH` descriptor for directory `name` under `dirfd`, creating
+// it with `mode` if absent. It must be a root-owned directory not writable by
+// group or other.
+static int ensure_root_dirat(int dirfd, const char* name, mode_t mode,
+                             const std::string& path) {
+    int fd = dirfd < 0 ? -1 : openat(dirfd, name, O_PATH | O_CLOEXEC | O_NOFOLLOW);
+    if (fd == -1 && (errno == ENOENT || dirfd < 0)) {
+        if (v_mkdirat(dirfd, name, mode, path) != 0) {
+            perror_die("mkdir " + path);
+        } else if (dryrun) {
+            return -1;
+        }
+        fd = openat(dirfd, name, O_PATH | O_CLOEXEC | O_NOFOLLOW);
+    }
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0) {
         perror_die(path);
+    } else if (!S_ISDIR(st.st_mode)) {
+        errno = ENOTDIR;
+        perror_die(path);
+    } else if (st.st_uid != ROOT) {
+        die("%s: Not owned by root\n", path.c_str());
+    } else if (st.st_mode & (S_IWGRP | S_IWOTH)) {
+        die("%s: Writable by non-root\n", path.c_str());
+    }
+    return fd;
+}
+
+// `--overlay`: create `.pa-overlay` under the jail directory, holding the
+// overlay's upper layer (`upper`, which takes the run's writes), its work
+// directory (`work`), and the mount point (`root`) where the overlay is
+// assembled before it is moved onto the jail directory.
+void jaildirinfo::ensure_overlay() {
+    int dirfd = open_root();
+    if (dirfd == -1 && !dryrun) {
+        perror_die(perm.dir);
+    }
+    mode_t old_umask = umask(0);
+    std::string ovdir = perm.dir + ".pa-overlay";
+    int ovfd = ensure_root_dirat(dirfd, ".pa-overlay", 0700, ovdir);
+    for (const char* name : {"upper", "work", "root"}) {
+        int fd = ensure_root_dirat(ovfd, name, strcmp(name, "work") == 0 ? 0700 : 0755,
+                                   ovdir + "/" + name);
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    umask(old_umask);
+    if (ovfd >= 0) {
+        close(ovfd);
+    }
+    if (dirfd >= 0) {
+        close(dirfd);
+    }
+}
+
+// Removing a jail. A pool of `--jobs` threads shares a stack of directories:
+// a thread reads a directory in large batches (`dir_reader`), unlinks its
+// files relative to its descriptor, and pushes its subdirectories, and the
+// thread that finishes a directory's last subtree removes the directory,
+// then perhaps its parent. A stack keeps the work depth-first, so few
+// directories are open at once. As with `rm -r --one-file-system`, a
+// directory on another file system is not entered, and a file system a dry
+// run would have unmounted is skipped. `reap --rate` caps the entries removed
+// per second.
+struct jail_remover {
+    struct rm_dir {
+        rm_dir* parent;
+        std::string component; // name in `parent`
+        std::string path;      // ends in `/`
+        int fd = -1;
+        std::atomic<unsigned> pending = 1;     // its own read, and subdirectories
+    };
+
+    dev_t dev;
+    int rootparentfd;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<rm_dir*> stack;
+    size_t nlive = 0;           // directories pushed and not yet read
+    std::atomic<unsigned long long> nfiles = 0, ndirs = 0, nreads = 0;
+    struct timespec t0;
+    std::mutex rate_mutex;
+    unsigned long long nrated = 0;     // entries allowed by `opt_rate`
+
+    jail_remover(dev_t dev_, int parentfd)
+        : dev(dev_), rootparentfd(parentfd) {
+    }
+    void run(const std::string& component, const std::string& path);
+
+  private:
+    void work(fsbatch& b, dir_reader& reader);
+    void read(rm_dir* d, fsbatch& b, dir_reader& reader);
+    void finish(rm_dir* d, bool remove);
+    void throttle(unsigned long long n);
+};
+
+void jail_remover::run(const std::string& component, const std::string& path) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    stack.push_back(new rm_dir{nullptr, component, path_endslash(path)});
+    nlive = 1;
+    // a dry run prints its actions in order
+    unsigned njobs = dryrun ? 1 : populate_jobs();
+    std::vector<std::pair<unsigned long long, unsigned long long>> iostats(njobs);
+    auto thread_work = [&] (unsigned t) {
+        fsbatch b;
+        if (fsb.uring()) {
+            b.init_uring();
+        }
+        dir_reader reader;
+        work(b, reader);
+        iostats[t] = {b.nops, b.nsyscalls};
+    };
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < njobs; ++t) {
+        try {
+            threads.emplace_back(thread_work, t);
+        } catch (std::system_error&) {
+            break;
+        }
+    }
+    dir_reader reader;
+    work(fsb, reader);
+    for (auto& th : threads) {
+        th.join();
+    }
+    for (auto& io : iostats) {
+        fsb.nops += io.first;
+        fsb.nsyscalls += io.second;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (verbose) {
+        double dt = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        fprintf(verbosefile, "# rm: %llu files, %llu directories, %llu directory reads, %u jobs, %.3fs, %.0f files/s\n",
+                nfiles.load(), ndirs.load(), nreads.load(), njobs, dt,
+                dt > 0 ? nfiles / dt : 0.0);
+    }
+}
+
+void jail_remover::work(fsbatch& b, dir_reader& reader) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cond.wait(lock, [&] { return !stack.empty() || nlive == 0; });
+        if (stack.empty()) {
+            break;
+        }
+        rm_dir* d = stack.back();
+        stack.pop_back();
+        lock.unlock();
+        read(d, b, reader);
+        lock.lock();
+    }
+    nreads += reader.nreads;
+}
+
+void jail_remover::read(rm_dir* d, fsbatch& b, dir_reader& reader) {
+    std::vector<rm_dir*> subdirs;
+    bool remove = false;
+    if (const int* v = dst_table.find(path_noendslash(d->path));
+        !v || *v != 3) {        // not an unmounted file system
+        int parentfd = d->parent ? d->parent->fd : rootparentfd;
+        d->fd = openat(parentfd, d->component.c_str(),
+                       O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        struct stat dirst;
+        if (d->fd == -1 || fstat(d->fd, &dirst) != 0) {
+            perror_die(d->path);
+        }
+        remove = dirst.st_dev == dev;   // --one-file-system
+    }
+
+    std::vector<std::string> files;     // unlinked together, in one batch
+    std::vector<int> r;
+    size_t batchsize = opt_rate > 0 ? std::clamp<size_t>(opt_rate / 8, 1, 256) : 256;
+    auto unlink_files = [&] () {
+        throttle(files.size());
+        r.resize(files.size());
+        for (size_t i = 0; i != files.size(); ++i) {
+            b.unlinkat(d->fd, files[i], 0, &r[i]);
+        }
+        b.submit();
+        for (size_t i = 0; i != files.size(); ++i) {
+            if (r[i] < 0) {
+                errno = -r[i];
+                perror_die("rm " + d->path + files[i]);
+            }
+        }
+        files.clear();
+    };
+    if (remove) {
+        unsigned long long n = 0;
+        reader.open(d->fd);
+        unsigned char type;
+        while (const char* name = reader.next(&type)) {
+            struct stat st;
+            if (type == DT_UNKNOWN
+                && fstatat(d->fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0
+                && S_ISDIR(st.st_mode)) {
+                type = DT_DIR;
+            }
+            if (type == DT_DIR) {
+                subdirs.push_back(new rm_dir{d, name, d->path + name + "/"});
+                ++d->pending;
+                continue;
+            }
+            ++n;
+            if (verbose) {
+                fprintf(verbosefile, "rm %s%s\n", d->path.c_str(), name);
+            }
+            if (!dryrun) {
+                files.push_back(name);
+                if (files.size() == batchsize) {
+                    unlink_files();
+                }
+            }
+        }
+        if (errno != 0) {
+            perror_die(d->path);
+        }
+        unlink_files();
+        nfiles += n;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stack.insert(stack.end(), subdirs.begin(), subdirs.end());
+        nlive += subdirs.size();
+        --nlive;
+    }
+    cond.notify_all();
+    finish(d, remove);
+}
+
+// Drop `d`'s own count; if that was its last, remove it (if `remove`), and
+// repeat for its parent.
+void jail_remover::finish(rm_dir* d, bool remove) {
+    while (d && --d->pending == 0) {
+        if (d->fd >= 0) {
+            close(d->fd);
+        }
+        if (remove) {
+            std::string dirname = path_noendslash(d->path);
+            if (verbose) {
+                fprintf(verbosefile, "rmdir %s\n", dirname.c_str());
+            }
+            int parentfd = d->parent ? d->parent->fd : rootparentfd;
+            throttle(1);
+            if (!dryrun && unlinkat(parentfd, d->component.c_str(), AT_REMOVEDIR) != 0) {
+                perror_die("rmdir " + dirname);
+            }
+            ++ndirs;
+        }
+        rm_dir* parent = d->parent;
+        delete d;
+        d = parent;
+        remove = true;
+    }
+}
+
+// Sleep until removing `n` more entries keeps within `opt_rate`.
+void jail_remover::throttle(unsigned long long n) {
+    if (opt_rate <= 0 || dryrun || n == 0) {
+        return;
+    }
+    double due;
+    {
+        std::lock_guard<std::mutex> lock(rate_mutex);
+        due = nrated / opt_rate;
+        nrated += n;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double wait = due - ((now.tv_sec - t0.tv_sec) + (now.tv_nsec - t0.tv_nsec) / 1e9);
+    if (wait > 0) {
+        struct timespec ts = {time_t(wait), long((wait - time_t(wait)) * 1e9)};
+        while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+            // sleep out the remainder
+        }
+    }
+}
+
+void jaildirinfo::remove() {
+    jail_remover(dev, parentfd).run(component, perm.dir);
+}
+
+
+// Jail pools. `pa-jail prepare POOLDIR N` keeps N jails populated from a
+// manifest in POOLDIR, named `ready.*`, so that `add --pool POOLDIR` or `run
+// --pool POOLDIR` can start from one instead of an empty directory. A claim is
+// a `rename` of a ready jail onto the (empty) jail directory, after the jail
+// directory's usual checks, so two runs never claim the same jail, and a run
+// that finds none ready populates as before. A ready jail's name carries a
+// digest of the manifest text it was prepared from, and only a run with the
+// same manifest claims it. Prepared jails are root-owned, with no home
+// directory and no mounts; the run's manifest is populated over the claimed
+// jail as usual, which costs a `stat` per unchanged file and recopies a
+// source changed since.
+
+static bool pool_entry_ok(int poolfd, const char* name) {
+    struct stat st;
+    return fstatat(poolfd, name, &st, AT_SYMLINK_NOFOLLOW) == 0
+        && S_ISDIR(st.st_mode)
+        && st.st_uid == ROOT
+        && !(st.st_mode & (S_IWGRP | S_IWOTH));
+}
+
+// The name prefix of jails prepared from `manifest`.
+static std::string pool_ready_prefix(const std::string& manifest) {
+    return "ready." + sha256_hex(manifest).substr(0, 16) + ".";
+}
+
+static int open_pool(const jaildirinfo& pool) {
+    int poolfd = openat(pool.parentfd, pool.component.c_str(),
+                        O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    struct stat st;
+    if (poolfd == -1 || fstat(poolfd, &st) != 0) {
+        perror_die(pool.perm.dir);
+    } else if (st.st_uid != ROOT || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        die("%s: Pool must be a root-owned directory writable only by root\n",
+            pool.perm.dir.c_str());
+    }
+    return poolfd;
+}
+
+// Return the names in `poolfd` that start with `prefix`.
+static std::vector<std::string> pool_entries(int poolfd, std::string_view prefix) {
+    std::vector<std::string> names;
+    DIR* dir = fdopendir(dup(poolfd));
+    if (!dir) {
+        perror_die("opendir");
+    }
+    // the duplicate shares `poolfd`'s position
+    rewinddir(dir);
+    while (struct dirent* de = readdir(dir)) {
+        if (std::string_view(de->d_name).starts_with(prefix)) {
+            names.emplace_back(de->d_name);
+        }
+    }
+    closedir(dir);
+    return names;
+}
+
+// `pa-jail prepare`: top the pool up to `n` ready jails. Each is populated by
+// a forked child, since population's tables are global, in `.build.*`, then
+// renamed ready. Ready jails from another manifest are removed. Preparers
+// serialize on the pool directory's lock; one that finds the lock held leaves
+// the work to its holder.
+static int prepare_pool(pajailconf& jailconf, const char* pooldir, long n,
+                        std::string& manifest, bool foreground) {
+    jaildirinfo pool(pooldir, std::string(), do_prepare, jailconf);
+    if (!dryrun && !foreground) {
+        pid_t p = fork();
+        if (p > 0) {
+            exit(0);
+        } else if (p < 0) {
+            perror_die("fork");
+        }
+    }
+    if (dryrun) {
+        // the pool directory might not exist yet
+        return 0;
+    }
+    int poolfd = open_pool(pool);
+    if (flock(poolfd, LOCK_EX | LOCK_NB) != 0) {
+        if (errno != EWOULDBLOCK) {
+            perror_die(pool.perm.dir);
+        } else if (verbose) {
+            fprintf(verbosefile, "# %s: another preparer is running\n",
+                    pool.perm.dir.c_str());
+        }
+        return 0;
+    }
+
+    // an interrupted preparer leaves a partial jail
+    for (auto& name : pool_entries(poolfd, ".build.")) {
+        jaildirinfo(path_endslash(pool.perm.dir + name).c_str(), std::string(),
+                    do_rm, jailconf).remove();
+    }
+    std::string prefix = pool_ready_prefix(manifest);
+    long nready = 0;
+    for (auto& name : pool_entries(poolfd, "ready.")) {
+        if (!name.starts_with(prefix)) {
+            jaildirinfo(path_endslash(pool.perm.dir + name).c_str(), std::string(),
+                        do_rm, jailconf).remove();
+        } else {
+            nready += pool_entry_ok(poolfd, name.c_str());
+        }
+    }
+    if (!pool.perm.linkstore.empty()) {
+        linkstore_init(pool.perm.linkstore, pool.dev,
+                       {pool.perm.dir, pool.perm.skeletondir});
+    }
+
+    std::string tag = std::to_string((long long) time(nullptr)) + "."
+        + std::to_string((long) getpid()) + ".";
+    for (long k = 0; nready + k < n; ++k) {
+        std::string build = ".build." + tag + std::to_string(k);
+        std::string ready = prefix + tag + std::to_string(k);
+        fflush(verbosefile);
+        pid_t child = fork();
+        if (child == 0) {
+            dstroot = pool.perm.dir + build;
+            if (v_mkdirat(poolfd, build.c_str(), 0755, dstroot) != 0) {
+                perror_die(dstroot);
+            }
+            umask(0);
+            int r = construct_jail(pool.dev, manifest, true);
+            if (verbose) {
+                pplan.report();
+                pstats.report();
+                report_fsbatch();
+            }
+            exit(r == 0 ? 0 : 1);
+        } else if (child < 0) {
+            perror_die("fork");
+        }
+        if (x_waitpid(child, 0).second != 0) {
+            if (faccessat(poolfd, build.c_str(), F_OK, AT_SYMLINK_NOFOLLOW) == 0) {
+                jaildirinfo(path_endslash(pool.perm.dir + build).c_str(),
+                            std::string(), do_rm, jailconf).remove();
+            }
+            fprintf(stderr, "%s%s: Could not prepare jail\n",
+                    pool.perm.dir.c_str(), build.c_str());
+            return 1;
+        }
+        if (verbose) {
+            fprintf(verbosefile, "mv %s%s %s%s\n", pool.perm.dir.c_str(),
+                    build.c_str(), pool.perm.dir.c_str(), ready.c_str());
+        }
+        if (renameat(poolfd, build.c_str(), poolfd, ready.c_str()) != 0) {
+            perror_die("mv " + pool.perm.dir + build);
+        }
+    }
+    close(poolfd);
+    return 0;
+}
+
+// `--pool POOLDIR`: claim a jail prepared from `manifest` in `pooldir` as
+// `jaildir`. Returns false, leaving `jaildir` alone, if none can be claimed:
+// the pool is missing, has none ready for `manifest`, or is on another file
+// system, or `jaildir` is not empty.
+static bool claim_pool_jail(pajailconf& jailconf, const std::string& pooldir,
+                            const jaildirinfo& jaildir, const std::string& manifest) {
+    std::string dir = path_pa_validate(path_absolute(pooldir));
+    if (struct stat st; dir.empty() || lstat(dir.c_str(), &st) != 0) {
+        if (verbose) {
+            fprintf(verbosefile, "# %s: no jail pool\n", pooldir.c_str());
+        }
+        return false;
+    }
+    jaildirinfo pool(dir.c_str(), std::string(), do_mv, jailconf);
+    if (pool.dev != jaildir.dev) {
+        if (verbose) {
+            fprintf(verbosefile, "# %s: jail pool on another file system\n",
+                    pool.perm.dir.c_str());
+        }
+        return false;
+    }
+    int poolfd = open_pool(pool);
+    bool claimed = false, tried = false;
+    for (auto& name : pool_entries(poolfd, pool_ready_prefix(manifest))) {
+        if (!pool_entry_ok(poolfd, name.c_str())) {
+            continue;
+        }
+        tried = true;
+        if (verbose) {
+            fprintf(verbosefile, "mv %s%s %s\n", pool.perm.dir.c_str(),
+                    name.c_str(), jaildir.perm.dir.c_str());
+        }
+        if (dryrun) {
+            claimed = true;
+            break;
+        }
+        if (renameat(poolfd, name.c_str(), jaildir.parentfd,
+                     jaildir.component.c_str()) == 0) {
+            claimed = true;
+            break;
+        } else if (errno != ENOENT) {
+            // ENOENT: another run claimed it first
+            if (verbose) {
+                fprintf(verbosefile, "# %s: %s, not claimed\n",
+                        jaildir.perm.dir.c_str(), strerror(errno));
+            }
+            break;
+        }
+    }
+    if (!tried && verbose) {
+        fprintf(verbosefile, "# %s: no ready jail\n", pool.perm.dir.c_str());
+    }
+    close(poolfd);
+    return claimed;
+}
+
+
+// `pa-jail clone SRCJAIL DSTJAIL`: build a jail as a copy of a populated
+// ("golden") jail in one walk of the source tree, rather than by replaying
+// its manifest. Both directories are checked against /etc/pa-jail.conf, and
+// the source must be root-owned and writable only by root. Regular files no
+// jail user could change -- root-owned, without group or other write
+// permission, the link store's rule -- are hard-linked; others are reflinked
+// where the file system allows, else copied. Directories, symbolic links, and
+// allowed device nodes are recreated with their owners, modes, and times. The
+// walk does not descend into `home`, `.pa-overlay`, or other file systems
+// (mounts); those directories are created empty.
+struct jail_cloner {
+    dev_t dev;                  // the source jail's file system
+    dev_t dst_dev = 0;          // the destination jail root, never copied
+    ino_t dst_ino = 0;
+    unsigned long long dirs = 0, files_linked = 0, files_reflinked = 0,
+        files_copied = 0, bytes_copied = 0, symlinks = 0, nodes = 0;
+
+    explicit jail_cloner(dev_t dev_)
+        : dev(dev_) {
+    }
+    void clone_dir(int srcfd, int dstfd, const std::string& src,
+                   const std::string& dst, bool top);
+    void report() const;
+
+  private:
+    void clone_entry(int srcfd, int dstfd, const char* name,
+                     const std::string& src, const std::string& dst, bool top);
+};
+
+// Clone the entries of directory `srcfd` (path `src`) into `dstfd` (`dst`),
+// which is -1 when a dry run has not created it.
+void jail_cloner::clone_dir(int srcfd, int dstfd, const std::string& src,
+                            const std::string& dst, bool top) {
+    DIR* dir = fdopendir(dup(srcfd));
+    if (!dir) {
+        perror_die(src);
+    }
+    rewinddir(dir);
+    while (struct dirent* de = readdir(dir)) {
+        if (strcmp(de->d_name, ".") != 0 && strcmp(de->d_name, "..") != 0) {
+            clone_entry(srcfd, dstfd, de->d_name, src, dst, top);
+        }
+    }
+    closedir(dir);
+}
+
+void jail_cloner::clone_entry(int srcfd, int dstfd, const char* name,
+                              const std::string& srcdir, const std::string& dstdir,
+                              bool top) {
+    std::string src = srcdir + name, dst = dstdir + name;
+    struct stat st;
+    if (fstatat(srcfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        perror_fail("%s: %s\n", src.c_str());
+        return;
+    }
+    mode_t mode = st.st_mode & perm_mask;
+    bool live = !dryrun && dstfd >= 0;
+
+    if (S_ISDIR(st.st_mode)) {
+        if (st.st_dev == dst_dev && st.st_ino == dst_ino) {
+            return;
+        }
+        ++dirs;
+        if (verbose) {
+            fprintf(verbosefile, "mkdir -m 0%o %s\n", mode, dst.c_str());
+        }
+        int subdstfd = -1;
+        if (live
+            && (mkdirat(dstfd, name, 0700) != 0
+                || (subdstfd = openat(dstfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) == -1)) {
+            perror_fail("mkdir %s: %s\n", dst.c_str());
+            return;
+        }
+        if (st.st_dev == dev
+            && !(top && (strcmp(name, "home") == 0 || strcmp(name, ".pa-overlay") == 0))) {
+            int subsrcfd = openat(srcfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (subsrcfd == -1) {
+                perror_fail("%s: %s\n", src.c_str());
+            } else {
+                clone_dir(subsrcfd, subdstfd, path_endslash(src), path_endslash(dst), false);
+                close(subsrcfd);
+            }
+        }
+        // set the mode last: the copy may need to write a read-only directory
+        if (subdstfd >= 0) {
+            if (fchown(subdstfd, st.st_uid, st.st_gid) != 0
+                || fchmod(subdstfd, mode) != 0) {
+                perror_fail("chmod %s: %s\n", dst.c_str());
+            }
+            close(subdstfd);
+        }
+    } else if (S_ISREG(st.st_mode)) {
+        if (st.st_uid == ROOT && (st.st_mode & (S_IWGRP | S_IWOTH)) == 0) {
+            if (verbose) {
+                fprintf(verbosefile, "ln %s %s\n", src.c_str(), dst.c_str());
+            }
+            if (!live || linkat(srcfd, name, dstfd, name, 0) == 0) {
+                ++files_linked;
+                return;
+            } else if (errno != EXDEV && errno != EMLINK) {
+                perror_fail("ln %s: %s\n", dst.c_str());
+                return;
+            }
+        }
+        if (verbose) {
+            fprintf(verbosefile, "cp -p %s %s\n", src.c_str(), dst.c_str());
+        }
+        copy_result result;
+        if (live && copy_file_at(srcfd, name, dstfd, name, &st, result, true) != 0) {
+            perror_fail("cp %s: %s\n", dst.c_str());
+            return;
+        }
+        if (result.method == COPY_REFLINK) {
+            ++files_reflinked;
+        } else {
+            ++files_copied;
+            bytes_copied += result.bytes;
+        }
+        return;
+    } else if (S_ISLNK(st.st_mode)) {
+        char lnkbuf[4096];
+        ssize_t r = readlinkat(srcfd, name, lnkbuf, sizeof(lnkbuf));
+        if (r == -1) {
+            perror_fail("readlink %s: %s\n", src.c_str());
+            return;
+        } else if (r == sizeof(lnkbuf)) {
+            perror_fail("%s: Symbolic link too long\n", src.c_str());
+            return;
+        }
+        lnkbuf[r] = 0;
+        ++symlinks;
+        if (verbose) {
+            fprintf(verbosefile, "ln -s %s %s\n", lnkbuf, dst.c_str());
+        }
+        if (live && symlinkat(lnkbuf, dstfd, name) != 0) {
+            perror_fail("ln -s %s: %s\n", dst.c_str());
+            return;
+        }
+    } else if (S_ISCHR(st.st_mode) || S_ISBLK(st.st_mode)) {
+        // the golden jail was checked when it was populated, but it is only
+        // a directory: check again before wielding `mknod`
+        if (!dev_node_allowed(st.st_mode, st.st_rdev)) {
+            std::string what = src + " (" + dev_name(st.st_mode, st.st_rdev) + ")";
+            perror_fail("%s: Device node not permitted in jail\n", what.c_str());
+            return;
+        }
+        ++nodes;
+        if (verbose) {
+            fprintf(verbosefile, "mknod -m 0%o %s %s\n", mode, dst.c_str(),
+                    dev_name(st.st_mode, st.st_rdev));
+        }
+        if (live && mknodat(dstfd, name, (st.st_mode & S_IFMT) | mode, st.st_rdev) != 0) {
+            perror_fail("mknod %s: %s\n", dst.c_str());
+            return;
+        }
+    } else {
+        // sockets and FIFOs belong to the runs that made them
+        if (verbose) {
+            fprintf(verbosefile, "# %s: not cloned\n", src.c_str());
+        }
+        return;
+    }
+
+    // symbolic links and device nodes
+    if ((st.st_uid != ROOT || st.st_gid != ROOT) && verbose) {
+        fprintf(verbosefile, "chown -h %s:%s %s\n",
+                uid_to_name(st.st_uid), gid_to_name(st.st_gid), dst.c_str());
+    }
+    struct timespec ts[2] = {st.st_atim, st.st_mtim};
+    if (live
+        && (fchownat(dstfd, name, st.st_uid, st.st_gid, AT_SYMLINK_NOFOLLOW) != 0
+            || utimensat(dstfd, name, ts, AT_SYMLINK_NOFOLLOW) != 0)) {
+        perror_fail("chown %s: %s\n", dst.c_str());
+    }
+}
+
+void jail_cloner::report() const {
+    fprintf(verbosefile, "# clone: %llu directories, %llu files linked, %llu reflinked, %llu copied (%llu bytes), %llu symbolic links, %llu device nodes\n",
+            dirs, files_linked, files_reflinked, files_copied, bytes_copied,
+            symlinks, nodes);
+}
+
+static int clone_jail(pajailconf& jailconf, const char* srcarg, const char* dstarg) {
+    jaildirinfo src(srcarg, std::string(), do_mv, jailconf);
+    int srcfd = openat(src.parentfd, src.component.c_str(),
+                       O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    struct stat st;
+    if (srcfd == -1 || fstat(srcfd, &st) != 0) {
+        perror_die(src.perm.dir);
+    } else if (st.st_uid != ROOT) {
+        die("%s: Not owned by root\n", src.perm.dir.c_str());
+    } else if ((st.st_gid != ROOT && (st.st_mode & S_IWGRP))
+               || (st.st_mode & S_IWOTH)) {
+        die("%s: Writable by non-root\n", src.perm.dir.c_str());
+    }
+
+    jaildirinfo dst(dstarg, std::string(), do_clone, jailconf);
+    jail_cloner cloner(st.st_dev);
+    int dstfd = openat(dst.parentfd, dst.component.c_str(),
+                       O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (dstfd == -1 && !dryrun) {
+        perror_die(dst.perm.dir);
+    } else if (dstfd >= 0) {
+        struct stat dst_st;
+        if (fstat(dstfd, &dst_st) != 0) {
+            perror_die(dst.perm.dir);
+        }
+        cloner.dst_dev = dst_st.st_dev;
+        cloner.dst_ino = dst_st.st_ino;
+        if (dst_st.st_dev == st.st_dev && dst_st.st_ino == st.st_ino) {
+            die("%s: Cannot clone a jail onto itself\n", dst.perm.dir.c_str());
+        } else if (pool_entries(dstfd, "").size() > 2) {
+            // more than `.` and `..`
+            die("%s: Clone destination is not empty\n", dst.perm.dir.c_str());
+        }
+    }
+
+    umask(0);
+    cloner.clone_dir(srcfd, dstfd, src.perm.dir, dst.perm.dir, true);
+    if (verbose) {
+        cloner.report();
     }
-    if (x_fchown_path(lastfd, owner, group, path)) {
-        exit(::exit_status);
+    close(srcfd);
+    if (dstfd >= 0) {
+        close(dstfd);
     }
-    if (S_ISDIR(st.st_mode)) {
-        // reopen without O_PATH, chown recursively
-        close(lastfd);
-        lastfd = openat(dirfd, last_component.c_str(),
-                        O_CLOEXEC | O_NOFOLLOW);
-        if (lastfd == -1 || fstat(lastfd, &st) != 0 || !S_ISDIR(st.st_mode)) {
-            perror_die(path);
-        }
-        std::string pathbuf = path_endslash(path);
-        chown_recursive(lastfd, pathbuf, owner, group, false, st.st_dev);
-    } else {
-        close(lastfd);
+    return ::exit_status;
+}
+
+
+// Unmount everything mounted in `jaildir`, then remove it.
+static void remove_jail(jaildirinfo& jaildir) {
+    // unmount EVERYTHING mounted in the jail!
+    // INCLUDING MY HOME DIRECTORY
+    populate_mount_table();
+    auto mounts = mount_info.below(jaildir.perm.dir);
+    for (auto it = mounts.rbegin(); it != mounts.rend(); ++it) {
+        handle_umount((*it)->path);
     }
-    close(dirfd);
+    jaildir.remove();
 }
 
-void jaildirinfo::chown_recursive(int dirfd, std::string& dirbuf,
-                                  uid_t owner, gid_t group,
-                                  bool ishome, dev_t dev) {
-    dirbuf = path_endslash(dirbuf);
-    size_t dirbuflen = dirbuf.length();
 
-    using ug_t = std::pair<uid_t, gid_t>;
-    std::unordered_map<std::string, ug_t>* home_map = nullptr;
-    if (ishome) {
-        setpwent();
-        home_map = new std::unordered_map<std::string, ug_t>;
-        while (struct passwd* pw = getpwent()) {
-            std::string name;
-            if (pw->pw_dir
-                && strncmp(pw->pw_dir, "/home/", 6) == 0
-                && strchr(pw->pw_dir + 6, '/') == nullptr) {
-                name = pw->pw_dir + 6;
-            } else {
-                name = pw->pw_name;
-            }
-            (*home_map)[name] = ug_t(pw->pw_uid, pw->pw_gid);
+// `pa-jail recycle JAILDIR FRESHDIR`: put the jail in FRESHDIR in place of
+// JAILDIR. One `renameat2(RENAME_EXCHANGE)` swaps the two trees, so JAILDIR
+// is never missing and a busy old jail does not hold up the new one. The old
+// tree, now at FRESHDIR, is renamed to `JAILDIR~.TIMESTAMP`, where `pa-jail
+// reap` looks for it, and removed in the background unless `--no-rm`.
+
+static int x_renameat2(int olddirfd, const char* oldpath,
+                       int newdirfd, const char* newpath, unsigned flags) {
+#if __linux__ && defined(SYS_renameat2)
+    return syscall(SYS_renameat2, olddirfd, oldpath, newdirfd, newpath, flags);
+#else
+    (void) olddirfd, (void) oldpath, (void) newdirfd, (void) newpath, (void) flags;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static int recycle_jail(pajailconf& jailconf, const char* jailarg,
+                        const char* freshdirarg, bool remove_old) {
+    // FRESHDIR will be the jail root, so check it as `run` would
+    jaildirinfo fresh(freshdirarg, std::string(), do_mv, jailconf);
+    struct stat st;
+    if (fresh.rootfd == -1 || fstat(fresh.rootfd, &st) != 0) {
+        perror_die(fresh.perm.dir);
+    } else if (st.st_uid != ROOT) {
+        die("%s: Not owned by root\n", fresh.perm.dir.c_str());
+    } else if ((st.st_gid != ROOT && (st.st_mode & S_IWGRP))
+               || (st.st_mode & S_IWOTH)) {
+        die("%s: Writable by non-root\n", fresh.perm.dir.c_str());
+    }
+
+    jaildirinfo jaildir(jailarg, std::string(), do_recycle, jailconf);
+    std::string jailpath = jaildir.parent + jaildir.component;
+    std::string freshpath = fresh.parent + fresh.component;
+    struct stat jst;
+    bool exists = jaildir.rootfd >= 0;
+    if (exists && fstat(jaildir.rootfd, &jst) != 0) {
+        perror_die(jaildir.perm.dir);
+    } else if (exists && jst.st_dev == st.st_dev && jst.st_ino == st.st_ino) {
+        die("%s: Cannot recycle a jail onto itself\n", jaildir.perm.dir.c_str());
+    }
+
+    if (!exists) {
+        if (verbose) {
+            fprintf(verbosefile, "mv -T --no-clobber %s %s\n", freshpath.c_str(), jailpath.c_str());
+        }
+        if (!dryrun
+            && x_renameat2(fresh.parentfd, fresh.component.c_str(),
+                           jaildir.parentfd, jaildir.component.c_str(),
+                           RENAME_NOREPLACE) != 0) {
+            die("mv %s %s: %s\n", freshpath.c_str(), jailpath.c_str(), strerror(errno));
         }
+        return ::exit_status;
     }
 
-    DIR* dir = fdopendir(dirfd);
-    if (!dir) {
-        perror_die(dirbuf);
+    // name the old tree now, so a disabled name stops us before the swap
+    char timestamp[64];
+    time_t now = time(nullptr);
+    strftime(timestamp, sizeof(timestamp), "%Y%m%dT%H%M%S", gmtime(&now));
+    std::string oldcomponent = jaildir.component + "~." + timestamp;
+    if (jailperm perm = jailconf.get(jaildir.parent + oldcomponent); !perm) {
+        die("%s: Destination jail disabled by /etc/pa-jail.conf\n%s",
+            (jaildir.parent + oldcomponent).c_str(), perm.disable_message().c_str());
     }
 
-    struct dirent* de;
-    while ((de = readdir(dir))) {
-        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
-            continue;
-        }
+    if (verbose) {
+        fprintf(verbosefile, "mv --exchange %s %s\n", freshpath.c_str(), jailpath.c_str());
+    }
+    if (!dryrun
+        && x_renameat2(fresh.parentfd, fresh.component.c_str(),
+                       jaildir.parentfd, jaildir.component.c_str(),
+                       RENAME_EXCHANGE) != 0) {
+        die("mv --exchange %s %s: %s\n", freshpath.c_str(), jailpath.c_str(), strerror(errno));
+    }
 
-        // don't follow symbolic links
-        if (de->d_type == DT_LNK) {
-            if (x_lchownat(dirfd, de->d_name, owner, group, dirbuf)) {
-                exit(::exit_status);
-            }
-            continue;
+    // move the old tree aside, next to JAILDIR
+    std::string oldpath;
+    for (int n = 0; true; ++n) {
+        std::string name = oldcomponent;
+        if (n > 0) {
+            name += "." + std::to_string(n);
+        }
+        oldpath = jaildir.parent + name;
+        if (verbose) {
+            fprintf(verbosefile, "mv -T --no-clobber %s %s\n", freshpath.c_str(), oldpath.c_str());
+        }
+        if (dryrun
+            || x_renameat2(fresh.parentfd, fresh.component.c_str(),
+                           jaildir.parentfd, name.c_str(), RENAME_NOREPLACE) == 0) {
+            break;
+        } else if (errno != EEXIST || n == 100) {
+            die("mv %s %s: %s\n", freshpath.c_str(), oldpath.c_str(), strerror(errno));
         }
+    }
 
-        // look up uid/gid if in home
-        uid_t u = owner;
-        gid_t g = group;
-        if (home_map) {
-            auto it = home_map->find(de->d_name);
-            if (it != home_map->end()) {
-                u = it->second.first;
-                g = it->second.second;
+    if (remove_old && !dryrun) {
+        pid_t p = fork();
+        if (p < 0) {
+            perror_die("fork");
+        } else if (p == 0) {
+            jaildirinfo old(oldpath.c_str(), std::string(), do_rm, jailconf);
+            remove_jail(old);
+            if (verbose) {
+                report_fsbatch();
             }
+            exit(0);
         }
+    }
+    return ::exit_status;
+}
 
-        if (de->d_type == DT_DIR) {
-            // recurse
-            dirbuf += de->d_name;
-            auto it = mount_table.find(dirbuf);
-            if (it == mount_table.end()) { // not a mount point
-                int subdirfd = openat(dirfd, de->d_name, O_CLOEXEC | O_NOFOLLOW);
-                struct stat subdirst;
-                if (subdirfd >= 0
-                    && fstat(subdirfd, &subdirst) == 0
-                    && subdirst.st_dev == dev
-                    && S_ISDIR(subdirst.st_mode)) {
-                    if (x_fchown(subdirfd, u, g, dirbuf)) {
-                        exit(::exit_status);
-                    }
-                    chown_recursive(subdirfd, dirbuf, u, g, false, dev);
-                } else if (subdirfd >= 0) {
-                    close(subdirfd);
-                }
-            }
-            dirbuf.resize(dirbuflen);
-        } else {
-            if (x_lchownat(dirfd, de->d_name, u, g, dirbuf)) {
-                exit(::exit_status);
+
+// `pa-jail reap DIR...`: remove old jails from one long-lived process.
+// Peteramati renames a jail it is done with to `NAME~.TIMESTAMP`; rather than
+// one `rm --bg` process per such jail, all competing with runs for the disk,
+// the reaper removes those in the DIRs one at a time, at idle I/O priority
+// and, with `--rate N`, at most N entries per second. It learns of new ones
+// by inotify where available, and by scanning every `--interval` seconds
+// regardless. Each jail is removed by a forked child with the checks `pa-jail
+// rm` makes, so a jail the config does not allow is reported and then left
+// alone, not fatal. `--status FILE` holds the backlog, the jails waiting.
+
+// Return the `~.` jails in `dirs`, oldest name first, except those in `failed`.
+static std::vector<std::string> reap_scan(const std::vector<std::string>& dirs,
+                                          const std::unordered_set<std::string>& failed) {
+    std::vector<std::string> jails;
+    for (auto& dir : dirs) {
+        DIR* d = opendir(dir.c_str());
+        if (!d) {
+            perror_fail("%s: %s\n", dir.c_str());
+            continue;
+        }
+        while (struct dirent* de = readdir(d)) {
+            struct stat st;
+            std::string path = dir + de->d_name;
+            if (strstr(de->d_name, "~.")
+                && (de->d_type == DT_DIR
+                    || (de->d_type == DT_UNKNOWN
+                        && lstat(path.c_str(), &st) == 0
+                        && S_ISDIR(st.st_mode)))
+                && !failed.contains(path)) {
+                jails.push_back(std::move(path));
             }
         }
+        closedir(d);
     }
-
-    closedir(dir);
-    delete home_map;
+    std::sort(jails.begin(), jails.end());
+    return jails;
 }
 
-void jaildirinfo::remove() {
-    remove_recursive(parentfd, component, path_endslash(perm.dir));
+static void reap_status(int statusfd, size_t backlog,
+                        unsigned long long nremoved, size_t nfailed) {
+    if (verbose) {
+        fprintf(verbosefile, "# reap: backlog %zu, %llu removed, %zu failed\n",
+                backlog, nremoved, nfailed);
+    }
+    if (statusfd >= 0) {
+        std::string s = std::format("{{\"pid\":{},\"backlog\":{},\"removed\":{},\"failed\":{}}}\n",
+                                    (long) getpid(), backlog, nremoved, nfailed);
+        if (pwrite(statusfd, s.data(), s.length(), 0) != (ssize_t) s.length()
+            || ftruncate(statusfd, s.length()) != 0) {
+            perror_fail("%s: %s\n", "reap status");
+        }
+    }
 }
 
-void jaildirinfo::remove_recursive(int parentdirfd, std::string component,
-                                   std::string dirname) {
-    auto it = dst_table.find(dirname);
-    if (it != dst_table.end() && it->second == 3) { // unmounted file system
-        return;
+static int reap_jails(pajailconf& jailconf, const std::vector<std::string>& dirs,
+                      bool once, long interval, int statusfd) {
+    int inotifyfd = -1;
+#if __linux__
+    // IOPRIO_WHO_PROCESS, IOPRIO_CLASS_IDLE: use the disk only when no one
+    // else wants it
+    if (verbose) {
+        fprintf(verbosefile, "ionice -c 3 -p %ld\n", (long) getpid());
     }
-
-    int dirfd = openat(parentdirfd, component.c_str(), O_RDONLY);
-    struct stat dirst;
-    if (dirfd == -1 || fstat(dirfd, &dirst) != 0) {
-        perror_die(dirname);
+    if (!dryrun && syscall(SYS_ioprio_set, 1, 0, 3 << 13) != 0 && verbose) {
+        fprintf(verbosefile, "# reap: ioprio_set: %s\n", strerror(errno));
     }
-    if (dirst.st_dev != dev) { // --one-file-system
-        close(dirfd);
-        return;
+    if (!once && !dryrun) {
+        inotifyfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
     }
-
-    DIR* dir = fdopendir(dirfd);
-    if (!dir) {
-        perror_die(dirname);
+    for (auto& dir : dirs) {
+        if (inotifyfd >= 0
+            && inotify_add_watch(inotifyfd, dir.c_str(), IN_CREATE | IN_MOVED_TO | IN_ONLYDIR) == -1) {
+            close(inotifyfd);
+            inotifyfd = -1;
+        }
     }
-    while (struct dirent* de = readdir(dir)) {
-        if (de->d_type == DT_DIR) {
-            if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
-                continue;
+#endif
+    if (inotifyfd < 0 && !once && !dryrun && verbose) {
+        fprintf(verbosefile, "# reap: inotify unavailable, scanning every %lds\n", interval);
+    }
+
+    std::unordered_set<std::string> failed;
+    unsigned long long nremoved = 0;
+    while (true) {
+        std::vector<std::string> jails = reap_scan(dirs, failed);
+        for (size_t i = 0; i != jails.size(); ++i) {
+            reap_status(statusfd, jails.size() - i, nremoved, failed.size());
+            fflush(verbosefile);
+            pid_t child = fork();
+            if (child == 0) {
+                ::exit_status = 0;
+                doforce = true;
+                jaildirinfo jaildir(jails[i].c_str(), std::string(), do_rm, jailconf);
+                remove_jail(jaildir);
+                exit(::exit_status);
+            } else if (child < 0) {
+                perror_die("fork");
             }
-            std::string next_component = de->d_name;
-            std::string next_dirname = dirname + next_component;
-            remove_recursive(dirfd, next_component, dirname + next_component);
-        } else {
-            if (verbose) {
-                fprintf(verbosefile, "rm %s%s\n", dirname.c_str(), de->d_name);
+            if (x_waitpid(child, 0).second == 0) {
+                ++nremoved;
+            } else {
+                fprintf(stderr, "%s: Could not remove jail, leaving it\n", jails[i].c_str());
+                failed.insert(jails[i]);
+            }
+        }
+        reap_status(statusfd, 0, nremoved, failed.size());
+        if (once || dryrun) {
+            return failed.empty() ? 0 : 1;
+        }
+
+        // wait for a new `~.` jail, or for the next scan
+        struct timespec now, deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += interval;
+        bool wanted = false;
+        while (!wanted) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long ms = (deadline.tv_sec - now.tv_sec) * 1000
+                + (deadline.tv_nsec - now.tv_nsec) / 1000000;
+            struct pollfd p = {inotifyfd, POLLIN, 0};
+            if (ms <= 0 || poll(&p, inotifyfd >= 0, ms) == 0) {
+                break;
             }
-            if (!dryrun && unlinkat(dirfd, de->d_name, de->d_type == DT_DIR ? AT_REMOVEDIR : 0) != 0) {
-                perror_die("rm " + dirname + de->d_name);
+#if __linux__
+            alignas(struct inotify_event) char buf[4096];
+            ssize_t n;
+            while ((n = read(inotifyfd, buf, sizeof(buf))) > 0) {
+                for (char* e = buf; e < buf + n; ) {
+                    auto ev = reinterpret_cast<struct inotify_event*>(e);
+                    wanted = wanted || (ev->mask & IN_Q_OVERFLOW)
+                        || (ev->len && strstr(ev->name, "~."));
+                    e += sizeof(struct inotify_event) + ev->len;
+                }
             }
+#endif
         }
     }
-    closedir(dir);
-    close(dirfd);
-
-    if (verbose) {
-        fprintf(verbosefile, "rmdir %s\n", dirname.c_str());
-    }
-    if (!dryrun && unlinkat(parentdirfd, component.c_str(), AT_REMOVEDIR) != 0) {
-        perror_die("rmdir " + dirname);
-    }
 }
 
 
@@ -2431,6 +5042,59 @@ static void setup_userns(uid_t owner, gid_t group) {
     prctl(PR_SET_DUMPABLE, 0, 0, 0, 0);
     cap_drop_all();
 }
+
+// Return a file descriptor for a new user namespace that maps uid 0 to `owner`
+// and gid 0 to `group`, or -1 with `errno` set. A helper process creates the
+// namespace and waits while we write its maps and open it.
+static int make_idmap_userns(uid_t owner, gid_t group) {
+    int ready[2], done[2];
+    if (pipe2(ready, O_CLOEXEC) != 0) {
+        return -1;
+    } else if (pipe2(done, O_CLOEXEC) != 0) {
+        close(ready[0]);
+        close(ready[1]);
+        return -1;
+    }
+    pid_t child = fork();
+    if (child == 0) {
+        close(ready[0]);
+        close(done[1]);
+        char c = unshare(CLONE_NEWUSER) == 0 ? 0 : errno;
+        (void) !write(ready[1], &c, 1);
+        (void) !read(done[0], &c, 1);
+        _exit(0);
+    }
+    close(ready[1]);
+    close(done[0]);
+    int nsfd = -1;
+    char c = EAGAIN;
+    if (child > 0 && read(ready[0], &c, 1) == 1 && c == 0) {
+        std::string proc = "/proc/" + std::to_string(child) + "/";
+        auto write_map = [&] (const char* name, unsigned id) {
+            std::string line = std::format("0 {} 1\n", id);
+            int fd = open((proc + name).c_str(), O_WRONLY | O_CLOEXEC);
+            bool ok = fd >= 0
+                && write(fd, line.data(), line.size()) == (ssize_t) line.size();
+            if (fd >= 0) {
+                close(fd);
+            }
+            return ok;
+        };
+        if (write_map("gid_map", group) && write_map("uid_map", owner)) {
+            nsfd = open((proc + "ns/user").c_str(), O_RDONLY | O_CLOEXEC);
+        }
+    } else if (child > 0) {
+        errno = c;
+    }
+    int e = errno;
+    close(ready[0]);
+    close(done[1]);
+    if (child > 0) {
+        x_waitpid(child, 0);
+    }
+    errno = e;
+    return nsfd;
+}
 #endif
 
 
@@ -2450,6 +5114,7 @@ class jailownerinfo {
     void set_foreground(bool foreground);
     void exec(int argc, char** argv, jaildirinfo& jaildir, jaildirinfo& permjail);
     int exec_go();
+    bool open_idmapped_home(const std::string& jailhome);
 
   private:
     std::vector<const char*> newenv_;
@@ -2457,6 +5122,8 @@ class jailownerinfo {
     jaildirinfo* jaildir_ = nullptr;
     jaildirinfo* permjail_ = nullptr;
     int inputfd_ = -1;
+    int idmap_home_fd_ = -1;    // detached mount of the home, mapped
+    std::string idmap_home_;
     double timeout_ = -1.0;
     double idle_timeout_ = -1.0;
     bool foreground_= false;
@@ -2619,6 +5286,51 @@ void jailownerinfo::set_foreground(bool foreground) {
     this->foreground_ = foreground;
 }
 
+// `--idmap-home`: prepare a detached bind mount of `jailhome` on which files
+// owned by root appear owned by the user, and files the user creates are
+// owned by root on disk. `exec_go` mounts it on the jail's home directory.
+// Returns false, with `errno` set, if the kernel or file system cannot idmap
+// the home; the caller then chowns it instead, and `exec_go` mounts nothing.
+bool jailownerinfo::open_idmapped_home(const std::string& jailhome) {
+    if (verbose) {
+        fprintf(verbosefile, "# idmap-home: %s maps root to %s\n",
+                jailhome.c_str(), uid_to_name(owner_));
+    }
+    if (dryrun) {
+        idmap_home_ = jailhome;
+        return true;
+    }
+#if __linux__ && defined(SYS_open_tree) && defined(SYS_mount_setattr) && defined(MOUNT_ATTR_IDMAP)
+    int treefd = syscall(SYS_open_tree, AT_FDCWD, jailhome.c_str(),
+                         OPEN_TREE_CLONE | OPEN_TREE_CLOEXEC | AT_SYMLINK_NOFOLLOW);
+    if (treefd < 0) {
+        return false;
+    }
+    int nsfd = make_idmap_userns(owner_, group_);
+    struct mount_attr attr = {};
+    // files the user makes setuid are root's on disk
+    attr.attr_set = MOUNT_ATTR_IDMAP | MOUNT_ATTR_NOSUID | MOUNT_ATTR_NODEV;
+    attr.userns_fd = nsfd;
+    if (nsfd < 0
+        || syscall(SYS_mount_setattr, treefd, "", AT_EMPTY_PATH, &attr, sizeof(attr)) != 0) {
+        int e = errno;
+        close(treefd);
+        if (nsfd >= 0) {
+            close(nsfd);
+        }
+        errno = e;
+        return false;
+    }
+    close(nsfd);
+    idmap_home_ = jailhome;
+    idmap_home_fd_ = treefd;
+    return true;
+#else
+    errno = ENOSYS;
+    return false;
+#endif
+}
+
 void jailownerinfo::exec(int argc, char** argv, jaildirinfo& jaildir, jaildirinfo& permjail) {
     // adjust environment; make sure we have a PATH
     char homebuf[8192];
@@ -2794,6 +5506,51 @@ void jailownerinfo::exec(int argc, char** argv, jaildirinfo& jaildir, jaildirinf
     exit(exit_status);
 }
 
+#if __linux__
+// `--overlay`: in the jail's mount namespace, mount an overlay of the skeleton
+// (lower) and `.pa-overlay/upper` on `.pa-overlay/root`, bind the jail
+// directory's `home` into it, and move it onto the jail directory `jdir`.
+// Mounts and directories created in `jdir` from here on land in the overlay.
+static void mount_overlay(const std::string& jdir) {
+    std::string ovdir = jdir + ".pa-overlay/", ovroot = ovdir + "root";
+    // `path_pa_validate`d paths contain no `,` or `:`
+    std::string data = "lowerdir=" + linkdir + ",upperdir=" + ovdir + "upper,workdir="
+        + ovdir + "work";
+    if (verbose) {
+        fprintf(verbosefile, "mount -t overlay -o %s overlay %s\n",
+                data.c_str(), ovroot.c_str());
+    }
+    if (!dryrun
+        && mount("overlay", ovroot.c_str(), "overlay", 0, data.c_str()) != 0) {
+        perror_die("mount -t overlay " + ovroot);
+    }
+    struct stat st;
+    if (lstat((jdir + "home").c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        std::string ovhome = ovroot + "/home";
+        if (!dryrun && mkdir(ovhome.c_str(), 0755) != 0 && errno != EEXIST) {
+            perror_die("mkdir " + ovhome);
+        }
+        if (verbose) {
+            fprintf(verbosefile, "mount --rbind %shome %s\n", jdir.c_str(), ovhome.c_str());
+        }
+        if (!dryrun
+            && mount((jdir + "home").c_str(), ovhome.c_str(), nullptr,
+                     MS_BIND | MS_REC, nullptr) != 0) {
+            perror_die("mount --rbind " + jdir + "home");
+        }
+    }
+    if (verbose) {
+        fprintf(verbosefile, "mount --move %s %s\n", ovroot.c_str(), jdir.c_str());
+    }
+    if (!dryrun
+        && mount(ovroot.c_str(), jdir.c_str(), nullptr, MS_MOVE, nullptr) != 0) {
+        perror_die("mount --move " + ovroot);
+    }
+    // directories noted under `jdir` were in the directory now covered
+    dirtable.clear();
+}
+#endif
+
 int jailownerinfo::exec_go() {
     std::string jdir = jaildir_->perm.dir;
     assert(jdir.back() == '/');
@@ -2822,6 +5579,13 @@ int jailownerinfo::exec_go() {
         perror_die("mount --make-rslave /");
     }
 
+    if (opt_overlay) {
+        mount_overlay(jdir);
+        if (v_ensuredir(parent_mnt, 0777) < 0) {
+            perror_die("mkdir -p " + parent_mnt);
+        }
+    }
+
     populate_mount_table();     // ensure we know how to mount /proc
     for (size_t i = 0; i != delayed_mounts.size(); i += 2) {
         handle_mount(delayed_mounts[i], delayed_mounts[i+1], true);
@@ -2839,18 +5603,37 @@ int jailownerinfo::exec_go() {
     // RAM-fill vector; the jail mounts a fresh empty tmpfs, so it's bounded)
     if (const jaillimit& tsz = permjail_->perm.limits[JLIMIT_TMPFS_SIZE];
         tsz.set && !tsz.unlimited) {
-        if (auto it = mount_table.find("/tmp");
-            it != mount_table.end() && it->second.type == "tmpfs") {
-            it->second.add_mountopt(("size=" + std::to_string(tsz.value)).c_str());
+        if (mountslot* ms = find_mount("/tmp");
+            ms && ms->type == "tmpfs") {
+            ms->add_mountopt(("size=" + std::to_string(tsz.value)).c_str());
         }
     }
     handle_mount("/tmp", jdir + "tmp", true);
     handle_mount("/run", jdir + "run", true);
+    // `idmap_home_` is set only if `open_idmapped_home` succeeded; otherwise
+    // the home was chowned and needs no mount
+    if (idmap_home_fd_ >= 0 || (dryrun && !idmap_home_.empty())) {
+        std::string home = jdir + owner_home_.substr(1);
+        if (verbose) {
+            fprintf(verbosefile, "mount --bind -o nosuid,nodev,X-mount.idmap='u:0:%u:1 g:0:%u:1' %s %s\n",
+                    (unsigned) owner_, (unsigned) group_, idmap_home_.c_str(), home.c_str());
+        }
+        if (idmap_home_fd_ >= 0) {
+#if defined(SYS_move_mount)
+            if (syscall(SYS_move_mount, idmap_home_fd_, "", AT_FDCWD, home.c_str(),
+                        MOVE_MOUNT_F_EMPTY_PATH) != 0) {
+                perror_die("mount " + home);
+            }
+#endif
+            close(idmap_home_fd_);
+            idmap_home_fd_ = -1;
+        }
+    }
 #endif
 
     // chroot
 #if __linux__
-    if (unmounted_jdir == jdir) {
+    if (unmounted_jdir == jdir && !opt_overlay) {
         if (verbose) {
             fprintf(verbosefile, "mount --bind %s\n", jdir.c_str());
         }
@@ -3510,7 +6293,20 @@ static void close_unwanted_fds() {
                    JAILDIR USER COMMAND\n\
        pa-jail mv SOURCE DEST\n\
        pa-jail rm [-nf] [--bg] JAILDIR\n\
-       pa-jail init [-nV] JAILDIR\n");
+       pa-jail init [-nV] JAILDIR\n\
+       pa-jail gc [-nV] JAILDIR\n\
+       pa-jail fingerprint [-V] [--cache CACHEFILE] FILE\n\
+       pa-jail prepare [-nV] [--bg] [-f FILE | -F DATA] POOLDIR N\n\
+       pa-jail clone [-nV] SRCJAIL DSTJAIL\n\
+       pa-jail reap [-nV] [--once] [--rate N] [--status FILE] DIR...\n\
+       pa-jail recycle [-nV] [--no-rm] JAILDIR FRESHDIR\n");
+    } else if (action == do_gc) {
+        fprintf(stderr, "Usage: pa-jail gc [-nV] JAILDIR\n\
+Remove the entries of the link store that JAILDIR uses (its `linkstore` in\n\
+/etc/pa-jail.conf) that no jail links any more.\n\
+\n\
+  -n, --dry-run     Print actions that would be taken, don't run them\n\
+  -V, --verbose     Print actions as well as running them\n");
     } else if (action == do_init) {
         fprintf(stderr, "Usage: pa-jail init [-nV] JAILDIR\n\
 Prepare the cgroup pool that `pa-jail run JAILDIR` would use (the `cgroupbase`\n\
@@ -3520,6 +6316,59 @@ jails (e.g. from a systemd unit). Needs root and a cgroup v2 unified hierarchy.\
 \n\
   -n, --dry-run     Print actions that would be taken, don't run them\n\
   -V, --verbose     Print actions as well as running them\n");
+    } else if (action == do_prepare) {
+        fprintf(stderr, "Usage: pa-jail prepare [-nV] [--bg] [-f FILE | -F DATA] POOLDIR N\n\
+Keep N jails populated from the manifest in POOLDIR, ready for `pa-jail add\n\
+--pool POOLDIR` or `pa-jail run --pool POOLDIR` to claim. POOLDIR must be\n\
+allowed by /etc/pa-jail.conf.\n\
+\n\
+  -f, --manifest-file FILE  Populate jails with manifest from FILE\n\
+  -F, --manifest MANIFEST   Populate jails with MANIFEST\n\
+      --bg          Run in the background\n\
+      --jobs N      Copy files on N threads [one per CPU, max 8]\n\
+  -n, --dry-run     Print actions that would be taken, don't run them\n\
+  -V, --verbose     Print actions as well as running them\n");
+    } else if (action == do_clone) {
+        fprintf(stderr, "Usage: pa-jail clone [-nV] SRCJAIL DSTJAIL\n\
+Create DSTJAIL as a copy of the populated jail SRCJAIL, hard-linking the files\n\
+no jail user can write. Home directories and mounts are not copied. SRCJAIL\n\
+and DSTJAIL must be allowed by /etc/pa-jail.conf, and DSTJAIL must be empty.\n\
+\n\
+  -n, --dry-run     Print actions that would be taken, don't run them\n\
+  -V, --verbose     Print actions as well as running them\n");
+    } else if (action == do_reap) {
+        fprintf(stderr, "Usage: pa-jail reap [-nV] [--once] [--rate N] [--status FILE] DIR...\n\
+Remove the old jails in each DIR -- jails named `NAME~.SUFFIX`, as Peteramati\n\
+names the jails it is done with -- one at a time, at idle I/O priority. Runs\n\
+until killed, watching for more. Each jail must be allowed by\n\
+/etc/pa-jail.conf.\n\
+\n\
+      --once        Exit when no old jails remain\n\
+      --rate N      Remove at most N files and directories per second\n\
+      --interval S  Scan for old jails every S seconds [60]\n\
+      --status FILE Keep the backlog of jails to remove, as JSON, in FILE\n\
+      --jobs N      Remove files on N threads [1]\n\
+  -n, --dry-run     Print actions that would be taken, don't run them\n\
+  -V, --verbose     Print actions as well as running them\n");
+    } else if (action == do_recycle) {
+        fprintf(stderr, "Usage: pa-jail recycle [-nV] [--no-rm] JAILDIR FRESHDIR\n\
+Replace JAILDIR with the jail in FRESHDIR, atomically: JAILDIR is never\n\
+missing. The old jail is renamed to `JAILDIR~.TIMESTAMP` and removed in the\n\
+background. JAILDIR, FRESHDIR, and the new name must be allowed by\n\
+/etc/pa-jail.conf.\n\
+\n\
+      --no-rm       Leave the old jail for `pa-jail reap`\n\
+  -n, --dry-run     Print actions that would be taken, don't run them\n\
+  -V, --verbose     Print actions as well as running them\n");
+    } else if (action == do_fingerprint) {
+        fprintf(stderr, "Usage: pa-jail fingerprint [-V] [--cache CACHEFILE] FILE\n\
+Print the fingerprint of manifest FILE: a digest of the manifest and of the\n\
+identity of every file it would copy. A `[bind auto FILES]` manifest entry\n\
+uses this fingerprint as its tag.\n\
+\n\
+      --cache CACHEFILE Recompute only if FILE or the files it names changed\n\
+                        since CACHEFILE was written\n\
+  -V, --verbose     Also print how many files were checked\n");
     } else if (action == do_mv) {
         fprintf(stderr, "Usage: pa-jail mv [-n] SOURCE DEST\n\
 Safely move a jail from SOURCE to DEST. SOURCE and DEST must be allowed\n\
@@ -3534,7 +6383,10 @@ JAILDIR must be allowed by /etc/pa-jail.conf.\n\
   -f, --force       Do not complain if JAILDIR doesn't exist\n\
   -n, --dry-run     Print actions that would be taken, don't run them\n\
   -V, --verbose     Print actions as well as running them\n\
-      --bg          Run in the background\n");
+      --bg          Run in the background\n\
+      --jobs N      Remove files on N threads [one per CPU, max 8]\n\
+      --io=MODE     Remove files one by one [sync], or in io_uring\n\
+                    batches where available [uring]\n");
     } else {
         if (action == do_add) {
             fprintf(stderr, "Usage: pa-jail add [OPTIONS...] JAILDIR [USER]\n\
@@ -3549,6 +6401,17 @@ Run COMMAND as USER in the JAILDIR jail. JAILDIR must be allowed by\n\
         fprintf(stderr, "  -h, --chown-home          Change ownership of USER homedir\n");
         fprintf(stderr, "  -u, --chown-user DIR      Change ownership of DIR/** to USER\n");
         fprintf(stderr, "  -S, --skeleton SKELDIR    Populate jail from SKELDIR\n");
+        fprintf(stderr, "      --copy=MODE           Copy files natively [native], by `cp -p` [cp],\n\
+                            or by reflink where possible [reflink]\n");
+        fprintf(stderr, "      --jobs N              Copy files on N threads [one per CPU, max 8]\n");
+        fprintf(stderr, "      --io=MODE             Make file system calls one by one [sync],\n\
+                            or in io_uring batches where available [uring]\n");
+        fprintf(stderr, "      --manifest-cache FILE Skip populating if nothing changed since FILE\n");
+        fprintf(stderr, "      --pool POOLDIR        Start from a jail prepared in POOLDIR\n");
+        if (action == do_add) {
+            fprintf(stderr, "      --plan=json           Print what populating would do as JSON, and\n\
+                            change nothing\n");
+        }
         if (action == do_run) {
             fprintf(stderr, "  -B, --bind BINDDIR        Build the jail in scaffold BINDDIR\n\
   -p, --pid-file PIDFILE    Write jail process PID to PIDFILE\n\
@@ -3565,6 +6428,9 @@ Run COMMAND as USER in the JAILDIR jail. JAILDIR must be allowed by\n\
   -q, --quiet               Don't print timeout or termination notices\n\
   -l, --limit NAME=VALUE,...  Tighten resource limits (may not loosen the config)\n\
       --userns              Run in a user namespace (jail-root maps to nobody)\n\
+      --overlay             Populate only SKELDIR, and run on an overlay of it\n\
+      --idmap-home          Keep USER's home owned by root, mapped to USER in\n\
+                            the jail; chown it where that is unsupported\n\
       --fg                  Run in the foreground\n");
         }
         fprintf(stderr, "  -n, --dry-run             Print actions, don't run them\n\
@@ -3588,6 +6454,20 @@ static struct option longoptions_before[] = {
 #define ARG_BG           1004
 #define ARG_READY        1005
 #define ARG_USERNS       1006
+#define ARG_COPY         1007
+#define ARG_JOBS         1008
+#define ARG_IO           1009
+#define ARG_MANIFEST_CACHE 1010
+#define ARG_PLAN 1011
+#define ARG_OVERLAY 1012
+#define ARG_CACHE 1013
+#define ARG_POOL 1014
+#define ARG_ONCE 1015
+#define ARG_RATE 1016
+#define ARG_INTERVAL 1017
+#define ARG_STATUS 1018
+#define ARG_IDMAP_HOME 1019
+#define ARG_NO_RM 1020
 
 static struct option longoptions_run[] = {
     { "verbose", no_argument, nullptr, 'V' },
@@ -3616,6 +6496,14 @@ static struct option longoptions_run[] = {
     { "quiet", no_argument, nullptr, 'q' },
     { "limit", required_argument, nullptr, 'l' },
     { "userns", no_argument, nullptr, ARG_USERNS },
+    { "copy", required_argument, nullptr, ARG_COPY },
+    { "jobs", required_argument, nullptr, ARG_JOBS },
+    { "io", required_argument, nullptr, ARG_IO },
+    { "manifest-cache", required_argument, nullptr, ARG_MANIFEST_CACHE },
+    { "plan", required_argument, nullptr, ARG_PLAN },
+    { "overlay", no_argument, nullptr, ARG_OVERLAY },
+    { "pool", required_argument, nullptr, ARG_POOL },
+    { "idmap-home", no_argument, nullptr, ARG_IDMAP_HOME },
     { nullptr, 0, nullptr, 0 }
 };
 
@@ -3625,15 +6513,58 @@ static struct option longoptions_rm[] = {
     { "bg", no_argument, nullptr, ARG_BG },
     { "help", no_argument, nullptr, 'H' },
     { "force", no_argument, nullptr, 'f' },
+    { "io", required_argument, nullptr, ARG_IO },
+    { "jobs", required_argument, nullptr, ARG_JOBS },
+    { nullptr, 0, nullptr, 0 }
+};
+
+static struct option longoptions_fingerprint[] = {
+    { "verbose", no_argument, nullptr, 'V' },
+    { "help", no_argument, nullptr, 'H' },
+    { "cache", required_argument, nullptr, ARG_CACHE },
+    { nullptr, 0, nullptr, 0 }
+};
+
+static struct option longoptions_prepare[] = {
+    { "verbose", no_argument, nullptr, 'V' },
+    { "dry-run", no_argument, nullptr, 'n' },
+    { "help", no_argument, nullptr, 'H' },
+    { "manifest-file", required_argument, nullptr, 'f' },
+    { "manifest", required_argument, nullptr, 'F' },
+    { "bg", no_argument, nullptr, ARG_BG },
+    { "jobs", required_argument, nullptr, ARG_JOBS },
+    { nullptr, 0, nullptr, 0 }
+};
+
+static struct option longoptions_reap[] = {
+    { "verbose", no_argument, nullptr, 'V' },
+    { "dry-run", no_argument, nullptr, 'n' },
+    { "help", no_argument, nullptr, 'H' },
+    { "once", no_argument, nullptr, ARG_ONCE },
+    { "rate", required_argument, nullptr, ARG_RATE },
+    { "interval", required_argument, nullptr, ARG_INTERVAL },
+    { "status", required_argument, nullptr, ARG_STATUS },
+    { "jobs", required_argument, nullptr, ARG_JOBS },
+    { nullptr, 0, nullptr, 0 }
+};
+
+static struct option longoptions_recycle[] = {
+    { "verbose", no_argument, nullptr, 'V' },
+    { "dry-run", no_argument, nullptr, 'n' },
+    { "help", no_argument, nullptr, 'H' },
+    { "no-rm", no_argument, nullptr, ARG_NO_RM },
     { nullptr, 0, nullptr, 0 }
 };
 
 static struct option* longoptions_action[] = {
     longoptions_before, longoptions_run, longoptions_run, longoptions_rm,
-    longoptions_before, longoptions_before
+    longoptions_before, longoptions_before, longoptions_before,
+    longoptions_fingerprint, longoptions_prepare, longoptions_before,
+    longoptions_reap, longoptions_recycle
 };
 static const char* shortoptions_action[] = {
-    "+Vn", "VnB:S:f:F:p:P:T:I:qi:hu:t:l:", "VnB:S:f:F:p:P:T:I:qi:hu:t:l:", "Vnf", "Vn", "Vn"
+    "+Vn", "VnB:S:f:F:p:P:T:I:qi:hu:t:l:", "VnB:S:f:F:p:P:T:I:qi:hu:t:l:", "Vnf", "Vn", "Vn", "Vn",
+    "V", "Vnf:F:", "Vn", "Vn", "Vn"
 };
 
 static bool opt_strtod(double& v) {
@@ -3666,7 +6597,9 @@ static int jail_main(int argc, char** argv) {
     jailaction action = do_start;
     bool chown_home = false, foreground = false;
     double timeout = -1, idle_timeout = -1;
-    std::string inputarg, linkarg, manifest, bindarg;
+    std::string inputarg, linkarg, manifest, bindarg, cachearg, poolarg, statusarg;
+    bool reap_once = false, recycle_rm = true;
+    long reap_interval = 60;
     std::vector<std::string> chown_user_args;
     jaillimits limit_override;          // `--limit` command-line overrides
     pidcontents = "$$";
@@ -3748,6 +6681,61 @@ static int jail_main(int argc, char** argv) {
                 pajailconf::parse_limits(limit_override, optarg); // may throw
             } else if (ch == ARG_USERNS) {
                 opt_userns = true;
+            } else if (ch == ARG_COPY) {
+                if (strcmp(optarg, "native") == 0) {
+                    opt_copy = copy_native;
+                } else if (strcmp(optarg, "cp") == 0) {
+                    opt_copy = copy_cp;
+                } else if (strcmp(optarg, "reflink") == 0) {
+                    opt_copy = copy_reflink;
+                } else {
+                    usage(action);
+                }
+            } else if (ch == ARG_JOBS) {
+                long n;
+                if (!range_strtol(n, optarg, optarg + strlen(optarg))
+                    || n < 1 || n > 256) {
+                    usage(action);
+                }
+                opt_jobs = n;
+            } else if (ch == ARG_IO) {
+                if (strcmp(optarg, "sync") == 0) {
+                    opt_io = iomode_sync;
+                } else if (strcmp(optarg, "uring") == 0) {
+                    opt_io = iomode_uring;
+                } else {
+                    usage(action);
+                }
+            } else if (ch == ARG_MANIFEST_CACHE && action != do_rm) {
+                mcache.filename = optarg;
+            } else if (ch == ARG_PLAN && action != do_rm
+                       && strcmp(optarg, "json") == 0) {
+                opt_plan = pplan.record = dryrun = true;
+            } else if (ch == ARG_OVERLAY && action != do_rm) {
+                opt_overlay = true;
+            } else if (ch == ARG_IDMAP_HOME && action != do_rm) {
+                opt_idmap_home = true;
+            } else if (ch == ARG_CACHE) {
+                cachearg = optarg;
+            } else if (ch == ARG_POOL) {
+                poolarg = optarg;
+            } else if (ch == ARG_ONCE) {
+                reap_once = true;
+            } else if (ch == ARG_NO_RM) {
+                recycle_rm = false;
+            } else if (ch == ARG_RATE) {
+                long n;
+                if (!range_strtol(n, optarg, optarg + strlen(optarg)) || n < 1) {
+                    usage(action);
+                }
+                opt_rate = n;
+            } else if (ch == ARG_INTERVAL) {
+                if (!range_strtol(reap_interval, optarg, optarg + strlen(optarg))
+                    || reap_interval < 1 || reap_interval > 86400) {
+                    usage(action);
+                }
+            } else if (ch == ARG_STATUS) {
+                statusarg = optarg;
             } else { /* if (ch == 'H') */
                 usage(action);
             }
@@ -3764,6 +6752,19 @@ static int jail_main(int argc, char** argv) {
             action = do_mv;
         } else if (strcmp(argv[optind], "init") == 0) {
             action = do_init;
+        } else if (strcmp(argv[optind], "gc") == 0) {
+            action = do_gc;
+        } else if (strcmp(argv[optind], "fingerprint") == 0) {
+            action = do_fingerprint;
+        } else if (strcmp(argv[optind], "prepare") == 0) {
+            action = do_prepare;
+            foreground = true;
+        } else if (strcmp(argv[optind], "clone") == 0) {
+            action = do_clone;
+        } else if (strcmp(argv[optind], "reap") == 0) {
+            action = do_reap;
+        } else if (strcmp(argv[optind], "recycle") == 0) {
+            action = do_recycle;
         } else if (strcmp(argv[optind], "add") == 0) {
             action = do_add;
         } else if (strcmp(argv[optind], "run") == 0) {
@@ -3782,21 +6783,44 @@ static int jail_main(int argc, char** argv) {
     }
     bool has_runarg = !linkarg.empty() || !manifest.empty() || !inputarg.empty() || !eventsourcefilename.empty();
     if ((action == do_rm && optind + 1 != argc)
-        || (action == do_mv && optind + 2 != argc)
-        || (action == do_init && optind + 1 != argc)
+        || ((action == do_mv || action == do_clone || action == do_recycle)
+            && optind + 2 != argc)
+        || ((action == do_init || action == do_gc || action == do_fingerprint)
+            && optind + 1 != argc)
         || (action == do_add && optind != argc - 1 && optind + 2 != argc)
         || (action == do_run && optind + 3 > argc)
         || (action == do_run && foreground && (!inputarg.empty() || !eventsourcefilename.empty()))
         || (action == do_rm && has_runarg)
-        || (action == do_mv && has_runarg)
-        || (action == do_init && has_runarg)
+        || ((action == do_mv || action == do_clone || action == do_reap
+             || action == do_recycle) && has_runarg)
+        || (action == do_reap && optind == argc)
+        || ((action == do_init || action == do_gc || action == do_fingerprint)
+            && has_runarg)
         || !argv[optind][0]
-        || (action == do_mv && !argv[optind+1][0])) {
+        || ((action == do_mv || action == do_clone || action == do_recycle)
+            && !argv[optind+1][0])
+        || (opt_plan && action != do_add)
+        || (opt_overlay && (action != do_run || linkarg.empty() || !bindarg.empty()))
+        || (opt_idmap_home && action != do_run)
+        || (action == do_prepare
+            && (optind + 2 != argc || manifest.empty() || !linkarg.empty()))
+        || (!poolarg.empty()
+            && ((action != do_add && action != do_run) || opt_overlay || !bindarg.empty()))) {
         usage();
     }
-    if (verbose && !dryrun) {
+    long npool = 0;
+    if (action == do_prepare
+        && (!range_strtol(npool, argv[optind + 1], argv[optind + 1] + strlen(argv[optind + 1]))
+            || npool < 0 || npool > 1024)) {
+        usage(action);
+    }
+    // `--plan=json` owns stdout
+    if (verbose && (!dryrun || opt_plan)) {
         verbosefile = stderr;
     }
+    if (opt_io == iomode_uring && !fsb.init_uring() && verbose) {
+        fprintf(verbosefile, "# io_uring unavailable, using synchronous calls\n");
+    }
 
     // parse user
     jailownerinfo jailuser;
@@ -3816,6 +6840,20 @@ static int jail_main(int argc, char** argv) {
         }
     }
 
+    // `pa-jail fingerprint FILE` needs no privilege; it reads as the caller
+    if (action == do_fingerprint) {
+        manifest_fingerprint fp(the_elf_resolver());
+        if (!fp.compute(argv[optind], cachearg)) {
+            perror_die(argv[optind]);
+        }
+        if (verbose) {
+            fprintf(verbosefile, "# fingerprint: %zu files checked%s\n",
+                    fp.nfiles, fp.cached ? ", cached" : "");
+        }
+        printf("%s\n", fp.hex.c_str());
+        return 0;
+    }
+
     // close extra file descriptors
     if (action == do_run) {
         close_unwanted_fds();
@@ -3902,6 +6940,29 @@ static int jail_main(int argc, char** argv) {
         }
     }
 
+    // open reaper status file as current user
+    int statusfd = -1;
+    if (!statusarg.empty() && !dryrun) {
+        statusfd = open(statusarg.c_str(), O_WRONLY | O_CLOEXEC | O_CREAT | O_NOFOLLOW, 0666);
+        if (statusfd == -1) {
+            perror_die(statusarg);
+        }
+    }
+
+    // open manifest cache as current user
+    if (!mcache.filename.empty() && verbose) {
+        fprintf(verbosefile, "touch %s\n", mcache.filename.c_str());
+    }
+    if (!mcache.filename.empty() && !dryrun) {
+        mcache.fd = open(mcache.filename.c_str(), O_RDWR | O_CLOEXEC | O_CREAT | O_NOFOLLOW, 0666);
+        if (mcache.fd == -1) {
+            perror_die(mcache.filename);
+        }
+        if (flock(mcache.fd, LOCK_EX) == -1) {
+            perror_die(mcache.filename);
+        }
+    }
+
     // escalate so that the real (not just effective) UID/GID is root. this is
     // so that the system processes will execute as root
     if (!dryrun && setresgid(ROOT, ROOT, ROOT) < 0) {
@@ -3927,7 +6988,8 @@ static int jail_main(int argc, char** argv) {
     // `pa-jail init JAILDIR`: prepare the cgroup pool that `run JAILDIR` would
     // use -- the `cgroupbase` JAILDIR resolves to in the config. No jail tree is
     // built or required, so this resolves the config only (no path walk).
-    if (action == do_init) {
+    // `pa-jail gc JAILDIR` likewise resolves the `linkstore` JAILDIR uses.
+    if (action == do_init || action == do_gc) {
         std::string dir = path_pa_validate(path_absolute(argv[optind]));
         if (dir.empty() || dir == "/" || dir[0] != '/') {
             fprintf(stderr, "%s: Bad jail directory\n", argv[optind]);
@@ -3940,10 +7002,51 @@ static int jail_main(int argc, char** argv) {
             die("%s: Jail disabled in /etc/pa-jail.conf\n%s",
                 perm.dir.c_str(), perm.disable_message().c_str());
         }
+        if (action == do_gc) {
+            return linkstore_gc(perm.linkstore);
+        }
         resolve_percent_limits(perm.limits);
         return cgroup_init(jailconf, perm);
     }
 
+    // `pa-jail prepare POOLDIR N`
+    if (action == do_prepare) {
+        return prepare_pool(jailconf, argv[optind], npool, manifest, foreground);
+    }
+
+    // `pa-jail clone SRCJAIL DSTJAIL`
+    if (action == do_clone) {
+        return clone_jail(jailconf, argv[optind], argv[optind + 1]);
+    }
+
+    // `pa-jail recycle JAILDIR FRESHDIR`
+    if (action == do_recycle) {
+        return recycle_jail(jailconf, argv[optind], argv[optind + 1], recycle_rm);
+    }
+
+    // `pa-jail reap DIR...`
+    if (action == do_reap) {
+        std::vector<std::string> dirs;
+        for (int i = optind; i != argc; ++i) {
+            std::string dir = path_pa_validate(path_absolute(argv[i]));
+            struct stat st;
+            if (dir.empty() || dir[0] != '/') {
+                die("%s: Bad jail directory\n", argv[i]);
+            } else if (stat(dir.c_str(), &st) != 0) {
+                perror_die(dir);
+            } else if (!S_ISDIR(st.st_mode)) {
+                errno = ENOTDIR;
+                perror_die(dir);
+            }
+            dirs.push_back(path_endslash(dir));
+        }
+        if (opt_jobs == 0) {
+            // one removal at a time is the point
+            opt_jobs = 1;
+        }
+        return reap_jails(jailconf, dirs, reap_once, reap_interval, statusfd);
+    }
+
     jaildirinfo jaildir(argv[optind], linkarg, action, jailconf);
 
     // resolve `NN%`-of-RAM byte limits to bytes, then fold any `--limit` overrides
@@ -4006,18 +7109,20 @@ static int jail_main(int argc, char** argv) {
                 perror_die("fork");
             }
         }
-        // unmount EVERYTHING mounted in the jail!
-        // INCLUDING MY HOME DIRECTORY
-        populate_mount_table();
-        for (auto it = mount_table.begin(); it != mount_table.end(); ++it) {
-            if (it->first.starts_with(jaildir.perm.dir))
-                handle_umount(it);
+        remove_jail(jaildir);
+        if (verbose) {
+            report_fsbatch();
         }
-        // remove the jail
-        jaildir.remove();
         exit(0);
     }
 
+    // start from a prepared jail, if one is ready
+    if (!poolarg.empty()) {
+        if (claim_pool_jail(jailconf, poolarg, jaildir, manifest) && !dryrun) {
+            jaildir.reopen_root();
+        }
+    }
+
     // check skeleton directory
     if (!jaildir.perm.skeletondir.empty()) {
         if (v_ensuredir(jaildir.perm.skeletondir, 0755) < 0) {
@@ -4025,6 +7130,16 @@ static int jail_main(int argc, char** argv) {
         }
         linkdir = path_noendslash(jaildir.perm.skeletondir);
     }
+    // an overlay's lower layer is the jail's own contents
+    if (struct stat st; opt_overlay && !dryrun) {
+        if (lstat(linkdir.c_str(), &st) != 0) {
+            perror_die(linkdir);
+        } else if (!S_ISDIR(st.st_mode) || st.st_uid != ROOT
+                   || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+            die("%s: Skeleton must be a root-owned directory writable only by root\n",
+                linkdir.c_str());
+        }
+    }
 
     // create the home directory
     if (!jailuser.owner_home_.empty()) {
@@ -4052,10 +7167,48 @@ static int jail_main(int argc, char** argv) {
         }
     }
 
-    // set ownership
+    // check link store
+    if (!jaildir.perm.linkstore.empty() && !manifest.empty()) {
+        linkstore_init(jaildir.perm.linkstore, buildjail.dev,
+                       {jaildir.perm.dir, buildjail.perm.dir, linkdir});
+    }
+
+    // set ownership. With `--idmap-home`, the home directory is owned by root
+    // on disk and its idmapped mount shows it as the user's, so it is chowned
+    // only when switching between that and a chowned home. A file the user
+    // made setuid or setgid there is root's on disk: every idmapped run clears
+    // those bits and resets the home to mode 0700, undoing a `chmod` the user
+    // made through the mount.
+    std::string idmap_home;
+    uid_t home_owner = jailuser.owner_;
+    gid_t home_group = jailuser.group_;
+    if (opt_idmap_home && !jailuser.owner_home_.empty()) {
+        std::string jailhome = jaildir.perm.dir + jailuser.owner_home_.substr(1);
+        if (jailuser.open_idmapped_home(jailhome)) {
+            idmap_home = jailhome;
+            home_owner = home_group = ROOT;
+        } else if (verbose) {
+            fprintf(verbosefile, "# idmap-home: %s: %s, chowning instead\n",
+                    jailhome.c_str(), strerror(errno));
+        }
+        struct stat st;
+        if (lstat(jailhome.c_str(), &st) != 0) {
+            if (!dryrun) {
+                perror_die(jailhome);
+            }
+        } else if (!idmap_home.empty()) {
+            jaildir.chown_recursive({jailhome}, home_owner, home_group, true);
+            if ((st.st_mode & 07777) != 0700 && x_chmod(jailhome.c_str(), 0700)) {
+                exit(::exit_status);
+            }
+        } else if (st.st_uid != home_owner || st.st_gid != home_group) {
+            jaildir.chown_recursive({jailhome}, home_owner, home_group);
+        }
+    }
     if (chown_home) {
-        jaildir.chown_home();
+        jaildir.chown_home(idmap_home);
     }
+    std::vector<std::string> chown_user_paths, chown_home_paths;
     for (const auto& f : chown_user_args) {
         if (f.empty()) {
             die("--chown-user directory must not be empty\n");
@@ -4070,12 +7223,30 @@ static int jail_main(int argc, char** argv) {
             die("%s: --chown-user directory must be within %s\n",
                 f.c_str(), jaildir.perm.dir.c_str());
         }
-        jaildir.chown_recursive(xf, jailuser.owner_, jailuser.group_);
+        if (!idmap_home.empty()
+            && (xf == idmap_home || xf.starts_with(idmap_home + "/"))) {
+            chown_home_paths.push_back(std::move(xf));
+        } else {
+            chown_user_paths.push_back(std::move(xf));
+        }
+    }
+    if (!chown_user_paths.empty()) {
+        jaildir.chown_recursive(std::move(chown_user_paths),
+                                jailuser.owner_, jailuser.group_);
+    }
+    if (!chown_home_paths.empty()) {
+        jaildir.chown_recursive(std::move(chown_home_paths), ROOT, ROOT);
+    }
+
+    // `--overlay` runs write to the jail directory's `.pa-overlay/upper`
+    if (opt_overlay) {
+        jaildir.ensure_overlay();
     }
 
     // construct the jail
     mount_status = optind + 2 < argc;
     dstroot = path_noendslash(buildjail.perm.dir);
+    dstrootfd = buildjail.rootfd;
     assert(dstroot != "/");
     if (!manifest.empty()) {
         mode_t old_umask = umask(0);
@@ -4083,15 +7254,34 @@ static int jail_main(int argc, char** argv) {
             exit(1);
         }
         umask(old_umask);
+        dst_dirs.clear();
+        src_dirs.clear();
+        if (opt_plan) {
+            pplan.print_json(stdout);
+        } else if (verbose) {
+            pplan.report();
+            pstats.report();
+            report_fsbatch();
+        }
     }
 
-    // close `parentfd`
+    // close `parentfd` and `rootfd`
     close(jaildir.parentfd);
     jaildir.parentfd = -1;
+    if (jaildir.rootfd >= 0) {
+        close(jaildir.rootfd);
+        jaildir.rootfd = -1;
+    }
     if (bindjail) {
         close(bindjail->parentfd);
         bindjail->parentfd = -1;
+        if (bindjail->rootfd >= 0) {
+            close(bindjail->rootfd);
+            bindjail->rootfd = -1;
+        }
     }
+    dstrootfd = -1;
+    dst_dirs.set_root(std::string());
 
     // maybe execute a command in the jail
     if (optind + 2 < argc) {
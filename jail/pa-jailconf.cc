@@ -4,6 +4,8 @@
 
 #include "pa-jailconf.hh"
 #include "pa-jutil.hh"
+#include <cctype>
+#include <cstdlib>
 #include <cstring>
 #include <cerrno>
 #include <format>
@@ -415,6 +417,47 @@ void pajailconf::parse(jailperm& perm) const {
             continue;
         }
 
+        // the link store this jail's files may share, scoped like `cgroupbase`;
+        // `linkstore none` turns it off
+        if (action == "linkstore") {
+            if (parser.args.size() != 2
+                || (parser.args[1] != "none" && !parser.args[1].starts_with('/'))) {
+                throw parser.error("Expected `linkstore /PATH` or `linkstore none`");
+            }
+            if (parser.args[1] == "none") {
+                perm.linkstore = std::string();
+            } else {
+                perm.linkstore = std::string(parser.args[1]);
+            }
+            continue;
+        }
+
+        // the file caching home directory owners, scoped like `linkstore`:
+        // `pwcache /PATH [SECONDS]` or `pwcache none`
+        if (action == "pwcache") {
+            size_t nargs = parser.args.size();
+            bool ok = (nargs == 2 || nargs == 3)
+                && (parser.args[1] == "none" ? nargs == 2 : parser.args[1].starts_with('/'));
+            unsigned long ttl = default_pwcache_ttl;
+            if (ok && nargs == 3) {
+                std::string s(parser.args[2]);
+                char* end;
+                ttl = strtoul(s.c_str(), &end, 10);
+                ok = isdigit((unsigned char) s[0]) && *end == '\0'
+                    && ttl > 0 && ttl <= 7 * 86400;
+            }
+            if (!ok) {
+                throw parser.error("Expected `pwcache /PATH [SECONDS]` or `pwcache none`");
+            }
+            if (parser.args[1] == "none") {
+                perm.pwcache = std::string();
+            } else {
+                perm.pwcache = std::string(parser.args[1]);
+            }
+            perm.pwcache_ttl = ttl;
+            continue;
+        }
+
         // resolve a directory pattern argument the way enable/disable do: an
         // absolute pattern is taken as-is; a relative one is section-relative
         // (and meaningless outside a section). Returns "" to mean "no match".
@@ -159,6 +159,9 @@ struct jaillimits {
 // expanded only at apply time.
 inline constexpr char default_cgroupbase[] = "/sys/fs/cgroup/pa-jail";
 
+// How long a `pwcache` remembers an owner, in seconds, unless it says.
+inline constexpr unsigned default_pwcache_ttl = 600;
+
 // A `pajailconf` query and its result. (`dir`, `skeletondir`) are the inputs --
 // the jail directory and an optional skeleton; the other fields are filled in
 // by `parse()`. `enabled`/`skeleton_enabled` say whether each is permitted; for
@@ -166,13 +169,20 @@ inline constexpr char default_cgroupbase[] = "/sys/fs/cgroup/pa-jail";
 // among the matching `enablejail` globs, below which pa-jail may create
 // components), `limits` the resolved resource limits, and `cgroupbase` the pool
 // it joins (default `default_cgroupbase`, overridable by a `cgroupbase`
-// directive). If `!enabled`, `disabled_lineno` is the 1-based line of the
-// responsible `disablejail` (0 if none -- e.g. never enabled), used to explain it.
+// directive), `linkstore` the content store its files may hard-link into
+// (empty for none, set by a `linkstore` directive), and `pwcache` the file
+// caching its home directories' owners for `pwcache_ttl` seconds (empty for
+// none, set by a `pwcache` directive). If `!enabled`,
+// `disabled_lineno` is the 1-based line of the responsible `disablejail` (0 if
+// none -- e.g. never enabled), used to explain it.
 struct jailperm {
     std::string dir;
     std::string skeletondir;
     std::string permdir;
     std::string cgroupbase = default_cgroupbase;
+    std::string linkstore;
+    std::string pwcache;
+    unsigned pwcache_ttl = default_pwcache_ttl;
     bool enabled = false;
     bool skeleton_enabled = false;
     int disabled_lineno = 0;
@@ -0,0 +1,327 @@
+// pa-jbatch.cc -- Peteramati batched file system calls for pa-jail
+// Peteramati is Copyright (c) 2013-2026 Eddie Kohler and others
+// See LICENSE for open-source distribution terms
+
+#include "pa-jbatch.hh"
+#include "pa-jutil.hh"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#if __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <linux/io_uring.h>
+#endif
+
+// io_uring statx/unlinkat arrived in Linux 5.6-5.11, mkdirat/symlinkat/linkat
+// in 5.15; `IORING_SETUP_SUBMIT_ALL` (5.18) marks headers that know them all.
+#if __linux__ && defined(IORING_SETUP_SUBMIT_ALL) && defined(__NR_io_uring_setup)
+#define PA_HAVE_URING 1
+#else
+#define PA_HAVE_URING 0
+#endif
+
+fsbatch::~fsbatch() {
+#if PA_HAVE_URING
+    if (ringfd_ >= 0) {
+        munmap(sqes_, sqes_size_);
+        if (cq_ring_ != sq_ring_) {
+            munmap(cq_ring_, cq_ring_size_);
+        }
+        munmap(sq_ring_, sq_ring_size_);
+        close(ringfd_);
+    }
+#endif
+}
+
+bool fsbatch::init_uring(unsigned entries) {
+#if PA_HAVE_URING
+    if (ringfd_ >= 0) {
+        return true;
+    }
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0) {
+        return false;
+    }
+
+    // every operation must be supported
+    size_t probesz = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    std::vector<unsigned char> probebuf(probesz, 0);
+    auto probe = reinterpret_cast<struct io_uring_probe*>(probebuf.data());
+    bool ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (int opcode : {IORING_OP_STATX, IORING_OP_MKDIRAT, IORING_OP_SYMLINKAT,
+                       IORING_OP_LINKAT, IORING_OP_UNLINKAT}) {
+        ok = ok && opcode <= probe->last_op
+            && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED);
+    }
+    if (!ok) {
+        close(fd);
+        return false;
+    }
+
+    sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    cq_ring_ = sq_ring_;
+    if (!single) {
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    }
+    sqes_size_ = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (cq_ring_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+        if (sqes_ != MAP_FAILED) {
+            munmap(sqes_, sqes_size_);
+        }
+        if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+            munmap(cq_ring_, cq_ring_size_);
+        }
+        munmap(sq_ring_, sq_ring_size_);
+        close(fd);
+        return false;
+    }
+
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_ = cq + p.cq_off.cqes;
+    sq_entries_ = p.sq_entries;
+    cq_entries_ = p.cq_entries;
+    ringfd_ = fd;
+    return true;
+#else
+    (void) entries;
+    return false;
+#endif
+}
+
+
+fsbatch::op& fsbatch::push(optype type, int* result) {
+    ops_.emplace_back();
+    op& o = ops_.back();
+    o.type = type;
+    o.chained = chain_next_;
+    o.result = result;
+    chain_next_ = false;
+    return o;
+}
+
+void fsbatch::lstat(int dirfd, std::string path, struct stat* st, int* result) {
+    op& o = push(op_lstat, result);
+    o.dirfd = dirfd;
+    o.path = std::move(path);
+    o.st = st;
+}
+
+void fsbatch::mkdirat(int dirfd, std::string path, mode_t mode, int* result) {
+    op& o = push(op_mkdirat, result);
+    o.dirfd = dirfd;
+    o.path = std::move(path);
+    o.flags = mode;
+}
+
+void fsbatch::symlinkat(std::string target, int dirfd, std::string path, int* result) {
+    op& o = push(op_symlinkat, result);
+    o.dirfd = dirfd;
+    o.path = std::move(path);
+    o.path2 = std::move(target);
+}
+
+void fsbatch::linkat(int olddirfd, std::string oldpath, int newdirfd,
+                     std::string newpath, int* result) {
+    op& o = push(op_linkat, result);
+    o.dirfd = olddirfd;
+    o.path = std::move(oldpath);
+    o.dirfd2 = newdirfd;
+    o.path2 = std::move(newpath);
+    o.flags = 0;
+}
+
+void fsbatch::unlinkat(int dirfd, std::string path, int flags, int* result) {
+    op& o = push(op_unlinkat, result);
+    o.dirfd = dirfd;
+    o.path = std::move(path);
+    o.flags = flags;
+}
+
+void fsbatch::then() {
+    if (!ops_.empty()) {
+        chain_next_ = true;
+    }
+}
+
+
+void fsbatch::run_sync(op& o) {
+    int r = -1;
+    switch (o.type) {
+    case op_lstat:
+        r = fstatat(o.dirfd, o.path.c_str(), o.st, AT_SYMLINK_NOFOLLOW);
+        break;
+    case op_mkdirat:
+        r = ::mkdirat(o.dirfd, o.path.c_str(), o.flags);
+        break;
+    case op_symlinkat:
+        r = ::symlinkat(o.path2.c_str(), o.dirfd, o.path.c_str());
+        break;
+    case op_linkat:
+        r = ::linkat(o.dirfd, o.path.c_str(), o.dirfd2, o.path2.c_str(), o.flags);
+        break;
+    case op_unlinkat:
+        r = ::unlinkat(o.dirfd, o.path.c_str(), o.flags);
+        break;
+    }
+    *o.result = r < 0 ? -errno : r;
+    ++nsyscalls;
+}
+
+void fsbatch::submit() {
+    nops += ops_.size();
+    if (ringfd_ >= 0) {
+        submit_uring();
+    } else {
+        for (auto& o : ops_) {
+            run_sync(o);
+        }
+    }
+    ops_.clear();
+    chain_next_ = false;
+}
+
+#if PA_HAVE_URING
+static void statx_to_stat(const struct statx& sx, struct stat* st) {
+    memset(st, 0, sizeof(*st));
+    st->st_dev = makedev(sx.stx_dev_major, sx.stx_dev_minor);
+    st->st_ino = sx.stx_ino;
+    st->st_mode = sx.stx_mode;
+    st->st_nlink = sx.stx_nlink;
+    st->st_uid = sx.stx_uid;
+    st->st_gid = sx.stx_gid;
+    st->st_rdev = makedev(sx.stx_rdev_major, sx.stx_rdev_minor);
+    st->st_size = sx.stx_size;
+    st->st_blksize = sx.stx_blksize;
+    st->st_blocks = sx.stx_blocks;
+    st->st_atim.tv_sec = sx.stx_atime.tv_sec;
+    st->st_atim.tv_nsec = sx.stx_atime.tv_nsec;
+    st->st_mtim.tv_sec = sx.stx_mtime.tv_sec;
+    st->st_mtim.tv_nsec = sx.stx_mtime.tv_nsec;
+    st->st_ctim.tv_sec = sx.stx_ctime.tv_sec;
+    st->st_ctim.tv_nsec = sx.stx_ctime.tv_nsec;
+}
+#endif
+
+void fsbatch::submit_uring() {
+#if PA_HAVE_URING
+    auto sqes = static_cast<struct io_uring_sqe*>(sqes_);
+    auto cqes = static_cast<struct io_uring_cqe*>(cqes_);
+    unsigned limit = std::min(sq_entries_, cq_entries_);
+    std::vector<struct statx> sxbuf(std::min<size_t>(limit, ops_.size()));
+
+    size_t base = 0;
+    while (base != ops_.size()) {
+        // take as many ops as fit, never splitting a chain
+        size_t end = base;
+        while (end != ops_.size()) {
+            size_t cend = end + 1;
+            while (cend != ops_.size() && ops_[cend].chained) {
+                ++cend;
+            }
+            assert(cend - end <= limit);    // chains are shorter than the ring
+            if (cend - base > limit) {
+                break;
+            }
+            end = cend;
+        }
+        unsigned n = end - base;
+
+        unsigned tail = *sq_tail_;
+        for (unsigned i = 0; i != n; ++i) {
+            op& o = ops_[base + i];
+            unsigned idx = tail & *sq_mask_;
+            struct io_uring_sqe* sqe = &sqes[idx];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->user_data = i;
+            sqe->fd = o.dirfd;
+            sqe->addr = reinterpret_cast<uintptr_t>(o.path.c_str());
+            switch (o.type) {
+            case op_lstat:
+                sqe->opcode = IORING_OP_STATX;
+                sqe->len = STATX_BASIC_STATS;
+                sqe->off = reinterpret_cast<uintptr_t>(&sxbuf[i]);
+                sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+                break;
+            case op_mkdirat:
+                sqe->opcode = IORING_OP_MKDIRAT;
+                sqe->len = o.flags;
+                break;
+            case op_symlinkat:
+                sqe->opcode = IORING_OP_SYMLINKAT;
+                sqe->addr = reinterpret_cast<uintptr_t>(o.path2.c_str());
+                sqe->addr2 = reinterpret_cast<uintptr_t>(o.path.c_str());
+                break;
+            case op_linkat:
+                sqe->opcode = IORING_OP_LINKAT;
+                sqe->len = o.dirfd2;
+                sqe->addr2 = reinterpret_cast<uintptr_t>(o.path2.c_str());
+                sqe->hardlink_flags = o.flags;
+                break;
+            case op_unlinkat:
+                sqe->opcode = IORING_OP_UNLINKAT;
+                sqe->unlink_flags = o.flags;
+                break;
+            }
+            if (i + 1 != n && ops_[base + i + 1].chained) {
+                sqe->flags |= IOSQE_IO_HARDLINK;
+            }
+            sq_array_[idx] = idx;
+            ++tail;
+        }
+        __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+
+        unsigned unsubmitted = n, incomplete = n;
+        while (incomplete != 0) {
+            int r = syscall(__NR_io_uring_enter, ringfd_, unsubmitted, incomplete,
+                            IORING_ENTER_GETEVENTS, nullptr, 0);
+            ++nsyscalls;
+            if (r < 0 && errno != EINTR) {
+                perror_die("io_uring_enter");
+            } else if (r > 0) {
+                unsubmitted -= r;
+            }
+            unsigned head = *cq_head_;
+            unsigned ctail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+            for (; head != ctail; ++head, --incomplete) {
+                const struct io_uring_cqe& cqe = cqes[head & *cq_mask_];
+                op& o = ops_[base + cqe.user_data];
+                *o.result = cqe.res;
+                if (o.type == op_lstat && cqe.res == 0) {
+                    statx_to_stat(sxbuf[cqe.user_data], o.st);
+                }
+            }
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        }
+        base = end;
+    }
+#endif
+}
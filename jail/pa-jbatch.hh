@@ -0,0 +1,92 @@
+// pa-jbatch.hh -- Peteramati batched file system calls for pa-jail
+// Peteramati is Copyright (c) 2013-2026 Eddie Kohler and others
+// See LICENSE for open-source distribution terms
+
+#pragma once
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+// A batch of file system calls, run together by `submit`. With an io_uring
+// (`init_uring` succeeded) the batch goes to the kernel in as few
+// `io_uring_enter` calls as the ring allows; otherwise each call runs
+// synchronously, in order. Either way, every queued call's result is stored
+// in its `int* result`: the system call's return value, or `-errno`.
+//
+// Calls in one batch may run in any order and concurrently, unless chained by
+// `then()`: a chained call starts after the previous call completes, whether
+// or not it succeeded. Path arguments are copied; `struct stat` buffers and
+// `result` slots must stay valid until `submit` returns.
+class fsbatch {
+  public:
+    fsbatch() = default;
+    fsbatch(const fsbatch&) = delete;
+    fsbatch& operator=(const fsbatch&) = delete;
+    ~fsbatch();
+
+    // Try to set up an io_uring. Returns false, leaving the batch synchronous,
+    // if the kernel lacks io_uring or any of the operations used here.
+    bool init_uring(unsigned entries = 256);
+    bool uring() const {
+        return ringfd_ >= 0;
+    }
+
+    // `fstatat(dirfd, path, st, AT_SYMLINK_NOFOLLOW)`, by `statx`.
+    void lstat(int dirfd, std::string path, struct stat* st, int* result);
+    void mkdirat(int dirfd, std::string path, mode_t mode, int* result);
+    void symlinkat(std::string target, int dirfd, std::string path, int* result);
+    void linkat(int olddirfd, std::string oldpath, int newdirfd,
+                std::string newpath, int* result);
+    void unlinkat(int dirfd, std::string path, int flags, int* result);
+
+    // Make the next queued call wait for the last one.
+    void then();
+
+    size_t size() const {
+        return ops_.size();
+    }
+    // Run every queued call and empty the batch.
+    void submit();
+
+    // Counters: calls run, and system calls made to run them.
+    unsigned long long nops = 0;
+    unsigned long long nsyscalls = 0;
+
+  private:
+    enum optype { op_lstat, op_mkdirat, op_symlinkat, op_linkat, op_unlinkat };
+    struct op {
+        optype type;
+        bool chained = false;   // runs after the previous op
+        int dirfd;
+        int dirfd2;
+        int flags;
+        std::string path;
+        std::string path2;
+        struct stat* st;
+        int* result;
+    };
+    std::vector<op> ops_;
+    bool chain_next_ = false;
+
+    int ringfd_ = -1;
+    unsigned sq_entries_ = 0;
+    unsigned cq_entries_ = 0;
+    void* sq_ring_ = nullptr;
+    void* cq_ring_ = nullptr;
+    void* sqes_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    size_t sqes_size_ = 0;
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned* sq_mask_;
+    unsigned* sq_array_;
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned* cq_mask_;
+    void* cqes_;
+
+    op& push(optype type, int* result);
+    void run_sync(op& o);
+    void submit_uring();
+};
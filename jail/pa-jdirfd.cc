@@ -0,0 +1,328 @@
+// pa-jdirfd.cc -- Peteramati directory file descriptor cache for pa-jail
+// Peteramati is Copyright (c) 2013-2026 Eddie Kohler and others
+// See LICENSE for open-source distribution terms
+
+#include "pa-jdirfd.hh"
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#if __linux__
+#include <sys/syscall.h>
+#if __has_include(<linux/openat2.h>)
+#include <linux/openat2.h>
+#endif
+#endif
+
+// Descriptors are used only as `*at()` anchors, so on Linux they need not be
+// readable: `O_PATH` opens directories the caller may only search.
+#ifdef O_PATH
+static constexpr int dir_flags = O_PATH | O_DIRECTORY | O_CLOEXEC;
+#else
+static constexpr int dir_flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+#endif
+
+// Symbolic links followed in one rooted walk before giving up with `ELOOP`,
+// as the kernel does.
+static constexpr int max_symlink_hops = 40;
+
+dirfd_cache::dirfd_cache(size_t capacity)
+    : capacity_(capacity) {
+    assert(capacity_ > 0);
+}
+
+dirfd_cache::~dirfd_cache() {
+    clear();
+    if (root_fd_ >= 0) {
+        close(root_fd_);
+    }
+}
+
+void dirfd_cache::set_root(std::string root, int rootfd) {
+    while (root.length() > 1 && root.back() == '/') {
+        root.pop_back();
+    }
+    assert(root.empty() || (root[0] == '/' && root != "/"));
+    if (root != root_ || (rootfd >= 0 && root_fd_ < 0)) {
+        clear();
+        root_ = std::move(root);
+        if (root_fd_ >= 0) {
+            close(root_fd_);
+        }
+        root_fd_ = rootfd >= 0 ? fcntl(rootfd, F_DUPFD_CLOEXEC, 0) : -1;
+    }
+}
+
+void dirfd_cache::release() {
+    for (int fd : retired_) {
+        close(fd);
+    }
+    retired_.clear();
+}
+
+void dirfd_cache::clear() {
+    map_.clear();
+    for (auto& e : lru_) {
+        close(e.second);
+    }
+    lru_.clear();
+    release();
+}
+
+int dirfd_cache::find(std::string_view path) {
+    auto it = map_.find(path);
+    if (it == map_.end()) {
+        return -1;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return it->second->second;
+}
+
+int dirfd_cache::insert(std::string path, int fd) {
+    lru_.emplace_front(std::move(path), fd);
+    map_.emplace(lru_.front().first, lru_.begin());
+    if (lru_.size() > capacity_) {
+        auto& victim = lru_.back();
+        retired_.push_back(victim.second);
+        map_.erase(victim.first);
+        lru_.pop_back();
+    }
+    return fd;
+}
+
+// Resolve `path`, which is under `root_`, one component at a time from the
+// nearest cached directory. Each component is opened `O_NOFOLLOW`; a symbolic
+// link is read and spliced into the path, relative to `root_` if absolute.
+// Every directory opened is cached under its symlink-free path.
+int dirfd_cache::walk(std::string path) {
+    int hops = 0;
+    while (true) {
+        size_t len = path.length();
+        int fd;
+        while ((fd = find(std::string_view(path).substr(0, len))) < 0) {
+            if (len == root_.length()) {
+                fd = root_fd_ >= 0 ? openat(root_fd_, ".", dir_flags)
+                    : open(root_.c_str(), dir_flags);
+                if (fd < 0) {
+                    return -1;
+                }
+                ++nopens;
+                insert(root_, fd);
+                break;
+            }
+            len = path.rfind('/', len - 1);
+        }
+
+        std::string prefix = path.substr(0, len);
+        size_t pos = len;
+        bool respliced = false;
+        while (!respliced && pos != path.length()) {
+            size_t end = path.find('/', pos + 1);
+            if (end == std::string::npos) {
+                end = path.length();
+            }
+            std::string comp = path.substr(pos + 1, end - pos - 1);
+            if (comp.empty() || comp == ".") {
+                pos = end;
+                continue;
+            } else if (comp == "..") {
+                if (prefix.length() > root_.length()) {
+                    prefix.resize(prefix.rfind('/'));
+                }
+                path = prefix + path.substr(end);
+                respliced = true;
+                continue;
+            }
+
+            int nfd = openat(fd, comp.c_str(), dir_flags | O_NOFOLLOW);
+            if (nfd < 0) {
+                if (errno != ENOTDIR && errno != ELOOP) {
+                    return -1;
+                }
+                char lnk[4096];
+                ssize_t n = readlinkat(fd, comp.c_str(), lnk, sizeof(lnk));
+                if (n < 0) {
+                    errno = ENOTDIR;
+                    return -1;
+                } else if (n == sizeof(lnk)) {
+                    errno = ENAMETOOLONG;
+                    return -1;
+                } else if (++hops > max_symlink_hops) {
+                    errno = ELOOP;
+                    return -1;
+                }
+                std::string_view target(lnk, n);
+                if (target.empty()) {
+                    errno = ENOENT;
+                    return -1;
+                }
+                std::string rest = path.substr(end);
+                path = target[0] == '/' ? root_ : prefix + "/";
+                path.append(target);
+                path.append(rest);
+                respliced = true;
+                continue;
+            }
+            ++nopens;
+            prefix.push_back('/');
+            prefix.append(comp);
+            fd = insert(prefix, nfd);
+            pos = end;
+        }
+        if (!respliced) {
+            return fd;
+        }
+    }
+}
+
+int dirfd_cache::dir(std::string_view path) {
+    ++nlookups;
+    if (int fd = find(path); fd >= 0) {
+        return fd;
+    }
+    if (!root_.empty()
+        && path.starts_with(root_)
+        && (path.length() == root_.length() || path[root_.length()] == '/')) {
+        return walk(std::string(path));
+    }
+
+    // outside the root: let the kernel resolve the rest of `path` from its
+    // nearest cached ancestor
+    size_t len = path.rfind('/');
+    int fd = -1;
+    while (len != 0 && len != std::string_view::npos
+           && (fd = find(path.substr(0, len))) < 0) {
+        len = path.rfind('/', len - 1);
+    }
+    if (fd >= 0) {
+        fd = openat(fd, std::string(path.substr(len + 1)).c_str(), dir_flags);
+    } else {
+        fd = open(std::string(path).c_str(), dir_flags);
+    }
+    if (fd < 0) {
+        return -1;
+    }
+    ++nopens;
+    return insert(std::string(path), fd);
+}
+
+int dirfd_cache::parent(const std::string& path, std::string& name) {
+    size_t slash = path.rfind('/');
+    if (slash == std::string::npos
+        || slash + 1 == path.length()
+        || (!root_.empty()
+            && (slash < root_.length() || !path.starts_with(root_)
+                || path[root_.length()] != '/'))) {
+        name = path;
+        return AT_FDCWD;
+    }
+    name = path.substr(slash + 1);
+    return dir(slash == 0 ? std::string_view("/") : std::string_view(path).substr(0, slash));
+}
+
+int dirfd_cache::lstat(const std::string& path, struct stat* st) {
+    std::string name;
+    int fd = parent(path, name);
+    if (fd == -1) {
+        return -1;
+    }
+    return fstatat(fd, name.c_str(), st, AT_SYMLINK_NOFOLLOW);
+}
+
+
+// `struct linux_dirent64`, which glibc does not declare before 2.30.
+#if __linux__
+struct dirent64_header {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+dir_reader::dir_reader(size_t bufsize)
+    : buf_(new char[bufsize]), bufsize_(bufsize) {
+    assert(bufsize_ >= 4096);
+}
+
+dir_reader::~dir_reader() {
+    delete[] buf_;
+}
+
+void dir_reader::open(int dirfd) {
+    fd_ = dirfd;
+    pos_ = len_ = 0;
+}
+
+const char* dir_reader::next(unsigned char* type) {
+    while (true) {
+        if (pos_ == len_) {
+            ssize_t n = syscall(SYS_getdents64, fd_, buf_, bufsize_);
+            ++nreads;
+            if (n <= 0) {
+                errno = n == 0 ? 0 : errno;
+                return nullptr;
+            }
+            pos_ = 0;
+            len_ = n;
+        }
+        auto de = reinterpret_cast<dirent64_header*>(buf_ + pos_);
+        pos_ += de->d_reclen;
+        if (de->d_name[0] != '.'
+            || (de->d_name[1] != 0
+                && (de->d_name[1] != '.' || de->d_name[2] != 0))) {
+            *type = de->d_type;
+            return de->d_name;
+        }
+    }
+}
+#else
+dir_reader::dir_reader(size_t) {
+}
+
+dir_reader::~dir_reader() {
+    if (dir_) {
+        closedir(dir_);
+    }
+}
+
+void dir_reader::open(int dirfd) {
+    if (dir_) {
+        closedir(dir_);
+    }
+    fd_ = dirfd;
+    dir_ = fdopendir(dup(dirfd));
+}
+
+const char* dir_reader::next(unsigned char* type) {
+    if (!dir_) {
+        return nullptr;
+    }
+    while (true) {
+        errno = 0;
+        struct dirent* de = readdir(dir_);
+        ++nreads;
+        if (!de) {
+            return nullptr;
+        } else if (strcmp(de->d_name, ".") != 0 && strcmp(de->d_name, "..") != 0) {
+            *type = de->d_type;
+            return de->d_name;
+        }
+    }
+}
+#endif
+
+int openat_beneath(int dirfd, const char* path, int flags) {
+#if __linux__ && defined(SYS_openat2) && defined(RESOLVE_BENEATH)
+    struct open_how how = {};
+    how.flags = flags;
+    how.resolve = RESOLVE_BENEATH | RESOLVE_NO_SYMLINKS;
+    return syscall(SYS_openat2, dirfd, path, &how, sizeof(how));
+#else
+    (void) dirfd, (void) path, (void) flags;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
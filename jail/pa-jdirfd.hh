@@ -0,0 +1,121 @@
+// pa-jdirfd.hh -- Peteramati directory file descriptor cache for pa-jail
+// Peteramati is Copyright (c) 2013-2026 Eddie Kohler and others
+// See LICENSE for open-source distribution terms
+
+#pragma once
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// A least-recently-used cache of open directory file descriptors, keyed by
+// absolute path, so that `*at()` calls on many files in few directories
+// resolve each directory once rather than once per file.
+//
+// A cache with a root (`set_root`) resolves paths under that root one
+// component at a time, never following a symbolic link out of the tree: a
+// symbolic link met on the way is expanded as if the root were `/`, so that
+// an absolute link in a jail means the jail's file, not the host's. Paths
+// outside the root, and all paths in a cache without one, are resolved by the
+// kernel in the usual way (for a cache without a root, from the nearest cached
+// ancestor). Only directories that exist are cached.
+//
+// Descriptors evicted from the cache stay open until `release()`, so a
+// descriptor returned by `parent` may be queued in a batch (`fsbatch`) and
+// used until the batch is submitted. A cache is not thread-safe; threads use
+// a cache each.
+class dirfd_cache {
+  public:
+    explicit dirfd_cache(size_t capacity = 64);
+    dirfd_cache(const dirfd_cache&) = delete;
+    dirfd_cache& operator=(const dirfd_cache&) = delete;
+    ~dirfd_cache();
+
+    // Resolve paths under `root` within it (see above). Changing the root
+    // closes every cached descriptor. An empty `root` means no root. If
+    // `rootfd` is not -1, it is a descriptor for the directory `root`, maybe
+    // `O_PATH`, which the cache uses (a duplicate of) instead of opening
+    // `root` by name.
+    void set_root(std::string root, int rootfd = -1);
+    const std::string& root() const {
+        return root_;
+    }
+    int root_fd() const {
+        return root_fd_;
+    }
+
+    // Return a descriptor for the directory `path` (absolute, no trailing
+    // slash), or -1 with `errno` set.
+    int dir(std::string_view path);
+    // Return a descriptor for the directory containing `path` and set `name`
+    // to the last component of `path`, or return -1 with `errno` set. The
+    // result may be `AT_FDCWD`, with `name` the whole path, for a path
+    // outside the root.
+    int parent(const std::string& path, std::string& name);
+    // `lstat(path, st)`, relative to `path`'s parent descriptor.
+    int lstat(const std::string& path, struct stat* st);
+
+    // Close the descriptors evicted since the last call.
+    void release();
+    // Close every descriptor.
+    void clear();
+
+    // Counters: directory lookups, and directories opened to serve them.
+    unsigned long long nlookups = 0;
+    unsigned long long nopens = 0;
+
+  private:
+    using lru_list = std::list<std::pair<std::string, int>>;
+    lru_list lru_;              // most recently used first
+    std::unordered_map<std::string_view, lru_list::iterator> map_;
+    std::vector<int> retired_;
+    size_t capacity_;
+    std::string root_;
+    int root_fd_ = -1;
+
+    int find(std::string_view path);
+    int insert(std::string path, int fd);
+    int walk(std::string path);
+};
+
+// Reads the entries of open directories in large batches: `getdents64` into a
+// reusable buffer on Linux, `readdir` elsewhere. `.` and `..` are skipped. A
+// reader is not thread-safe; threads use a reader each.
+class dir_reader {
+  public:
+    explicit dir_reader(size_t bufsize = 65536);
+    dir_reader(const dir_reader&) = delete;
+    dir_reader& operator=(const dir_reader&) = delete;
+    ~dir_reader();
+
+    // Start reading `dirfd`, a descriptor for a directory opened for reading
+    // and not yet read. The reader does not close it.
+    void open(int dirfd);
+    // Return the next entry's name, and set `*type` to its `DT_` type, which
+    // may be `DT_UNKNOWN`. The name is valid until the next call. At the end
+    // return nullptr with `errno` 0; on error, nullptr with `errno` set.
+    const char* next(unsigned char* type);
+
+    // Counter: system calls made to read entries.
+    unsigned long long nreads = 0;
+
+  private:
+    int fd_ = -1;
+#if __linux__
+    char* buf_;
+    size_t bufsize_;
+    size_t pos_ = 0;
+    size_t len_ = 0;
+#else
+    DIR* dir_ = nullptr;
+#endif
+};
+
+// `openat(dirfd, path, flags)`, resolving `path` beneath `dirfd` without
+// following a symbolic link or `..` out of it: `openat2` with
+// `RESOLVE_BENEATH | RESOLVE_NO_SYMLINKS`. Where `openat2` is unavailable
+// (before Linux 5.6, and off Linux), returns -1 with `errno` `ENOSYS`.
+int openat_beneath(int dirfd, const char* path, int flags);
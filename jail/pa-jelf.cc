@@ -0,0 +1,330 @@
+// pa-jelf.cc -- Peteramati ELF dependency resolver for pa-jail
+// Peteramati is Copyright (c) 2013-2026 Eddie Kohler and others
+// See LICENSE for open-source distribution terms
+
+#include "pa-jelf.hh"
+#include "pa-jutil.hh"
+#include <cctype>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <glob.h>
+#include <unistd.h>
+#if __linux__
+#include <elf.h>
+#endif
+
+static bool pread_all(int fd, void* buf, size_t n, off_t off) {
+    return pread(fd, buf, n, off) == (ssize_t) n;
+}
+
+static void split_path_list(std::string_view s, std::vector<std::string>& out) {
+    while (!s.empty()) {
+        size_t colon = s.find(':');
+        if (colon != 0) {
+            out.emplace_back(s.substr(0, colon));
+        }
+        s.remove_prefix(colon == std::string_view::npos ? s.length() : colon + 1);
+    }
+}
+
+#if __linux__
+// Objects larger than this in any table we read are not believed.
+static constexpr size_t elf_table_max = 16 << 20;
+
+template <typename Ehdr, typename Phdr, typename Dyn>
+static bool elf_read_class(int fd, elf_info& ei) {
+    Ehdr eh;
+    if (!pread_all(fd, &eh, sizeof(eh), 0)
+        || eh.e_phentsize != sizeof(Phdr)
+        || eh.e_phnum == 0
+        || eh.e_phnum > 4096) {
+        return false;
+    }
+    std::vector<Phdr> ph(eh.e_phnum);
+    if (!pread_all(fd, ph.data(), ph.size() * sizeof(Phdr), eh.e_phoff)) {
+        return false;
+    }
+    ei.machine = eh.e_machine;
+
+    std::vector<Dyn> dyn;
+    for (auto& p : ph) {
+        if (p.p_type == PT_INTERP && p.p_filesz > 1 && p.p_filesz < 4096) {
+            ei.interp.resize(p.p_filesz);
+            if (!pread_all(fd, ei.interp.data(), p.p_filesz, p.p_offset)) {
+                return false;
+            }
+            ei.interp.resize(strnlen(ei.interp.data(), p.p_filesz));
+        } else if (p.p_type == PT_DYNAMIC && p.p_filesz < elf_table_max) {
+            dyn.resize(p.p_filesz / sizeof(Dyn));
+            if (!pread_all(fd, dyn.data(), dyn.size() * sizeof(Dyn), p.p_offset)) {
+                return false;
+            }
+        }
+    }
+
+    // the dynamic section names its string table by address; find the
+    // loaded segment that holds it
+    unsigned long long strtab = 0, strsz = 0;
+    for (auto& d : dyn) {
+        if (d.d_tag == DT_STRTAB) {
+            strtab = d.d_un.d_ptr;
+        } else if (d.d_tag == DT_STRSZ) {
+            strsz = d.d_un.d_val;
+        }
+    }
+    if (dyn.empty() || strsz == 0 || strsz > elf_table_max) {
+        return true;
+    }
+    std::string strings;
+    for (auto& p : ph) {
+        if (p.p_type == PT_LOAD
+            && strtab >= p.p_vaddr
+            && strtab - p.p_vaddr + strsz <= p.p_filesz) {
+            strings.resize(strsz);
+            if (!pread_all(fd, strings.data(), strsz, strtab - p.p_vaddr + p.p_offset)) {
+                return false;
+            }
+            break;
+        }
+    }
+    auto str = [&] (unsigned long long off) {
+        if (off >= strings.length()) {
+            return std::string_view();
+        }
+        return std::string_view(strings.data() + off,
+                                strnlen(strings.data() + off, strings.length() - off));
+    };
+    for (auto& d : dyn) {
+        if (d.d_tag == DT_NULL) {
+            break;
+        } else if (d.d_tag == DT_NEEDED) {
+            if (auto s = str(d.d_un.d_val); !s.empty()) {
+                ei.needed.emplace_back(s);
+            }
+        } else if (d.d_tag == DT_RUNPATH) {
+            split_path_list(str(d.d_un.d_val), ei.runpath);
+        } else if (d.d_tag == DT_RPATH) {
+            split_path_list(str(d.d_un.d_val), ei.rpath);
+        }
+    }
+    return true;
+}
+#endif
+
+bool elf_read(int fd, elf_info& ei) {
+#if __linux__
+    unsigned char ident[EI_NIDENT];
+    if (!pread_all(fd, ident, sizeof(ident), 0)
+        || memcmp(ident, ELFMAG, SELFMAG) != 0) {
+        return false;
+    }
+    // objects of the other byte order cannot be loaded here
+    static const unsigned one = 1;
+    int data = *reinterpret_cast<const unsigned char*>(&one) ? ELFDATA2LSB : ELFDATA2MSB;
+    if (ident[EI_DATA] != data) {
+        return false;
+    }
+    ei.elfclass = ident[EI_CLASS];
+    if (ei.elfclass == ELFCLASS64) {
+        return elf_read_class<Elf64_Ehdr, Elf64_Phdr, Elf64_Dyn>(fd, ei);
+    } else if (ei.elfclass == ELFCLASS32) {
+        return elf_read_class<Elf32_Ehdr, Elf32_Phdr, Elf32_Dyn>(fd, ei);
+    }
+#else
+    (void) fd, (void) ei;
+#endif
+    return false;
+}
+
+
+// Append the directories named by the `ld.so.conf`-format file `fname` to
+// `dirs`, following `include` lines.
+static void read_ld_so_conf(const std::string& fname, std::vector<std::string>& dirs,
+                            int depth = 0) {
+    std::string text = file_get_contents(fname, 0);
+    size_t pos = 0;
+    while (pos < text.length() && depth < 8) {
+        size_t eol = text.find('\n', pos);
+        if (eol == std::string::npos) {
+            eol = text.length();
+        }
+        std::string_view line(text.data() + pos, eol - pos);
+        pos = eol + 1;
+        line = line.substr(0, line.find('#'));
+        while (!line.empty() && isspace((unsigned char) line.front())) {
+            line.remove_prefix(1);
+        }
+        while (!line.empty() && isspace((unsigned char) line.back())) {
+            line.remove_suffix(1);
+        }
+        if (line.starts_with("include") && line.length() > 7
+            && isspace((unsigned char) line[7])) {
+            std::string pattern(line.substr(8));
+            while (!pattern.empty() && isspace((unsigned char) pattern.front())) {
+                pattern.erase(0, 1);
+            }
+            if (!pattern.empty() && pattern[0] != '/') {
+                pattern = path_parentdir(fname) + pattern;
+            }
+            glob_t g;
+            if (glob(pattern.c_str(), 0, nullptr, &g) == 0) {
+                for (size_t i = 0; i != g.gl_pathc; ++i) {
+                    read_ld_so_conf(g.gl_pathv[i], dirs, depth + 1);
+                }
+            }
+            globfree(&g);
+        } else if (line.starts_with("/")) {
+            // a line may list several directories
+            while (!line.empty()) {
+                size_t end = line.find_first_of(" \t,:");
+                if (end != 0) {
+                    dirs.emplace_back(line.substr(0, end));
+                }
+                line.remove_prefix(end == std::string_view::npos ? line.length() : end + 1);
+            }
+        }
+    }
+}
+
+elf_resolver::elf_resolver() {
+    read_ld_so_conf("/etc/ld.so.conf", search_dirs_);
+    for (const char* d : {"/lib64", "/usr/lib64", "/lib", "/usr/lib"}) {
+        search_dirs_.emplace_back(d);
+    }
+}
+
+// Return the index in `deps_` of the object at `path`, reading it if it is
+// not cached, or -1 if it cannot be opened.
+ssize_t elf_resolver::lookup(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    struct stat st;
+    if (fd < 0) {
+        return -1;
+    } else if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+#if __APPLE__
+    key k{st.st_dev, st.st_ino, st.st_mtimespec.tv_sec, st.st_mtimespec.tv_nsec};
+#else
+    key k{st.st_dev, st.st_ino, st.st_mtim.tv_sec, st.st_mtim.tv_nsec};
+#endif
+    if (const size_t* idx = cache_.find(k)) {
+        close(fd);
+        ++ncached;
+        return *idx;
+    }
+
+    ++nread;
+    elf_info ei;
+    deps d;
+    char buf[256];
+    ssize_t n;
+    if (elf_read(fd, ei)) {
+        d.elfclass = ei.elfclass;
+        d.machine = ei.machine;
+    } else if ((n = pread(fd, buf, sizeof(buf) - 1, 0)) > 2
+               && buf[0] == '#' && buf[1] == '!') {
+        // a script needs its interpreter
+        buf[n] = '\0';
+        char* s = buf + 2;
+        while (*s == ' ' || *s == '\t') {
+            ++s;
+        }
+        size_t len = strcspn(s, " \t\r\n");
+        if (s[0] == '/' && s[len] != '\0') {
+            d.paths.emplace_back(s, len);
+        }
+    }
+    close(fd);
+
+    // cache before resolving, since libraries may depend on each other
+    ssize_t idx = deps_.size();
+    deps_.push_back(d);
+    cache_.insert(k, idx);
+
+    std::string origin = path_noendslash(path_parentdir(path));
+    if (!ei.interp.empty()) {
+        d.paths.push_back(ei.interp);
+    }
+    for (auto& name : ei.needed) {
+        std::string lib = name.find('/') != std::string::npos
+            ? name : find_library(name, ei, origin);
+        if (!lib.empty()) {
+            d.paths.push_back(std::move(lib));
+        } else {
+            d.missing.push_back(name);
+        }
+    }
+    deps_[idx] = std::move(d);
+    return idx;
+}
+
+std::string elf_resolver::find_library(const std::string& name, const elf_info& ei,
+                                       const std::string& origin) {
+    auto try_dirs = [&] (const std::vector<std::string>& dirs) {
+        for (const auto& dir : dirs) {
+            std::string d = dir;
+            for (const char* o : {"${ORIGIN}", "$ORIGIN"}) {
+                for (size_t p; (p = d.find(o)) != std::string::npos; ) {
+                    d.replace(p, strlen(o), origin);
+                }
+            }
+            if (d.empty() || d[0] != '/') {
+                continue;
+            }
+            std::string cand = path_endslash(d) + name;
+            ssize_t idx = lookup(cand);
+            if (idx >= 0
+                && deps_[idx].elfclass == ei.elfclass
+                && deps_[idx].machine == ei.machine) {
+                return cand;
+            }
+        }
+        return std::string();
+    };
+    std::string lib;
+    if (ei.runpath.empty()) {
+        lib = try_dirs(ei.rpath);
+    }
+    if (lib.empty()) {
+        lib = try_dirs(ei.runpath);
+    }
+    if (lib.empty()) {
+        lib = try_dirs(search_dirs_);
+    }
+    return lib;
+}
+
+bool elf_resolver::closure(const std::string& path, std::vector<std::string>& out,
+                           std::vector<std::string>& missing) {
+    ssize_t idx = lookup(path);
+    if (idx < 0) {
+        return false;
+    }
+    path_table<int> seen;
+    seen.insert(path, 1);
+    std::deque<size_t> queue{size_t(idx)};
+    while (!queue.empty()) {
+        // copy: `lookup` may grow `deps_`
+        deps d = deps_[queue.front()];
+        queue.pop_front();
+        for (auto& m : d.missing) {
+            if (seen.insert("?" + m, 1).second) {
+                missing.push_back(m);
+            }
+        }
+        for (auto& p : d.paths) {
+            if (seen.insert(p, 1).second) {
+                out.push_back(p);
+                if ((idx = lookup(p)) >= 0) {
+                    queue.push_back(idx);
+                } else {
+                    missing.push_back(p);
+                }
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,90 @@
+// pa-jelf.hh -- Peteramati ELF dependency resolver for pa-jail
+// Peteramati is Copyright (c) 2013-2026 Eddie Kohler and others
+// See LICENSE for open-source distribution terms
+
+#pragma once
+#include "pa-jpath.hh"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// What the dynamic linker needs to load an executable or shared library.
+struct elf_info {
+    int elfclass = 0;           // `ELFCLASS32` or `ELFCLASS64`
+    int machine = 0;            // `e_machine`
+    std::string interp;         // `PT_INTERP`, for executables
+    std::vector<std::string> needed;    // `DT_NEEDED`
+    std::vector<std::string> runpath;   // `DT_RUNPATH`, split at `:`
+    std::vector<std::string> rpath;     // `DT_RPATH`, split at `:`
+};
+
+// Read the ELF headers and dynamic section of the file open on `fd`. Returns
+// false if the file is not an ELF object this host could load.
+bool elf_read(int fd, elf_info& ei);
+
+
+// The `[libs]` manifest option: find the shared libraries a binary needs,
+// transitively, as the dynamic linker would. A script's `#!` interpreter
+// counts as a dependency, with its own libraries.
+//
+// Libraries are searched for in the object's `DT_RPATH` (unless it has a
+// `DT_RUNPATH`), its `DT_RUNPATH`, the directories named by `/etc/ld.so.conf`,
+// and the system directories -- never in `LD_LIBRARY_PATH`, which belongs to
+// pa-jail's caller. `$ORIGIN` expands to the object's directory. A candidate
+// of the wrong ELF class or machine is skipped, as the linker skips it.
+//
+// Each object's direct dependencies are cached by device, inode, and
+// modification time, so a library many binaries share is read once.
+class elf_resolver {
+  public:
+    elf_resolver();
+
+    // Append to `out` the host paths `path` needs, each once, in the order
+    // found: its interpreter and libraries and theirs. A dependency that
+    // cannot be found is appended to `missing`. Returns false if `path` cannot
+    // be opened.
+    bool closure(const std::string& path, std::vector<std::string>& out,
+                 std::vector<std::string>& missing);
+
+    // Replace the system search directories (for tests).
+    void set_search_dirs(std::vector<std::string> dirs) {
+        search_dirs_ = std::move(dirs);
+    }
+    const std::vector<std::string>& search_dirs() const {
+        return search_dirs_;
+    }
+
+    // Counters: objects read, and lookups answered from the cache.
+    unsigned long long nread = 0;
+    unsigned long long ncached = 0;
+
+  private:
+    struct key {
+        dev_t dev;
+        ino_t ino;
+        long long mtime_sec;
+        long mtime_nsec;
+        bool operator==(const key&) const = default;
+    };
+    struct key_hash {
+        size_t operator()(const key& k) const {
+            return std::hash<unsigned long long>()(k.ino * 0x100000001B3ULL ^ k.dev
+                                                   ^ k.mtime_sec ^ k.mtime_nsec);
+        }
+    };
+    struct deps {
+        int elfclass = 0;
+        int machine = 0;
+        std::vector<std::string> paths;     // resolved direct dependencies
+        std::vector<std::string> missing;
+    };
+    flat_table<key, size_t, key_hash> cache_;   // index into `deps_`
+    std::vector<deps> deps_;
+    std::vector<std::string> search_dirs_;
+
+    ssize_t lookup(const std::string& path);
+    std::string find_library(const std::string& name, const elf_info& ei,
+                             const std::string& origin);
+};
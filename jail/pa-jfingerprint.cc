@@ -0,0 +1,224 @@
+// pa-jfingerprint.cc -- Peteramati manifest fingerprints for pa-jail
+// Peteramati is Copyright (c) 2013-2026 Eddie Kohler and others
+// See LICENSE for open-source distribution terms
+
+#include "pa-jfingerprint.hh"
+#include "pa-jmanifest.hh"
+#include "pa-jutil.hh"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+static constexpr std::string_view fingerprint_magic = "pa-jail fingerprint 1\n";
+
+// Return the identity of `path` (see `manifest_fingerprint`), or `-` if it
+// cannot be `stat`ed. Sets `*mode` to its file type and mode, or 0.
+static std::string file_identity(const std::string& path, bool follow,
+                                 mode_t* mode = nullptr) {
+    struct stat st;
+    if ((follow ? stat(path.c_str(), &st) : lstat(path.c_str(), &st)) != 0) {
+        if (mode) {
+            *mode = 0;
+        }
+        return "-";
+    }
+    if (mode) {
+        *mode = st.st_mode;
+    }
+    char buf[256];
+    if (S_ISDIR(st.st_mode)) {
+        snprintf(buf, sizeof(buf), "d %o %u %u",
+                 (unsigned) st.st_mode, (unsigned) st.st_uid, (unsigned) st.st_gid);
+    } else {
+#if __APPLE__
+        const struct timespec& mtim = st.st_mtimespec, & ctim = st.st_ctimespec;
+#else
+        const struct timespec& mtim = st.st_mtim, & ctim = st.st_ctim;
+#endif
+        snprintf(buf, sizeof(buf), "%o %u %u %llx %llx %llu %lld.%09ld %lld.%09ld",
+                 (unsigned) st.st_mode, (unsigned) st.st_uid, (unsigned) st.st_gid,
+                 (unsigned long long) st.st_dev, (unsigned long long) st.st_ino,
+                 (unsigned long long) st.st_size,
+                 (long long) mtim.tv_sec, (long) mtim.tv_nsec,
+                 (long long) ctim.tv_sec, (long) ctim.tv_nsec);
+    }
+    return buf;
+}
+
+static bool read_file(const std::string& filename, std::string& text) {
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    text.clear();
+    char buf[8192];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) != 0) {
+        if (n > 0) {
+            text.append(buf, n);
+        } else if (errno != EINTR) {
+            int e = errno;
+            close(fd);
+            errno = e;
+            return false;
+        }
+    }
+    close(fd);
+    return true;
+}
+
+bool manifest_fingerprint::compute(const std::string& filename,
+                                   const std::string& cachefile) {
+    hex.clear();
+    cached = false;
+    nfiles = 0;
+    records_.clear();
+
+    std::string fileid = file_identity(filename, true);
+    ++nfiles;
+    if (!cachefile.empty() && fileid != "-"
+        && load(cachefile, filename, fileid)) {
+        cached = true;
+        return true;
+    }
+
+    std::string text;
+    if (!read_file(filename, text)) {
+        return false;
+    }
+    manifest m;
+    m.parse(text);
+
+    // each file once, followed by the directories above it
+    path_table<int> seen;
+    auto add = [&] (std::string path) {
+        while (path.length() > 1 && seen.insert(path, 1).second) {
+            mode_t mode;
+            records_.push_back({'l', path, file_identity(path, false, &mode)});
+            if (S_ISLNK(mode)) {
+                records_.push_back({'s', path, file_identity(path, true)});
+            }
+            path = path_noendslash(path_parentdir(path));
+        }
+    };
+    std::vector<std::string> libs, missing;
+    for (auto& me : m.entries) {
+        if (!me.is_copy()) {
+            continue;
+        }
+        std::string src(path_noendslash(me.src));
+        add(src);
+        if (me.flags & FLAG_LIBS) {
+            libs.clear();
+            missing.clear();
+            elfres_.closure(src, libs, missing);
+            for (auto& lib : libs) {
+                add(lib);
+            }
+            for (auto& name : missing) {
+                records_.push_back({'m', name, "-"});
+            }
+        }
+    }
+    nfiles += records_.size();
+
+    sha256 h;
+    h.update(fingerprint_magic);
+    h.update(std::to_string(text.length()) + "\n");
+    h.update(text);
+    for (auto& r : records_) {
+        h.update(&r.kind, 1);
+        h.update(r.path.c_str(), r.path.length() + 1);
+        h.update(r.id);
+        h.update("\n");
+    }
+    hex = sha256_hex(h);
+
+    if (!cachefile.empty() && fileid != "-") {
+        save(cachefile, filename, fileid);
+    }
+    return true;
+}
+
+// The cache file: the magic line; the fingerprint; the manifest file's
+// identity, a tab, and its name; then, for each record, its kind and
+// identity, a tab, and its path.
+bool manifest_fingerprint::load(const std::string& cachefile,
+                                const std::string& filename,
+                                const std::string& fileid) {
+    std::string text;
+    if (!read_file(cachefile, text) || !text.starts_with(fingerprint_magic)) {
+        return false;
+    }
+    std::string_view s(text);
+    s.remove_prefix(fingerprint_magic.length());
+    auto next_line = [&] () {
+        size_t nl = s.find('\n');
+        std::string_view line = s.substr(0, nl);
+        s.remove_prefix(nl == std::string_view::npos ? s.length() : nl + 1);
+        return line;
+    };
+
+    std::string_view digest = next_line();
+    if (digest.length() != 64
+        || next_line() != fileid + "\t" + filename) {
+        return false;
+    }
+    std::string path;
+    while (!s.empty()) {
+        std::string_view line = next_line();
+        size_t tab = line.find('\t');
+        if (tab == std::string_view::npos || tab == 0
+            || (line[0] != 'l' && line[0] != 's')) {
+            // a missing library might have appeared
+            return false;
+        }
+        path.assign(line.substr(tab + 1));
+        ++nfiles;
+        if (file_identity(path, line[0] == 's') != line.substr(1, tab - 1)) {
+            return false;
+        }
+    }
+    hex.assign(digest);
+    return true;
+}
+
+void manifest_fingerprint::save(const std::string& cachefile,
+                                const std::string& filename,
+                                const std::string& fileid) {
+    std::string text(fingerprint_magic);
+    text.append(hex).append("\n").append(fileid).append("\t").append(filename).append("\n");
+    for (auto& r : records_) {
+        if (r.path.find('\n') != std::string::npos) {
+            return;
+        }
+        text.push_back(r.kind);
+        text.append(r.id).append("\t").append(r.path).append("\n");
+    }
+    if (filename.find('\n') != std::string::npos) {
+        return;
+    }
+    // write a new file and rename it over the old, so concurrent runs never
+    // read a partial cache. The new file must not exist already: a name
+    // planted there (a hard link, say) is never written through.
+    static std::atomic<unsigned> tmpcounter;
+    std::string tmp;
+    int fd = -1;
+    for (int tries = 0; fd == -1 && tries != 8; ++tries) {
+        tmp = cachefile + "." + std::to_string(getpid())
+            + "." + std::to_string(tmpcounter++) + ".tmp";
+        fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+        if (fd == -1 && errno != EEXIST) {
+            return;
+        }
+    }
+    if (fd == -1) {
+        return;
+    }
+    bool ok = write(fd, text.data(), text.length()) == (ssize_t) text.length();
+    if (close(fd) != 0 || !ok || rename(tmp.c_str(), cachefile.c_str()) != 0) {
+        unlink(tmp.c_str());
+    }
+}
@@ -0,0 +1,51 @@
+// pa-jfingerprint.hh -- Peteramati manifest fingerprints for pa-jail
+// Peteramati is Copyright (c) 2013-2026 Eddie Kohler and others
+// See LICENSE for open-source distribution terms
+
+#pragma once
+#include "pa-jelf.hh"
+#include <string>
+#include <vector>
+
+// The fingerprint of a manifest file: a SHA-256 digest of the manifest's
+// bytes and of the identity of every file populating from it would copy --
+// each source, the directories above it, a symbolic link's final target, and
+// a `[libs]` entry's libraries. A file's identity is its `lstat` mode, owner,
+// device, inode, size, and modification and change times; a directory's is
+// its mode and owner only, so a new sibling does not change it. `pa-jail
+// fingerprint` prints it, and `[bind auto FILES]` uses it as the tag.
+//
+// With a cache file, the manifest is parsed and hashed only if something
+// changed: the cache records the manifest file's identity and every identity
+// that went into the digest, and if `stat`ing them again finds them all
+// unchanged, the recorded digest stands.
+class manifest_fingerprint {
+  public:
+    explicit manifest_fingerprint(elf_resolver& elfres)
+        : elfres_(elfres) {
+    }
+
+    // Fingerprint the manifest in `filename`, reading and updating `cachefile`
+    // if it is nonempty. Returns false, with `errno` set, if `filename` cannot
+    // be read. A cache file that cannot be read or written is ignored.
+    bool compute(const std::string& filename,
+                 const std::string& cachefile = std::string());
+
+    std::string hex;            // the fingerprint, 64 hexadecimal digits
+    bool cached = false;        // `hex` came from the cache file
+    size_t nfiles = 0;          // identities checked
+
+  private:
+    struct record {
+        char kind;              // 'l' `lstat`, 's' `stat`, 'm' missing library
+        std::string path;
+        std::string id;
+    };
+    elf_resolver& elfres_;
+    std::vector<record> records_;
+
+    bool load(const std::string& cachefile, const std::string& filename,
+              const std::string& fileid);
+    void save(const std::string& cachefile, const std::string& filename,
+              const std::string& fileid);
+};
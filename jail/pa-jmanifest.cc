@@ -0,0 +1,177 @@
+// pa-jmanifest.cc -- Peteramati jail manifest parser for pa-jail
+// Peteramati is Copyright (c) 2013-2026 Eddie Kohler and others
+// See LICENSE for open-source distribution terms
+
+#include "pa-jmanifest.hh"
+#include <cctype>
+#include <string>
+
+static inline bool is_space(char c) {
+    return isspace((unsigned char) c);
+}
+
+// Option text is scanned only up to the `]` that ends its line.
+static inline const char* opt_wordskip(const char* s) {
+    while (*s != ']' && *s != ';' && !is_space(*s)) {
+        ++s;
+    }
+    return s;
+}
+
+static inline const char* opt_spaceskip(const char* s) {
+    while (is_space(*s)) {
+        ++s;
+    }
+    return s;
+}
+
+static inline bool opt_eq(const char* opt, const char* endopt,
+                          std::string_view def) {
+    return std::string_view(opt, endopt - opt) == def;
+}
+
+std::string_view manifest::join(std::string_view dir, std::string_view name) {
+    buf_.assign(dir).append(name);
+    return arena_.intern(buf_);
+}
+
+manifest_entry& manifest::add(std::string_view src, std::string_view dst) {
+    manifest_entry& me = entries.emplace_back();
+    me.src = arena_.intern(src);
+    me.dst = src == dst ? me.src : arena_.intern(dst);
+    return me;
+}
+
+void manifest::parse(std::string_view text) {
+    // `DIR:` names both the source directory and the destination subdirectory
+    std::string_view curdir("/");
+
+    const char* pos = text.data(), *endpos = pos + text.length();
+    while (pos < endpos) {
+        while (pos < endpos && is_space(*pos)) {
+            ++pos;
+        }
+        const char* line = pos;
+        while (pos < endpos && *pos != '\n') {
+            ++pos;
+        }
+        const char* endline = pos;
+        while (line < endline && is_space(endline[-1])) {
+            --endline;
+        }
+        if (line == endline || line[0] == '#') {
+            continue;
+        }
+
+        // 'directory:'
+        if (endline[-1] == ':') {
+            std::string& dir = buf_;
+            dir.clear();
+            if (line + 2 == endline && line[0] == '.') {
+                dir = "/";
+            } else {
+                if (line[0] != '/') {
+                    dir.push_back('/');
+                }
+                dir.append(line, endline - 1);
+            }
+            while (dir.length() > 1 && dir.ends_with("//")) {
+                dir.pop_back();
+            }
+            if (dir.back() != '/') {
+                dir.push_back('/');
+            }
+            curdir = dir == "/" ? std::string_view("/") : arena_.intern(dir);
+            continue;
+        }
+
+        manifest_entry me;
+
+        // '[FLAGS]'
+        if (endline[-1] == ']') {
+            // skip ' [FLAGS]'
+            for (--endline; line < endline && endline[-1] != '['; --endline) {
+                // do nothing
+            }
+            if (line == endline) {
+                continue;
+            }
+            const char* opts = endline;
+            do {
+                --endline;
+            } while (line < endline && is_space(endline[-1]));
+            // parse flags
+            while (true) {
+                while (is_space(*opts) || *opts == ';') {
+                    ++opts;
+                }
+                if (*opts == ']') {
+                    break;
+                }
+                // read first option word
+                const char* optstart = opts;
+                opts = opt_wordskip(opts + 1);
+                // process option
+                int want = 0;
+                if (opt_eq(optstart, opts, "cp")) {
+                    me.flags |= FLAG_CP;
+                } else if (opt_eq(optstart, opts, "libs")) {
+                    me.flags |= FLAG_LIBS;
+                } else if (opt_eq(optstart, opts, "bind")) {
+                    me.flags |= FLAG_BIND;
+                    want = FLAG_BIND;
+                } else if (opt_eq(optstart, opts, "bind-ro")) {
+                    me.flags |= FLAG_BIND_RO;
+                    want = FLAG_BIND;
+                } else if (opt_eq(optstart, opts, "mount")) {
+                    me.flags |= FLAG_MOUNT;
+                    want = FLAG_MOUNT;
+                }
+                if (want == FLAG_BIND) {
+                    const char* tag = opt_spaceskip(opts);
+                    opts = opt_wordskip(tag);
+                    me.bind_tag = std::string_view(tag, opts - tag);
+                    const char* files = opt_spaceskip(opts);
+                    opts = opt_wordskip(files);
+                    me.bind_files = std::string_view(files, opts - files);
+                } else if (want == FLAG_MOUNT) {
+                    const char* type = opt_spaceskip(opts);
+                    opts = opt_wordskip(type);
+                    me.mount_dst = std::string_view(type, opts - type);
+                    const char* args = opts = opt_spaceskip(opts);
+                    while (*opts != ']' && *opts != ';') {
+                        ++opts;
+                    }
+                    me.mount_args = std::string_view(args, opts - args);
+                }
+                // skip to next option word
+                while (*opts != ']' && *opts != ';') {
+                    ++opts;
+                }
+            }
+            // a bind entry ignores `[mount]`
+            if (me.flags & (FLAG_BIND | FLAG_BIND_RO)) {
+                me.mount_dst = me.mount_args = std::string_view();
+            }
+        }
+
+        // 'DST <- SRC', 'ABSPATH', or 'RELPATH'
+        std::string_view l(line, endline - line);
+        bool absolute = !l.empty() && l[0] == '/';
+        size_t arrow = l.find(" <- ");
+        if (absolute && curdir.length() == 1) {
+            // zero-copy: the destination is the line's own text
+            me.dst = l.substr(0, arrow);
+        } else {
+            me.dst = join(curdir, l.substr(absolute, arrow - absolute));
+        }
+        if (arrow != std::string_view::npos) {
+            me.src = l.substr(arrow + 4);
+        } else if (absolute) {
+            me.src = l;
+        } else {
+            me.src = me.dst;
+        }
+        entries.push_back(me);
+    }
+}
@@ -0,0 +1,69 @@
+// pa-jmanifest.hh -- Peteramati jail manifest parser for pa-jail
+// Peteramati is Copyright (c) 2013-2026 Eddie Kohler and others
+// See LICENSE for open-source distribution terms
+
+#pragma once
+#include "pa-jpath.hh"
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define FLAG_CP       1        // copy even if source is symlink
+#define FLAG_BIND     2
+#define FLAG_BIND_RO  4
+#define FLAG_MOUNT    8
+#define FLAG_LIBS     16       // also copy the shared libraries it needs
+
+// One manifest line, parsed. Every view points into the manifest text or into
+// the owning `manifest`'s arena.
+struct manifest_entry {
+    std::string_view src;
+    std::string_view dst;       // relative to the jail root; starts with `/`
+    int flags = 0;
+    std::string_view bind_tag;  // `[bind TAG FILES]`
+    std::string_view bind_files;
+    std::string_view mount_dst; // `[mount TYPE ARGS]`
+    std::string_view mount_args;
+
+    bool is_copy() const {
+        return !(flags & (FLAG_BIND | FLAG_BIND_RO | FLAG_MOUNT));
+    }
+};
+
+// A parsed manifest: one entry per line that names a file, in order.
+//
+// A manifest is a list of paths, one per line. Blank lines and lines starting
+// with `#` are ignored. `DIR:` makes later relative paths relative to `DIR`
+// (initially `/`); an absolute path is relative to `/`, whatever `DIR` is,
+// but its destination stays under `DIR`. `DST <- SRC` copies `SRC` to `DST`.
+// A line may end with options in brackets, separated by `;`: `[cp]` copies a
+// symbolic link's target rather than the link; `[libs]` also copies the shared
+// libraries an executable needs (see `elf_resolver`); `[bind TAG FILES]` and
+// `[bind-ro TAG FILES]` bind-mount the source (read-only), first rebuilding it
+// from manifest `FILES` unless its `.pa-jail-bindtag` file says `TAG` (`auto`
+// means the fingerprint of `FILES`; see `manifest_fingerprint`); and
+// `[mount TYPE ARGS]` mounts a file system.
+//
+// Parsing never fails: a line it cannot make sense of names whatever its text
+// says, as the original inline parser did. Entries point into the text, which
+// must outlive them; paths the parser has to build (a relative path joined to
+// its `DIR:`) live in the manifest's arena.
+class manifest {
+  public:
+    manifest() = default;
+    manifest(const manifest&) = delete;
+    manifest& operator=(const manifest&) = delete;
+
+    // Parse `text`, appending its entries.
+    void parse(std::string_view text);
+    // Append an entry copying `src` to `dst`.
+    manifest_entry& add(std::string_view src, std::string_view dst);
+
+    std::vector<manifest_entry> entries;
+
+  private:
+    path_arena arena_;
+    std::string buf_;
+
+    std::string_view join(std::string_view dir, std::string_view name);
+};
@@ -0,0 +1,411 @@
+// pa-jmountinfo.cc -- Peteramati mount table index for pa-jail
+// Peteramati is Copyright (c) 2013-2026 Eddie Kohler and others
+// See LICENSE for open-source distribution terms
+
+#include "pa-jmountinfo.hh"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if __linux__
+#include <sys/syscall.h>
+#elif __APPLE__
+#include <sys/param.h>
+#include <sys/ucred.h>
+#include <sys/mount.h>
+#endif
+
+// `listmount` and `statmount`, which the C library may not declare. The
+// system call numbers are shared by every architecture that uses the generic
+// table, which includes x86-64 and 64-bit ARM.
+#if __linux__ && !defined(SYS_statmount) \
+    && (defined(__x86_64__) || defined(__aarch64__) || defined(__riscv))
+#define SYS_statmount 457
+#define SYS_listmount 458
+#endif
+
+#if __linux__ && defined(SYS_statmount)
+struct mnt_id_req_v0 {
+    uint32_t size;
+    uint32_t spare;
+    uint64_t mnt_id;
+    uint64_t param;
+};
+
+// `struct statmount`, through the fields we read
+struct statmount_header {
+    uint32_t size;
+    uint32_t mnt_opts;          // [str] superblock options (6.10)
+    uint64_t mask;
+    uint32_t sb_dev_major;
+    uint32_t sb_dev_minor;
+    uint64_t sb_magic;
+    uint32_t sb_flags;
+    uint32_t fs_type;           // [str]
+    uint64_t mnt_id;
+    uint64_t mnt_parent_id;
+    uint32_t mnt_id_old;
+    uint32_t mnt_parent_id_old;
+    uint64_t mnt_attr;
+    uint64_t mnt_propagation;
+    uint64_t mnt_peer_group;
+    uint64_t mnt_master;
+    uint64_t propagate_from;
+    uint32_t mnt_root;          // [str]
+    uint32_t mnt_point;         // [str]
+    uint64_t mnt_ns_id;
+    uint32_t fs_subtype;        // [str]
+    uint32_t sb_source;         // [str] (6.12)
+    uint32_t opt_num;
+    uint32_t opt_array;
+    uint32_t opt_sec_num;
+    uint32_t opt_sec_array;
+    uint64_t spare2[46];
+};
+static_assert(sizeof(statmount_header) == 512);
+
+static constexpr uint64_t lsmt_root = ~(uint64_t) 0;
+static constexpr uint64_t statmount_sb_basic = 0x1;
+static constexpr uint64_t statmount_mnt_basic = 0x2;
+static constexpr uint64_t statmount_mnt_point = 0x10;
+static constexpr uint64_t statmount_fs_type = 0x20;
+static constexpr uint64_t statmount_mnt_opts = 0x80;
+static constexpr uint64_t statmount_sb_source = 0x200;
+static constexpr uint64_t statmount_details = statmount_sb_basic
+    | statmount_mnt_basic | statmount_fs_type | statmount_mnt_opts
+    | statmount_sb_source;
+// An empty string is not reported, and a mount may have no options, so a
+// kernel that knows mount sources (6.12+) is trusted to know options (6.10+).
+static constexpr uint64_t statmount_required = statmount_sb_basic
+    | statmount_mnt_basic | statmount_fs_type | statmount_sb_source;
+
+// `statmount` mount `id` into `buf`, growing it as needed. Returns the
+// header, or null with `errno` set.
+static const statmount_header* do_statmount(uint64_t id, uint64_t mask,
+                                            std::vector<char>& buf) {
+    mnt_id_req_v0 req = {sizeof(req), 0, id, mask};
+    if (buf.size() < 4096) {
+        buf.resize(4096);
+    }
+    while (syscall(SYS_statmount, &req, buf.data(), buf.size(), 0) != 0) {
+        if (errno != EOVERFLOW || buf.size() >= (1U << 24)) {
+            return nullptr;
+        }
+        buf.resize(2 * buf.size());
+    }
+    return reinterpret_cast<const statmount_header*>(buf.data());
+}
+
+// Return string field `off`, or "" if `mask` says it is absent.
+static const char* statmount_str(const statmount_header* sm, uint64_t mask,
+                                 uint32_t off) {
+    if (!(sm->mask & mask)) {
+        return "";
+    }
+    return reinterpret_cast<const char*>(sm + 1) + off;
+}
+#endif
+
+// Undo the octal escapes (`\040` for space) in a mount table field.
+static std::string unescape(std::string_view s) {
+    std::string t;
+    t.reserve(s.length());
+    for (size_t i = 0; i != s.length(); ++i) {
+        if (s[i] == '\\' && i + 3 < s.length()
+            && s[i + 1] >= '0' && s[i + 1] <= '3'
+            && s[i + 2] >= '0' && s[i + 2] <= '7'
+            && s[i + 3] >= '0' && s[i + 3] <= '7') {
+            t.push_back((char) ((s[i + 1] - '0') * 64 + (s[i + 2] - '0') * 8
+                                + (s[i + 3] - '0')));
+            i += 3;
+        } else {
+            t.push_back(s[i]);
+        }
+    }
+    return t;
+}
+
+// Split off the next space-separated field of `s`.
+static std::string_view next_field(std::string_view& s) {
+    size_t sp = s.find(' ');
+    std::string_view f = s.substr(0, sp);
+    s.remove_prefix(sp == std::string_view::npos ? s.length() : sp + 1);
+    return f;
+}
+
+static uint64_t field_number(std::string_view f) {
+    uint64_t v = 0;
+    for (char c : f) {
+        if (c < '0' || c > '9') {
+            break;
+        }
+        v = 10 * v + c - '0';
+    }
+    return v;
+}
+
+std::string_view mount_index::normalize(std::string_view path) {
+    while (path.length() > 1 && path.back() == '/') {
+        path.remove_suffix(1);
+    }
+    return path;
+}
+
+void mount_index::add(uint64_t id, uint64_t parent_id, std::string path,
+                      size_t offset) {
+    size_t i = entries_.size();
+    mountinfo_entry& e = entries_.emplace_back();
+    e.id = id;
+    e.parent_id = parent_id;
+    e.path = std::move(path);
+    offsets_.push_back(offset);
+    // a later mount on the same mount point covers an earlier one
+    by_path_[normalize(e.path)] = i;
+    by_id_[id] = i;
+}
+
+bool mount_index::load() {
+#if __linux__
+    struct stat st;
+    unsigned long long ns = stat("/proc/self/ns/mnt", &st) == 0 ? st.st_ino : 0;
+    if (loaded && ns == ns_) {
+        return true;
+    }
+    ns_ = ns;
+    if (load_statmount()) {
+        return true;
+    }
+    int fd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    std::string text;
+    char buf[16384];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) != 0) {
+        if (n > 0) {
+            text.append(buf, n);
+        } else if (errno != EINTR) {
+            int e = errno;
+            close(fd);
+            errno = e;
+            return false;
+        }
+    }
+    close(fd);
+    load_mountinfo(std::move(text));
+    return true;
+#elif __APPLE__
+    if (loaded) {
+        return true;
+    }
+    struct statfs* mntbuf;
+    int nmntbuf = getmntinfo(&mntbuf, MNT_NOWAIT);
+    for (int i = 0; i != nmntbuf; ++i) {
+        add(i + 1, 1, mntbuf[i].f_mntonname, 0);
+        mountinfo_entry& e = entries_.back();
+        e.parsed = true;
+        e.fstype = mntbuf[i].f_fstypename;
+        e.source = mntbuf[i].f_mntfromname;
+        e.flags = mntbuf[i].f_flags;
+    }
+    nparsed = entries_.size();
+    loaded = true;
+    return true;
+#else
+    loaded = true;
+    return true;
+#endif
+}
+
+// A line of `/proc/self/mountinfo` is `ID PARENTID MAJOR:MINOR ROOT
+// MOUNTPOINT MOUNTOPTIONS [OPTIONALFIELDS...] - FSTYPE SOURCE SUPEROPTIONS`.
+// Only the first two fields and the mount point are read now.
+void mount_index::load_mountinfo(std::string text) {
+    entries_.clear();
+    offsets_.clear();
+    by_path_.clear();
+    by_id_.clear();
+    nparsed = 0;
+    from_statmount = false;
+    text_ = std::move(text);
+    size_t pos = 0;
+    while (pos < text_.length()) {
+        size_t nl = text_.find('\n', pos);
+        if (nl == std::string::npos) {
+            nl = text_.length();
+        }
+        std::string_view line(text_.data() + pos, nl - pos);
+        uint64_t id = field_number(next_field(line));
+        uint64_t parent_id = field_number(next_field(line));
+        next_field(line);
+        next_field(line);
+        std::string_view mp = next_field(line);
+        if (!mp.empty()) {
+            add(id, parent_id,
+                mp.find('\\') == std::string_view::npos ? std::string(mp) : unescape(mp),
+                pos);
+        }
+        pos = nl + 1;
+    }
+    loaded = true;
+}
+
+// List the mounts with `listmount`, and read their mount points with
+// `statmount`. Fails unless `statmount` can also fill in the details.
+bool mount_index::load_statmount() {
+#if __linux__ && defined(SYS_statmount)
+    std::vector<uint64_t> ids;
+    uint64_t chunk[512];
+    mnt_id_req_v0 req = {sizeof(req), 0, lsmt_root, 0};
+    while (true) {
+        ssize_t n = syscall(SYS_listmount, &req, chunk, 512, 0);
+        if (n < 0) {
+            return false;
+        }
+        ids.insert(ids.end(), chunk, chunk + n);
+        if (n < 512) {
+            break;
+        }
+        req.param = chunk[n - 1];
+    }
+    if (ids.empty()) {
+        return false;
+    }
+
+    std::vector<char> buf;
+    const statmount_header* sm = do_statmount(ids[0], statmount_details, buf);
+    if (!sm || (sm->mask & statmount_required) != statmount_required) {
+        // an older kernel cannot name sources or options
+        return false;
+    }
+
+    entries_.clear();
+    offsets_.clear();
+    by_path_.clear();
+    by_id_.clear();
+    text_.clear();
+    nparsed = 0;
+    for (uint64_t id : ids) {
+        sm = do_statmount(id, statmount_mnt_basic | statmount_mnt_point, buf);
+        if (sm && (sm->mask & statmount_mnt_point)) {
+            add(sm->mnt_id, sm->mnt_parent_id,
+                statmount_str(sm, statmount_mnt_point, sm->mnt_point), 0);
+        }
+        // a mount unmounted since `listmount` is skipped
+    }
+    from_statmount = true;
+    loaded = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void mount_index::fill(mountinfo_entry& e, size_t i) {
+    e.parsed = true;
+    ++nparsed;
+#if __linux__ && defined(SYS_statmount)
+    if (from_statmount) {
+        std::vector<char> buf;
+        const statmount_header* sm = do_statmount(e.id, statmount_details, buf);
+        if (!sm) {
+            return;
+        }
+        e.fstype = statmount_str(sm, statmount_fs_type, sm->fs_type);
+        e.source = statmount_str(sm, statmount_sb_source, sm->sb_source);
+        // MOUNT_ATTR_* and SB_* flags, as `/proc/self/mountinfo` names them
+        e.options = (sm->mnt_attr & 0x1) || (sm->sb_flags & 0x1) ? "ro" : "rw";
+        static const struct { uint64_t bit; const char* name; } attrs[] = {
+            {0x2, "nosuid"}, {0x4, "nodev"}, {0x8, "noexec"},
+            {0x80, "nodiratime"}
+        };
+        for (auto& a : attrs) {
+            if (sm->mnt_attr & a.bit) {
+                e.options.append(",").append(a.name);
+            }
+        }
+        uint64_t atime = sm->mnt_attr & 0x70;
+        e.options.append(atime == 0x10 ? ",noatime"
+                         : atime == 0x20 ? ",strictatime" : ",relatime");
+        if (sm->sb_flags & 0x10) {
+            e.options.append(",sync");
+        }
+        if (sm->sb_flags & 0x80) {
+            e.options.append(",dirsync");
+        }
+        if (sm->sb_flags & 0x2000000) {
+            e.options.append(",lazytime");
+        }
+        if (const char* opts = statmount_str(sm, statmount_mnt_opts, sm->mnt_opts);
+            *opts) {
+            e.options.append(",").append(unescape(opts));
+        }
+        return;
+    }
+#endif
+    if (text_.empty()) {
+        return;
+    }
+    size_t nl = text_.find('\n', offsets_[i]);
+    std::string_view line(text_.data() + offsets_[i],
+                          (nl == std::string::npos ? text_.length() : nl) - offsets_[i]);
+    for (int f = 0; f != 5; ++f) {
+        next_field(line);
+    }
+    std::string_view mountopts = next_field(line);
+    // skip optional fields through the `-` separator
+    while (!line.empty() && next_field(line) != "-") {
+        // do nothing
+    }
+    e.fstype = unescape(next_field(line));
+    e.source = unescape(next_field(line));
+    e.options = std::string(mountopts);
+    if (std::string_view superopts = next_field(line); !superopts.empty()) {
+        e.options.append(",").append(unescape(superopts));
+    }
+}
+
+const mountinfo_entry* mount_index::find(std::string_view path) {
+    const size_t* ip = by_path_.find(normalize(path));
+    if (!ip) {
+        return nullptr;
+    }
+    mountinfo_entry& e = entries_[*ip];
+    if (!e.parsed) {
+        fill(e, *ip);
+    }
+    return &e;
+}
+
+const mountinfo_entry* mount_index::find_id(uint64_t id) {
+    const size_t* ip = by_id_.find(id);
+    if (!ip) {
+        return nullptr;
+    }
+    mountinfo_entry& e = entries_[*ip];
+    if (!e.parsed) {
+        fill(e, *ip);
+    }
+    return &e;
+}
+
+std::vector<const mountinfo_entry*> mount_index::below(std::string_view dir) {
+    std::vector<const mountinfo_entry*> v;
+    for (size_t i = 0; i != entries_.size(); ++i) {
+        mountinfo_entry& e = entries_[i];
+        if (e.path.length() > dir.length() && e.path.starts_with(dir)) {
+            if (!e.parsed) {
+                fill(e, i);
+            }
+            v.push_back(&e);
+        }
+    }
+    // a mount's mount point lies within its parent's
+    std::stable_sort(v.begin(), v.end(), [] (const mountinfo_entry* a, const mountinfo_entry* b) {
+        return a->path.length() < b->path.length();
+    });
+    return v;
+}
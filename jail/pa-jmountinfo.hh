@@ -0,0 +1,80 @@
+// pa-jmountinfo.hh -- Peteramati mount table index for pa-jail
+// Peteramati is Copyright (c) 2013-2026 Eddie Kohler and others
+// See LICENSE for open-source distribution terms
+
+#pragma once
+#include "pa-jpath.hh"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// One mount.
+struct mountinfo_entry {
+    uint64_t id = 0;            // mount ID
+    uint64_t parent_id = 0;     // parent's mount ID (its own for the root)
+    std::string path;           // mount point, without a trailing slash
+    // Filled in when the entry is first looked up:
+    bool parsed = false;
+    std::string fstype;
+    std::string source;
+    std::string options;        // mount options, then superblock options
+    unsigned long flags = 0;    // mount flags, where options are not text
+};
+
+// The mounts in this process's mount namespace, indexed by mount ID and by
+// mount point. A host with container runtimes and many jails can have
+// thousands of mounts, of which a jail looks up a handful, so `load` reads
+// only IDs and mount points; the rest of an entry is read the first time it
+// is looked up.
+//
+// On Linux, `load` uses `listmount` and `statmount` where the kernel supports
+// them with mount sources and options (6.8+ for the calls, 6.12+ for every
+// field we need), and otherwise `/proc/self/mountinfo`. Mount IDs belong to a
+// mount namespace, so `load` in a new namespace reads the table again.
+// Lookups fill in entries, so an index is not thread-safe, except for
+// `contains`.
+class mount_index {
+  public:
+    mount_index() = default;
+    mount_index(const mount_index&) = delete;
+    mount_index& operator=(const mount_index&) = delete;
+
+    // Read the mount table, unless it was read in this mount namespace.
+    // Returns false, with `errno` set, on failure.
+    bool load();
+    // Index `text`, in `/proc/self/mountinfo` format.
+    void load_mountinfo(std::string text);
+
+    // Return the mount at `path`, or null. Trailing slashes are ignored. Of
+    // mounts stacked on one mount point, returns the topmost.
+    const mountinfo_entry* find(std::string_view path);
+    const mountinfo_entry* find_id(uint64_t id);
+    // Return true if something is mounted at `path`.
+    bool contains(std::string_view path) const {
+        return by_path_.contains(normalize(path));
+    }
+    // Return the mounts strictly below directory `dir`, which ends in `/`,
+    // each after the mounts it lies below.
+    std::vector<const mountinfo_entry*> below(std::string_view dir);
+
+    size_t size() const {
+        return entries_.size();
+    }
+    bool loaded = false;
+    bool from_statmount = false;        // read with `statmount`
+    size_t nparsed = 0;                 // entries filled in
+
+  private:
+    std::vector<mountinfo_entry> entries_;
+    std::vector<size_t> offsets_;       // `text_` offset of each entry's line
+    std::string text_;
+    unsigned long long ns_ = 0;         // mount namespace inode at `load`
+    path_table<size_t> by_path_;
+    flat_table<uint64_t, size_t> by_id_;
+
+    static std::string_view normalize(std::string_view path);
+    void add(uint64_t id, uint64_t parent_id, std::string path, size_t offset);
+    bool load_statmount();
+    void fill(mountinfo_entry& e, size_t i);
+};
@@ -0,0 +1,39 @@
+// pa-jpath.cc -- Peteramati interned path tables for pa-jail
+// Peteramati is Copyright (c) 2013-2026 Eddie Kohler and others
+// See LICENSE for open-source distribution terms
+
+#include "pa-jpath.hh"
+#include <algorithm>
+#include <cstring>
+
+path_arena::~path_arena() {
+    clear();
+}
+
+std::string_view path_arena::intern(std::string_view s) {
+    if (s.empty()) {
+        return std::string_view("", 0);
+    }
+    if (size_t(end_ - pos_) <= s.length()) {
+        // a string longer than a chunk gets a chunk of its own
+        size_t n = std::max(s.length() + 1, chunk_size);
+        chunks_.push_back(new char[n]);
+        pos_ = chunks_.back();
+        end_ = pos_ + n;
+    }
+    char* p = pos_;
+    memcpy(p, s.data(), s.length());
+    p[s.length()] = '\0';
+    pos_ += s.length() + 1;
+    nbytes += s.length();
+    return std::string_view(p, s.length());
+}
+
+void path_arena::clear() {
+    for (char* c : chunks_) {
+        delete[] c;
+    }
+    chunks_.clear();
+    pos_ = end_ = nullptr;
+    nbytes = 0;
+}
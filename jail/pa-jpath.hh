@@ -0,0 +1,181 @@
+// pa-jpath.hh -- Peteramati interned path tables for pa-jail
+// Peteramati is Copyright (c) 2013-2026 Eddie Kohler and others
+// See LICENSE for open-source distribution terms
+
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// A bump allocator for strings that live as long as the arena. Copies are
+// carved from large chunks, so interning thousands of paths costs a handful
+// of allocations, and the views it returns stay valid until `clear()`.
+class path_arena {
+  public:
+    path_arena() = default;
+    path_arena(const path_arena&) = delete;
+    path_arena& operator=(const path_arena&) = delete;
+    ~path_arena();
+
+    // Return a view of an arena copy of `s`. The copy is NUL-terminated, so
+    // `data()` may be passed to system calls.
+    std::string_view intern(std::string_view s);
+    // Free every copy.
+    void clear();
+
+    // Counters: chunks allocated, and bytes interned.
+    size_t nchunks() const {
+        return chunks_.size();
+    }
+    size_t nbytes = 0;
+
+  private:
+    static constexpr size_t chunk_size = 64 << 10;
+    std::vector<char*> chunks_;
+    char* pos_ = nullptr;
+    char* end_ = nullptr;
+};
+
+
+// An open-addressing hash table with linear probing, for keys and values that
+// are cheap to copy. Each slot keeps its key's hash, so a probe compares keys
+// only on a full hash match. Entries are never removed one at a time.
+template <typename K, typename V, typename Hash = std::hash<K>>
+class flat_table {
+  public:
+    V* find(const K& key);
+    const V* find(const K& key) const {
+        return const_cast<flat_table*>(this)->find(key);
+    }
+    bool contains(const K& key) const {
+        return find(key) != nullptr;
+    }
+    // Insert `key` with `value` unless `key` is present. Returns the entry's
+    // value and whether it was inserted.
+    std::pair<V*, bool> insert(const K& key, V value);
+    V& operator[](const K& key) {
+        return *insert(key, V()).first;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+    void clear() {
+        slots_.clear();
+        size_ = 0;
+    }
+
+  protected:
+    struct slot {
+        size_t hash = 0;        // 0 means empty
+        K key;
+        V value;
+    };
+    std::vector<slot> slots_;   // size is 0 or a power of two
+    size_t size_ = 0;
+
+    static size_t hash_of(const K& key) {
+        // `std::hash` of an integer is often the identity; mix it so that
+        // neighboring keys do not fill neighboring slots
+        unsigned long long h = Hash()(key);
+        h = (h ^ (h >> 31)) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 29;
+        return h ? h : 1;
+    }
+    // Return `key`'s slot, claiming an empty one if `key` is absent.
+    std::pair<slot*, bool> emplace(const K& key);
+    void grow();
+};
+
+template <typename K, typename V, typename Hash>
+V* flat_table<K, V, Hash>::find(const K& key) {
+    if (size_ == 0) {
+        return nullptr;
+    }
+    size_t h = hash_of(key), mask = slots_.size() - 1;
+    for (size_t i = h & mask; slots_[i].hash; i = (i + 1) & mask) {
+        if (slots_[i].hash == h && slots_[i].key == key) {
+            return &slots_[i].value;
+        }
+    }
+    return nullptr;
+}
+
+template <typename K, typename V, typename Hash>
+auto flat_table<K, V, Hash>::emplace(const K& key) -> std::pair<slot*, bool> {
+    // keep the table at most half full
+    if (2 * (size_ + 1) > slots_.size()) {
+        grow();
+    }
+    size_t h = hash_of(key), mask = slots_.size() - 1;
+    size_t i = h & mask;
+    for (; slots_[i].hash; i = (i + 1) & mask) {
+        if (slots_[i].hash == h && slots_[i].key == key) {
+            return {&slots_[i], false};
+        }
+    }
+    slots_[i].hash = h;
+    slots_[i].key = key;
+    ++size_;
+    return {&slots_[i], true};
+}
+
+template <typename K, typename V, typename Hash>
+std::pair<V*, bool> flat_table<K, V, Hash>::insert(const K& key, V value) {
+    auto [s, inserted] = emplace(key);
+    if (inserted) {
+        s->value = std::move(value);
+    }
+    return {&s->value, inserted};
+}
+
+template <typename K, typename V, typename Hash>
+void flat_table<K, V, Hash>::grow() {
+    std::vector<slot> old;
+    old.swap(slots_);
+    slots_.resize(old.empty() ? 64 : 2 * old.size());
+    size_t mask = slots_.size() - 1;
+    for (auto& s : old) {
+        if (s.hash) {
+            size_t i = s.hash & mask;
+            while (slots_[i].hash) {
+                i = (i + 1) & mask;
+            }
+            slots_[i] = std::move(s);
+        }
+    }
+}
+
+
+// A `flat_table` keyed by path. A key is copied into the table's arena when
+// first inserted, so lookups and repeat inserts with a borrowed view (of a
+// reused buffer, say) allocate nothing.
+template <typename V>
+class path_table : public flat_table<std::string_view, V> {
+    using base = flat_table<std::string_view, V>;
+  public:
+    std::pair<V*, bool> insert(std::string_view key, V value) {
+        auto [s, inserted] = this->emplace(key);
+        if (inserted) {
+            s->key = arena_.intern(key);
+            s->value = std::move(value);
+        }
+        return {&s->value, inserted};
+    }
+    V& operator[](std::string_view key) {
+        return *insert(key, V()).first;
+    }
+    void clear() {
+        base::clear();
+        arena_.clear();
+    }
+
+    const path_arena& arena() const {
+        return arena_;
+    }
+
+  private:
+    path_arena arena_;
+};
@@ -0,0 +1,168 @@
+// pa-jpwcache.cc -- Peteramati home directory owner cache for pa-jail
+// Peteramati is Copyright (c) 2013-2026 Eddie Kohler and others
+// See LICENSE for open-source distribution terms
+
+#include "pa-jpwcache.hh"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <pwd.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static constexpr std::string_view pwcache_magic = "pa-jail passwd cache 1\n";
+static constexpr off_t pwcache_max_size = 16 << 20;
+
+// The file: the magic line, then one line per name: its expiry time, its uid
+// and gid (`-` and `-` if there is no such user), and the name, separated by
+// spaces.
+void passwd_cache::open(std::string filename, unsigned ttl) {
+    filename_ = std::move(filename);
+    ttl_ = ttl;
+    entries_.clear();
+    changed_ = false;
+
+    int fd = ::open(filename_.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1) {
+        return;
+    } else if (fstat(fd, &st) != 0
+               || !S_ISREG(st.st_mode)
+               || st.st_uid != geteuid()
+               || (st.st_mode & (S_IWGRP | S_IWOTH))
+               || st.st_size > pwcache_max_size) {
+        close(fd);
+        return;
+    }
+    std::string text;
+    char buf[8192];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) != 0) {
+        if (n > 0) {
+            text.append(buf, n);
+        } else if (errno != EINTR) {
+            break;
+        }
+    }
+    close(fd);
+    if (!std::string_view(text).starts_with(pwcache_magic)) {
+        return;
+    }
+
+    time_t now = time(nullptr);
+    size_t pos = pwcache_magic.length();
+    while (pos < text.length()) {
+        size_t eol = text.find('\n', pos);
+        if (eol == std::string::npos) {
+            break;              // a torn write
+        }
+        text[eol] = '\0';
+        const char* s = text.c_str() + pos;
+        pos = eol + 1;
+        char* end;
+        entry e;
+        e.expires = strtoll(s, &end, 10);
+        if (end == s || *end != ' ') {
+            continue;
+        }
+        s = end + 1;
+        if (s[0] == '-' && s[1] == ' ' && s[2] == '-' && s[3] == ' ') {
+            e.found = false;
+            e.uid = e.gid = 0;
+            s += 4;
+        } else {
+            e.found = true;
+            e.uid = strtoul(s, &end, 10);
+            if (end == s || *end != ' ') {
+                continue;
+            }
+            s = end + 1;
+            e.gid = strtoul(s, &end, 10);
+            if (end == s || *end != ' ') {
+                continue;
+            }
+            s = end + 1;
+        }
+        if (*s != '\0' && e.expires > now && e.expires <= now + (time_t) ttl_) {
+            entries_[s] = e;
+        } else {
+            changed_ = true;    // drop it next save
+        }
+    }
+}
+
+bool passwd_cache::lookup(const std::string& name, uid_t* uid, gid_t* gid) {
+    ++nlookups;
+    time_t now = time(nullptr);
+    auto it = entries_.find(name);
+    if (it != entries_.end() && it->second.expires > now) {
+        ++ncached;
+    } else {
+        entry e{false, 0, 0, now + (time_t) ttl_};
+        errno = 0;
+        if (struct passwd* pw = getpwnam(name.c_str())) {
+            // a user whose home is elsewhere under /home owns that one
+            e.found = !pw->pw_dir
+                || strncmp(pw->pw_dir, "/home/", 6) != 0
+                || strchr(pw->pw_dir + 6, '/') != nullptr
+                || name == pw->pw_dir + 6;
+            e.uid = pw->pw_uid;
+            e.gid = pw->pw_gid;
+        } else if (errno != 0 && errno != ENOENT && errno != ESRCH) {
+            // the directory service failed: do not remember that
+            return false;
+        }
+        it = entries_.insert_or_assign(name, e).first;
+        changed_ = true;
+    }
+    *uid = it->second.uid;
+    *gid = it->second.gid;
+    return it->second.found;
+}
+
+void passwd_cache::save() {
+    if (filename_.empty() || !changed_) {
+        return;
+    }
+    time_t now = time(nullptr);
+    std::string text(pwcache_magic);
+    char buf[128];
+    for (const auto& [name, e] : entries_) {
+        if (e.expires <= now || name.find('\n') != std::string::npos) {
+            continue;
+        }
+        if (e.found) {
+            snprintf(buf, sizeof(buf), "%lld %lu %lu ", (long long) e.expires,
+                     (unsigned long) e.uid, (unsigned long) e.gid);
+        } else {
+            snprintf(buf, sizeof(buf), "%lld - - ", (long long) e.expires);
+        }
+        text.append(buf).append(name).push_back('\n');
+    }
+    // write a new file and rename it over the old, so concurrent runs never
+    // read a partial cache. The new file must not exist already: a name
+    // planted there is never written through.
+    static std::atomic<unsigned> tmpcounter;
+    std::string tmp;
+    int fd = -1;
+    for (int tries = 0; fd == -1 && tries != 8; ++tries) {
+        tmp = filename_ + "." + std::to_string(getpid())
+            + "." + std::to_string(tmpcounter++) + ".tmp";
+        fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+        if (fd == -1 && errno != EEXIST) {
+            return;
+        }
+    }
+    if (fd == -1) {
+        return;
+    }
+    bool ok = write(fd, text.data(), text.length()) == (ssize_t) text.length();
+    if (close(fd) != 0 || !ok || rename(tmp.c_str(), filename_.c_str()) != 0) {
+        unlink(tmp.c_str());
+    } else {
+        changed_ = false;
+    }
+}
@@ -0,0 +1,53 @@
+// pa-jpwcache.hh -- Peteramati home directory owner cache for pa-jail
+// Peteramati is Copyright (c) 2013-2026 Eddie Kohler and others
+// See LICENSE for open-source distribution terms
+
+#pragma once
+#include <ctime>
+#include <string>
+#include <unordered_map>
+#include <sys/types.h>
+
+// The owners of jail home directories, looked up one name at a time. `pa-jail
+// run -h` gives each directory under a jail's `home/` to its user; looking up
+// the names actually there costs a `getpwnam` each, where enumerating the user
+// database would cost a trip through every account the directory service
+// knows.
+//
+// With a file (`pwcache` in the config), answers, including "no such user",
+// persist for `ttl` seconds, so later runs need not ask the directory service
+// at all. The file must be owned by the effective user and not writable by
+// group or others, else it is ignored; it is replaced, never rewritten in
+// place. A cache is not thread-safe.
+class passwd_cache {
+  public:
+    passwd_cache() = default;
+    passwd_cache(const passwd_cache&) = delete;
+    passwd_cache& operator=(const passwd_cache&) = delete;
+
+    // Keep answers in `filename` for `ttl` seconds, loading its unexpired
+    // entries.
+    void open(std::string filename, unsigned ttl);
+    // Find the owner of home directory `name`: the user called `name`, unless
+    // that user's home directory is `/home/OTHER`. Returns false if there is
+    // none.
+    bool lookup(const std::string& name, uid_t* uid, gid_t* gid);
+    // Write the file, if it changed. A file that cannot be written is left
+    // alone.
+    void save();
+
+    unsigned long long nlookups = 0;    // calls to `lookup`
+    unsigned long long ncached = 0;     // answered from the cache
+
+  private:
+    struct entry {
+        bool found;
+        uid_t uid;
+        gid_t gid;
+        time_t expires;
+    };
+    std::string filename_;
+    unsigned ttl_ = 0;
+    bool changed_ = false;
+    std::unordered_map<std::string, entry> entries_;
+};
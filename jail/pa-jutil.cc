@@ -8,9 +8,17 @@
 #include <cstdarg>
 #include <cstdio>
 #include <cstring>
+#include <cerrno>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#if __linux__
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>           // FICLONE
+#endif
 
-int exit_status = 0;
+std::atomic<int> exit_status = 0;
 
 int perror_fail(const char* format, const char* arg1) {
     fprintf(stderr, format, arg1, strerror(errno));
@@ -79,6 +87,27 @@ std::string shell_quote(const std::string& argument) {
     return quoted;
 }
 
+std::string json_quote(std::string_view s) {
+    std::string quoted = "\"";
+    for (unsigned char ch : s) {
+        if (ch == '"' || ch == '\\') {
+            quoted += '\\';
+            quoted += ch;
+        } else if (ch == '\n') {
+            quoted += "\\n";
+        } else if (ch == '\t') {
+            quoted += "\\t";
+        } else if (ch < 0x20 || ch == 0x7F) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", ch);
+            quoted += buf;
+        } else {
+            quoted += ch;
+        }
+    }
+    return quoted + "\"";
+}
+
 // Check a potential character class match starting at `pp` against the string
 // starting at `sp`. Return 0 on no match, the (positive) number of pattern
 // characters in the character class on successful match, and -1 if `[pp, pe)`
@@ -390,3 +419,301 @@ std::string file_get_contents(std::string fname, int error_behavior) {
     fclose(f);
     return contents;
 }
+
+
+// Copy the `len` bytes at offset `off` of `sfd` to the same offset of `dfd`.
+// `method` is the best method not yet refused; it is downgraded in place when
+// the kernel or file system refuses it, so later extents skip the failed call.
+static int copy_extent(int sfd, int dfd, off_t off, off_t len,
+                       copy_method& method, copy_result& result) {
+    while (len > 0) {
+        size_t want = len > (off_t) (1 << 30) ? (size_t) 1 << 30 : (size_t) len;
+        ssize_t n;
+#if __linux__
+        if (method == COPY_RANGE) {
+            loff_t ioff = off, ooff = off;
+            n = copy_file_range(sfd, &ioff, dfd, &ooff, want, 0);
+            if (n == -1 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL
+                            || errno == EOPNOTSUPP || errno == EBADF)) {
+                method = COPY_SENDFILE;
+                continue;
+            }
+        } else if (method == COPY_SENDFILE) {
+            off_t ioff = off;
+            n = lseek(dfd, off, SEEK_SET) == off ? sendfile(dfd, sfd, &ioff, want) : -1;
+            if (n == -1 && (errno == ENOSYS || errno == EINVAL)) {
+                method = COPY_READWRITE;
+                continue;
+            }
+        } else
+#endif
+        {
+            method = COPY_READWRITE;
+            char buf[131072];
+            n = pread(sfd, buf, std::min(want, sizeof(buf)), off);
+            for (ssize_t w = 0; n > 0 && w != n; ) {
+                ssize_t m = pwrite(dfd, buf + w, n - w, off + w);
+                if (m == -1 && errno != EINTR) {
+                    return -1;
+                }
+                w += std::max(m, (ssize_t) 0);
+            }
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        } else if (n == -1) {
+            return -1;
+        } else if (n == 0 && method != COPY_READWRITE) {
+            // some file systems report 0 from `copy_file_range` or `sendfile`
+            // without copying anything; only `read` can say the data ended
+            method = COPY_READWRITE;
+            continue;
+        } else if (n == 0) {
+            // source shrank under us; the caller's `ftruncate` pads the copy
+            // to the size `fstat` reported
+            break;
+        }
+        result.method = method;
+        result.bytes += n;
+        off += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int copy_data(int sfd, int dfd, const struct stat& st, copy_result& result) {
+    copy_method method = COPY_RANGE;
+    // A file with fewer allocated blocks than its size has holes: walk its
+    // data extents so the copy has the same holes. Otherwise copy it whole.
+    off_t pos = 0;
+#ifdef SEEK_DATA
+    if ((off_t) st.st_blocks * 512 < st.st_size) {
+        while (pos < st.st_size) {
+            off_t data = lseek(sfd, pos, SEEK_DATA);
+            if (data == -1 && errno == ENXIO) {
+                break;          // only a hole remains
+            } else if (data == -1) {
+                goto whole;     // file system cannot report holes
+            }
+            off_t hole = lseek(sfd, data, SEEK_HOLE);
+            if (hole == -1) {
+                return -1;
+            }
+            if (copy_extent(sfd, dfd, data, hole - data, method, result) != 0) {
+                return -1;
+            }
+            pos = hole;
+        }
+        return ftruncate(dfd, st.st_size);
+    }
+ whole:
+#endif
+    if (copy_extent(sfd, dfd, pos, st.st_size - pos, method, result) != 0) {
+        return -1;
+    }
+    return ftruncate(dfd, st.st_size);
+}
+
+// Try to share `sfd`'s extents with the empty `dfd`. Returns false, with no
+// change to `dfd`, if the file system cannot (not copy-on-write, different
+// file systems, or a kernel without FICLONE).
+static bool clone_data(int sfd, int dfd, const struct stat& st, copy_result& result) {
+#if __linux__ && defined(FICLONE)
+    if (ioctl(dfd, FICLONE, sfd) == 0) {
+        result.method = COPY_REFLINK;
+        result.bytes = st.st_size;
+        return true;
+    }
+#else
+    (void) sfd, (void) dfd, (void) st, (void) result;
+#endif
+    return false;
+}
+
+int copy_file_at(int srcdirfd, const char* src, int dstdirfd, const char* dst,
+                 const struct stat* expected, copy_result& result, bool reflink) {
+    result = copy_result();
+    int sfd = openat(srcdirfd, src, O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NOCTTY);
+    if (sfd == -1) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(sfd, &st) != 0) {
+        int e = errno;
+        close(sfd);
+        errno = e;
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode)
+        || (expected
+            && (st.st_dev != expected->st_dev
+                || st.st_ino != expected->st_ino
+                || (st.st_mode & S_IFMT) != (expected->st_mode & S_IFMT)))) {
+        close(sfd);
+        errno = S_ISREG(st.st_mode) ? ESTALE : EINVAL;
+        return -1;
+    }
+
+    // private until the copy is complete; the real mode is applied last
+    int dfd = openat(dstdirfd, dst, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC | O_NOFOLLOW | O_NOCTTY, 0600);
+    if (dfd == -1) {
+        int e = errno;
+        close(sfd);
+        errno = e;
+        return -1;
+    }
+
+    mode_t mode = st.st_mode & 07777;
+    struct timespec ts[2];
+#if __linux__
+    ts[0] = st.st_atim;
+    ts[1] = st.st_mtim;
+#else
+    ts[0] = st.st_atimespec;
+    ts[1] = st.st_mtimespec;
+#endif
+    int r = 0;
+    if (!reflink || !clone_data(sfd, dfd, st, result)) {
+        r = copy_data(sfd, dfd, st, result);
+    }
+    // `cp -p` keeps going if ownership cannot be preserved, but then drops the
+    // set-id bits rather than grant them to the wrong owner. The mode comes
+    // after the owner because `fchown` clears set-id bits.
+    if (r == 0 && fchown(dfd, st.st_uid, st.st_gid) != 0) {
+        if (errno != EPERM && errno != EINVAL) {
+            r = -1;
+        }
+        mode &= ~(S_ISUID | S_ISGID);
+    }
+    if (r == 0) {
+        r = fchmod(dfd, mode);
+    }
+    if (r == 0) {
+        r = futimens(dfd, ts);
+    }
+    if (close(dfd) != 0 && r == 0) {
+        r = -1;
+    }
+    int e = errno;
+    close(sfd);
+    if (r != 0) {
+        unlinkat(dstdirfd, dst, 0);
+        errno = e;
+    }
+    return r;
+}
+
+
+// hashing
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+sha256::sha256()
+    : h_{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+         0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19} {
+}
+
+void sha256::block(const unsigned char* p) {
+    uint32_t w[64];
+    for (int i = 0; i != 16; ++i) {
+        w[i] = (uint32_t(p[4 * i]) << 24) | (uint32_t(p[4 * i + 1]) << 16)
+            | (uint32_t(p[4 * i + 2]) << 8) | p[4 * i + 3];
+    }
+    for (int i = 16; i != 64; ++i) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = h_[0], b = h_[1], c = h_[2], d = h_[3],
+        e = h_[4], f = h_[5], g = h_[6], h = h_[7];
+    for (int i = 0; i != 64; ++i) {
+        uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25))
+            + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22))
+            + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    h_[0] += a;
+    h_[1] += b;
+    h_[2] += c;
+    h_[3] += d;
+    h_[4] += e;
+    h_[5] += f;
+    h_[6] += g;
+    h_[7] += h;
+}
+
+void sha256::update(const void* data, size_t len) {
+    auto p = static_cast<const unsigned char*>(data);
+    size_t have = len_ % 64;
+    len_ += len;
+    if (have != 0) {
+        size_t n = std::min(len, 64 - have);
+        memcpy(buf_ + have, p, n);
+        p += n;
+        len -= n;
+        if (have + n != 64) {
+            return;
+        }
+        block(buf_);
+    }
+    for (; len >= 64; p += 64, len -= 64) {
+        block(p);
+    }
+    memcpy(buf_, p, len);
+}
+
+std::array<unsigned char, 32> sha256::digest() {
+    uint64_t bits = len_ * 8;
+    unsigned char pad[72] = {0x80};
+    size_t have = len_ % 64;
+    size_t padlen = (have < 56 ? 56 : 120) - have;
+    for (int i = 0; i != 8; ++i) {
+        pad[padlen + i] = bits >> (56 - 8 * i);
+    }
+    update(pad, padlen + 8);
+    std::array<unsigned char, 32> d;
+    for (int i = 0; i != 8; ++i) {
+        d[4 * i] = h_[i] >> 24;
+        d[4 * i + 1] = h_[i] >> 16;
+        d[4 * i + 2] = h_[i] >> 8;
+        d[4 * i + 3] = h_[i];
+    }
+    return d;
+}
+
+std::string sha256_hex(std::string_view s) {
+    sha256 h;
+    h.update(s);
+    return sha256_hex(h);
+}
+
+std::string sha256_hex(sha256& h) {
+    static const char hexdigits[] = "0123456789abcdef";
+    std::string x;
+    for (unsigned char c : h.digest()) {
+        x += hexdigits[c >> 4];
+        x += hexdigits[c & 15];
+    }
+    return x;
+}
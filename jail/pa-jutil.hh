@@ -3,15 +3,20 @@
 // See LICENSE for open-source distribution terms
 
 #pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <string>
+#include <sys/stat.h>
 
 #define ROOT 0
 
 
 // error helpers
 
-// Track whether an error occurred; initially 0.
-extern int exit_status;
+// Track whether an error occurred; initially 0. Atomic because manifest
+// population reports errors from worker threads.
+extern std::atomic<int> exit_status;
 
 // Print an error message to stderr, set `exit_status = 1`, and return 1.
 // `format` may contain two `%s` format strings; the first argument is `arg1`,
@@ -81,6 +86,11 @@ std::string path_pa_validate(std::string_view path);
 // in single quotes. Examples: `a`→`a`; `a b`→`'a b'`; `a'b`→`'a'\''b'`.
 std::string shell_quote(const std::string& argument);
 
+// Return `s` as a JSON string literal, double quotes included. `"`, `\`, and
+// control characters are escaped; other bytes, including non-UTF-8 ones, are
+// copied as-is. Examples: `a`→`"a"`; `a"b`→`"a\"b"`; newline→`"\n"`.
+std::string json_quote(std::string_view s);
+
 // Match `str` against `pattern` like `fnmatch(pattern, str,
 // FNM_PATHNAME | FNM_PERIOD)`, with one extension: a pattern component that is
 // exactly `**` matches any run of zero or more path components (i.e. it matches
@@ -107,3 +117,64 @@ std::string pathmatch_literal_prefix(std::string_view pattern);
 // it prints an error message to standard error; if positive, it prints an
 // error message and calls `exit(1)`.
 std::string file_get_contents(std::string path, int error_behavior = 0);
+
+
+// file copying
+
+// How `copy_file_at` moved a file's data.
+enum copy_method {
+    COPY_EMPTY = 0,     // no data to move (empty or all-hole file)
+    COPY_RANGE,         // copy_file_range(2), in-kernel (may share extents)
+    COPY_SENDFILE,      // sendfile(2), in-kernel
+    COPY_READWRITE,     // read(2)/write(2) through a user buffer
+    COPY_REFLINK        // ioctl(FICLONE): shares the source's extents
+};
+
+struct copy_result {
+    copy_method method = COPY_EMPTY;    // the last method that moved data
+    unsigned long long bytes = 0;       // data bytes moved (holes excluded),
+                                        // or for COPY_REFLINK, bytes shared
+};
+
+// Copy regular file `src` to a new file `dst` like `cp -p`: same data, same
+// holes (a sparse source stays sparse), and the source's owner, group, mode
+// (including set-id bits), access time, and modification time, all applied on
+// the open destination. `src` is relative to `srcdirfd` and `dst` to
+// `dstdirfd` (either may be `AT_FDCWD`); a symbolic link is not followed in
+// the final component of either. `dst` must not exist. If `expected` is
+// nonnull, `src` must still be the file it describes (same device, inode, and
+// type), else the copy fails with `ESTALE`. Data moves by `copy_file_range`,
+// falling back to `sendfile`, then to `read`/`write`, when the kernel or file
+// system refuses. If `reflink` is true, first try to clone the source's
+// extents (`ioctl(FICLONE)`, a copy-on-write file system such as btrfs or XFS)
+// and copy data only if the file system refuses. Returns 0 on success, or -1
+// with `errno` set; on failure a partially written `dst` is removed.
+int copy_file_at(int srcdirfd, const char* src, int dstdirfd, const char* dst,
+                 const struct stat* expected, copy_result& result,
+                 bool reflink = false);
+
+
+// hashing
+
+// SHA-256 (FIPS 180-4), computed incrementally.
+class sha256 {
+  public:
+    sha256();
+    void update(const void* data, size_t len);
+    void update(std::string_view s) {
+        update(s.data(), s.size());
+    }
+    // Finish and return the digest; the object must not be updated after.
+    std::array<unsigned char, 32> digest();
+
+  private:
+    uint32_t h_[8];
+    uint64_t len_ = 0;          // bytes hashed
+    unsigned char buf_[64];     // partial block, `len_ % 64` bytes
+    void block(const unsigned char* p);
+};
+
+// Return the lowercase hexadecimal SHA-256 digest of `s`.
+std::string sha256_hex(std::string_view s);
+// Finish `h` and return its digest in lowercase hexadecimal.
+std::string sha256_hex(sha256& h);
@@ -131,6 +131,8 @@ struct jail_run {
     std::string limit;                  // `--limit` argument (empty = none)
     bool cgroup_prep = false;           // delegate cgroup controllers first
     bool userns = false;                // pass `--userns`
+    std::string options;                // other pa-jail options, e.g. `--jobs 4`
+    std::string wrapper;                // command that runs pa-jail (empty = none)
 };
 
 // The pa-jail binary's path (in the image, or locally).
@@ -140,7 +142,8 @@ static std::string pajail_path() {
 
 // The `pa-jail run ...` invocation for this test.
 static std::string pajail_command(const jail_run& jr) {
-    std::string c = shq(pajail_path()) + (pa_verbose ? " run -q -V" : " run -q");
+    std::string c = (jr.wrapper.empty() ? "" : jr.wrapper + " ")
+        + shq(pajail_path()) + (pa_verbose ? " run -q -V" : " run -q");
     for (const std::string& f : jr.manifest) {
         c += " -F " + shq(f);
     }
@@ -150,6 +153,9 @@ static std::string pajail_command(const jail_run& jr) {
     if (jr.userns) {
         c += " --userns";
     }
+    if (!jr.options.empty()) {
+        c += " " + jr.options;
+    }
     return c + " --fg " + shq(jr.jaildir) + " pajtest " + shq(jr.command);
 }
 
@@ -651,6 +657,571 @@ static void test_userns() {
     printf("test-pa-jail: userns ok (identity-mapped non-root, jail-root unmapped, caps dropped)\n");
 }
 
+// Manifest files are copied on several threads (`--jobs`), but directories still
+// precede their contents, and a hard-linked pair -- one of them a symlink
+// target -- stays linked in the jail.
+static void test_jobs() {
+    jail_run jr;
+    jr.conf = "enablejail /jails/**\n";
+    jr.user_shell = "/bin/sh";
+    jr.manifest = shell_manifest("/bin/sh");
+    jr.jaildir = "/jails/jobs";
+    jr.options = "--jobs 4";
+    jr.setup = "rm -rf /pajjobs; for d in a b c d; do mkdir -p /pajjobs/$d/x; "
+        "for i in 1 2 3 4 5 6 7 8; do echo $d$i > /pajjobs/$d/x/f$i; done; done; "
+        "ln /pajjobs/a/x/f1 /pajjobs/d/x/hard; ln -s ../a/x/f1 /pajjobs/c/sym; "
+        "mkdir -p /pajjobs/e/y; echo e1 > /pajjobs/e/y/f; ln -s e /pajjobs/el\n";
+    for (const char* d : {"a", "b", "c", "d"}) {
+        for (int i = 1; i <= 8; ++i) {
+            jr.manifest.push_back(std::string("/pajjobs/") + d + "/x/f" + std::to_string(i));
+        }
+    }
+    jr.manifest.push_back("/pajjobs/c/sym");
+    jr.manifest.push_back("/pajjobs/d/x/hard");
+    jr.manifest.push_back("/pajjobs/el/y/f");   // a directory under a new symlink
+    jr.command = "read x < /pajjobs/b/x/f7; read y < /pajjobs/c/sym; read z < /pajjobs/e/y/f; "
+        "[ /pajjobs/a/x/f1 -ef /pajjobs/d/x/hard ] && echo \"jobs:$x:$y:$z:linked\"";
+    expect_output("jobs", jr, "jobs:b7:a1:e1:linked");
+    printf("test-pa-jail: jobs ok (parallel copies, hard link preserved, path through symlink)\n");
+}
+
+// Two manifest paths that name one file through a symbolic link (`lib` ->
+// `usr/lib`, as `[libs]` often lists) leave that file in the jail once.
+static void test_alias() {
+    jail_run jr;
+    jr.conf = "enablejail /jails/**\n";
+    jr.user_shell = "/bin/sh";
+    jr.manifest = shell_manifest("/bin/sh");
+    jr.manifest.push_back("/pajalias/l/f");
+    jr.manifest.push_back("/pajalias/d/f");
+    jr.jaildir = "/jails/alias";
+    jr.setup = shq(pajail_path()) + " rm -f /jails/alias\n"
+        "rm -rf /pajalias; mkdir -p /pajalias/d; echo al > /pajalias/d/f; "
+        "ln -s d /pajalias/l\n";
+    jr.command = "read x < /pajalias/d/f; echo \"alias:$x\"";
+    expect_output("alias", jr, "alias:al");
+    printf("test-pa-jail: alias ok (one file named through a symlink and directly)\n");
+}
+
+// An absolute symbolic link in the jail means the jail's file: populating a
+// path through one neither touches the host file it names outside the jail
+// nor skips the copy.
+static void test_jail_symlink() {
+    jail_run jr;
+    jr.conf = "enablejail /jails/**\n";
+    jr.user_shell = "/bin/sh";
+    jr.manifest = shell_manifest("/bin/sh");
+    jr.manifest.push_back("/pajabs/l/f");
+    jr.jaildir = "/jails/abs";
+    std::string add = shq(pajail_path()) + " add -h";
+    for (const std::string& f : jr.manifest) {
+        add += " -F " + shq(f);
+    }
+    jr.setup = "rm -rf /pajabs; mkdir -p /pajabs/d; echo abs > /pajabs/d/f; "
+        "ln -s /pajabs/d /pajabs/l\n"
+        + add + " " + shq(jr.jaildir) + " pajtest\n"
+        "[ \"$(cat /pajabs/d/f)\" = abs ]\n"
+        "[ -L /jails/abs/pajabs/l ]\n";
+    jr.command = "read x < /pajabs/l/f; echo \"jailsymlink:$x\"";
+    expect_output("jail-symlink", jr, "jailsymlink:abs");
+    printf("test-pa-jail: jail-symlink ok (absolute link resolved in the jail, host file kept)\n");
+}
+
+// Symbolic links whose targets overlap -- a merged-/usr `lib` link and a
+// chain of alternatives through it -- are each expanded once; later links in
+// the chain find their targets already populated.
+static void test_symlink_chain() {
+    jail_run jr;
+    jr.conf = "enablejail /jails/**\n";
+    jr.user_shell = "/bin/sh";
+    jr.manifest = shell_manifest("/bin/sh");
+    for (const char* f : {"/pajsym/lib/a", "/pajsym/alt/x", "/pajsym/alt/y", "/pajsym/alt/z"}) {
+        jr.manifest.push_back(f);
+    }
+    jr.jaildir = "/jails/symchain";
+    std::string add = shq(pajail_path()) + " add -V -h";
+    for (const std::string& f : jr.manifest) {
+        add += " -F " + shq(f);
+    }
+    jr.setup = "rm -rf /pajsym; mkdir -p /pajsym/usr/lib /pajsym/alt; "
+        "echo chain > /pajsym/usr/lib/a; ln -s usr/lib /pajsym/lib; "
+        "ln -s ../lib/a /pajsym/alt/x; ln -s x /pajsym/alt/y; "
+        "ln -s /pajsym/alt/y /pajsym/alt/z\n"
+        + add + " " + shq(jr.jaildir) + " pajtest 2>&1"
+        " | grep '# populate: .* symbolic link targets, .* memoized, [1-9][0-9]* already populated' >/dev/null\n";
+    jr.command = "read x < /pajsym/alt/z; echo \"symchain:$x\"";
+    expect_output("symlink-chain", jr, "symchain:chain");
+    printf("test-pa-jail: symlink-chain ok (overlapping link targets expanded once)\n");
+}
+
+// `--manifest-cache`: a second `add` with an unchanged manifest replays the
+// cache, and a changed source is copied again. A jail file reached through an
+// absolute symbolic link is checked in the jail, not at the host file the
+// link names there.
+static void test_manifest_cache() {
+    jail_run jr;
+    jr.conf = "enablejail /jails/**\n";
+    jr.user_shell = "/bin/sh";
+    jr.manifest = shell_manifest("/bin/sh");
+    jr.manifest.push_back("/pajcache/f1");
+    jr.manifest.push_back("/pajcache/f2");
+    jr.manifest.push_back("/pajcache/l/f");
+    jr.jaildir = "/jails/mcache";
+    jr.options = "--manifest-cache /pajcache.mc";
+    std::string add = shq(pajail_path()) + " add -V -h " + jr.options;
+    for (const std::string& f : jr.manifest) {
+        add += " -F " + shq(f);
+    }
+    add += " " + shq(jr.jaildir) + " pajtest 2>&1";
+    jr.setup = "rm -rf /pajcache /pajcache.mc; mkdir -p /pajcache/d; "
+        "echo one > /pajcache/f1; echo two > /pajcache/f2; echo four > /pajcache/d/f; "
+        "ln -s /pajcache/d /pajcache/l\n"
+        + add + " | grep 'manifest cache: .* records written' >/dev/null\n"
+        + add + " | grep 'manifest cache: .* entries unchanged' >/dev/null\n"
+        "rm /jails/mcache/pajcache/d/f\n"
+        + add + " | grep 'manifest cache: /pajcache/l/f changed' >/dev/null\n"
+        "echo three > /pajcache/f2\n";
+    jr.command = "read x < /pajcache/f1; read y < /pajcache/f2; read z < /pajcache/l/f; "
+        "echo \"mcache:$x:$y:$z\"";
+    expect_output("manifest-cache", jr, "mcache:one:three:four");
+    printf("test-pa-jail: manifest-cache ok (replayed, changed source recopied, checked in jail)\n");
+}
+
+// `add --plan=json`: after a source file changes, the plan reports one
+// replacement and skips everything else, and the jail is left alone until
+// the next plain `add`.
+static void test_plan() {
+    jail_run jr;
+    jr.conf = "enablejail /jails/**\n";
+    jr.user_shell = "/bin/sh";
+    jr.manifest = shell_manifest("/bin/sh");
+    jr.manifest.push_back("/pajplan/f1");
+    jr.manifest.push_back("/pajplan/f2");
+    jr.jaildir = "/jails/plan";
+    std::string add = shq(pajail_path()) + " add -h";
+    for (const std::string& f : jr.manifest) {
+        add += " -F " + shq(f);
+    }
+    std::string args = " " + shq(jr.jaildir) + " pajtest";
+    jr.setup = "rm -rf /pajplan; mkdir /pajplan; "
+        "echo one > /pajplan/f1; echo two > /pajplan/f2\n"
+        + add + args + "\n"
+        "echo three > /pajplan/f2\n"
+        + add + " --plan=json" + args + " > /pajplan.json\n"
+        "grep '\"create\": 0, \"replace\": 1, \"skip\": [1-9]' /pajplan.json >/dev/null\n"
+        "grep '\"op\": \"replace\", \"type\": \"file\", \"dst\": \"/jails/plan/pajplan/f2\"' /pajplan.json >/dev/null\n"
+        "[ \"$(cat /jails/plan/pajplan/f2)\" = two ]\n";
+    jr.command = "read x < /pajplan/f1; read y < /pajplan/f2; echo \"plan:$x:$y\"";
+    expect_output("plan", jr, "plan:one:three");
+    printf("test-pa-jail: plan ok (changed file planned as a replacement, jail unchanged)\n");
+}
+
+// `linkstore`: two jails share root-owned, unwritable files through the store,
+// a group-writable file is copied, and `gc` removes only unlinked entries.
+static void test_linkstore() {
+    jail_run jr;
+    jr.conf = "enablejail /jails/**\nlinkstore /pajstore\n";
+    jr.user_shell = "/bin/sh";
+    jr.manifest = shell_manifest("/bin/sh");
+    jr.manifest.push_back("/pajls/f");
+    jr.manifest.push_back("/pajls/g");
+    jr.jaildir = "/jails/ls2";
+    std::string add = shq(pajail_path()) + " add -h";
+    for (const std::string& f : jr.manifest) {
+        add += " -F " + shq(f);
+    }
+    std::string gc = shq(pajail_path()) + " gc /jails/ls2\n";
+    jr.setup = "rm -rf /pajls /pajstore; mkdir /pajls; "
+        "echo f > /pajls/f; echo g > /pajls/g; chmod 664 /pajls/g\n"
+        + add + " /jails/ls1 pajtest\n"
+        + add + " /jails/ls2 pajtest\n"
+        "[ \"$(stat -c %h /jails/ls1/pajls/f)\" = 3 ]\n"
+        "[ \"$(stat -c %h /jails/ls1/pajls/g)\" = 1 ]\n"
+        + shq(pajail_path()) + " rm /jails/ls1\n"
+        + gc + "[ \"$(stat -c %h /jails/ls2/pajls/f)\" = 2 ]\n"
+        "rm /jails/ls2/pajls/f\n"
+        + gc + "[ -z \"$(find /pajstore -type f -links 1)\" ]\n"
+        // a store inside the jail is refused
+        "printf 'enablejail /jails/**\\nlinkstore /jails/ls3/store\\n' > /etc/pa-jail.conf\n"
+        "if " + add + " /jails/ls3 pajtest 2>/dev/null; then exit 1; fi\n"
+        "printf 'enablejail /jails/**\\nlinkstore /pajstore\\n' > /etc/pa-jail.conf\n"
+        // `-u` chowns a root-owned hard link that is not a store entry
+        "rm -rf /jails/ls2/pajlsu; mkdir /jails/ls2/pajlsu; echo h > /jails/ls2/pajlsu/h; "
+        "ln /jails/ls2/pajlsu/h /jails/ls2/pajlsu/h2\n"
+        "echo s > /pajls/s\n"
+        + shq(pajail_path()) + " add -F /pajls/s /jails/ls2 pajtest\n"
+        "ln /jails/ls2/pajls/s /jails/ls2/pajlsu/s\n";
+    jr.options = "-u /jails/ls2/pajlsu";
+    jr.command = "read x < /pajls/f; read y < /pajls/g; echo >> /pajlsu/h "
+        "&& ! (echo >> /pajlsu/s) 2>/dev/null && echo \"linkstore:$x:$y\"";
+    expect_output("linkstore", jr, "linkstore:f:g");
+    printf("test-pa-jail: linkstore ok (shared across jails, writable file copied, gc, "
+           "store inside jail refused, only store entries kept root's)\n");
+}
+
+// `--overlay`: the manifest populates only the skeleton, the jail root is an
+// overlay of it, and the run's writes land in `.pa-overlay/upper` while the
+// home directory stays the jail directory's own.
+static void test_overlay() {
+    jail_run jr;
+    jr.conf = "enablejail /jails/**\nenableskeleton /pajskel\n";
+    jr.user_shell = "/bin/sh";
+    jr.manifest = shell_manifest("/bin/sh");
+    jr.manifest.push_back("/pajov/f");
+    jr.jaildir = "/jails/ov";
+    jr.options = "-S /pajskel --overlay";
+    jail_run first = jr;
+    first.command = "echo w > /home/pajtest/w";
+    jr.setup = "rm -rf /pajov /pajskel; mkdir /pajov; echo ov > /pajov/f\n"
+        + shq(pajail_path()) + " add -h " + shq(jr.jaildir) + " pajtest\n"
+        "echo code > /jails/ov/home/pajtest/c\n"
+        + pajail_command(first) + "\n"
+        "[ -f /pajskel/pajov/f ]\n"
+        "[ ! -e /jails/ov/pajov ]\n"
+        "[ ! -e /jails/ov/bin ]\n"
+        "[ -L /jails/ov/.pa-overlay/upper/dev/ptmx ]\n"
+        "[ -f /jails/ov/home/pajtest/w ]\n";
+    jr.command = "read x < /pajov/f; read y < /home/pajtest/c; read z < /home/pajtest/w; "
+        "echo \"overlay:$x:$y:$z\"";
+    expect_output("overlay", jr, "overlay:ov:code:w");
+    printf("test-pa-jail: overlay ok (skeleton as lower layer, writes in upper, home bound)\n");
+}
+
+// `[libs]`: a manifest naming only the shell gets its interpreter and shared
+// libraries from pa-jail's own ELF reader, with no `ldd`.
+static void test_libs() {
+    jail_run jr;
+    jr.conf = "enablejail /jails/**\n";
+    jr.user_shell = "/bin/sh";
+    jr.manifest = {"/bin/sh [libs]", "/pajlibs/run [libs]"};
+    jr.jaildir = "/jails/libs";
+    jr.setup = "rm -rf /pajlibs; mkdir /pajlibs; "
+        "printf '#!/bin/sh\\necho libs:ok\\n' > /pajlibs/run; chmod 755 /pajlibs/run\n";
+    jr.command = "/pajlibs/run";
+    expect_output("libs", jr, "libs:ok");
+    printf("test-pa-jail: libs ok (interpreter and libraries found without ldd)\n");
+}
+
+// `[bind-ro auto FILES]`: the scaffold's tag is the fingerprint of `FILES`, as
+// `pa-jail fingerprint` prints it, so a changed source rebuilds the scaffold
+// though the manifest text is the same.
+static void test_bind_auto() {
+    jail_run jr;
+    jr.conf = "enablejail /jails/**\n";
+    jr.user_shell = "/bin/sh";
+    std::string files;
+    for (const std::string& f : shell_manifest("/bin/sh")) {
+        files += f + "\n";
+    }
+    files += "/pajfp/f\n";
+    jr.manifest = {"/ <- /pajfpskel [bind-ro auto /pajfp.files]",
+                   "/home/pajtest <- /jails/fp/home/pajtest [bind]"};
+    jr.jaildir = "/jails/fp";
+    jr.options = "-h -B /jails/fpbind";
+    jail_run first = jr;
+    first.command = "true";
+    std::string fp = shq(pajail_path()) + " fingerprint --cache /pajfp.cache /pajfp.files";
+    // the scaffold source needs the mount points a full jail would have
+    jr.setup = "rm -rf /pajfp /pajfpskel /pajfp.cache; mkdir /pajfp; echo one > /pajfp/f; "
+        "mkdir -p /pajfpskel/proc /pajfpskel/dev/pts /pajfpskel/tmp /pajfpskel/home/pajtest; "
+        "ln -s pts/ptmx /pajfpskel/dev/ptmx\n"
+        + shq(pajail_path()) + " add -h /jails/fp pajtest\n"
+        "cat > /pajfp.files <<'PAJFILES'\n" + files + "PAJFILES\n"
+        "fp1=$(" + fp + "); [ \"$(" + fp + ")\" = \"$fp1\" ]\n"
+        + pajail_command(first) + "\n"
+        "[ \"$(cat /pajfpskel/.pa-jail-bindtag)\" = \"$fp1\" ]\n"
+        "echo two > /pajfp/f; [ \"$(" + fp + ")\" != \"$fp1\" ]\n";
+    jr.command = "read x < /pajfp/f; echo \"bindauto:$x\"";
+    expect_output("bind-auto", jr, "bindauto:two");
+    printf("test-pa-jail: bind-auto ok (scaffold rebuilt when a named file changes)\n");
+}
+
+// `prepare` tops a pool up to N populated jails, and `run --pool` starts from
+// one of them: the marker left in the prepared jails is in the run's jail. A
+// jail prepared from another manifest is not claimed, and is removed by the
+// next `prepare`.
+static void test_pool() {
+    jail_run jr;
+    jr.conf = "enablejail /jails/**\n";
+    jr.user_shell = "/bin/sh";
+    jr.manifest = shell_manifest("/bin/sh");
+    jr.jaildir = "/jails/pj";
+    jr.options = "--pool /jails/pjpool";
+    std::string pj = shq(pajail_path());
+    std::string prepare = pj + " prepare";
+    for (const std::string& f : jr.manifest) {
+        prepare += " -F " + shq(f);
+    }
+    std::string add = prepare;
+    prepare += " /jails/pjpool 2\n";
+    std::string other = add + " -F /pajpoolx /jails/pjpool 1\n";
+    add.replace(add.find(" prepare"), 8, " add --pool /jails/pjpool");
+    jr.setup = pj + " rm -f /jails/pj; " + pj + " rm -f /jails/pj2; "
+        + pj + " rm -f /jails/pjpool\n"
+        "echo x > /pajpoolx\n"
+        + other + "for d in /jails/pjpool/ready.*; do touch $d/pjother; done\n"
+        + add + " /jails/pj2 pajtest\n"
+        "[ ! -e /jails/pj2/pjother ]\n"
+        "[ \"$(ls /jails/pjpool | wc -l)\" = 1 ]\n"
+        + prepare + "[ \"$(ls /jails/pjpool | wc -l)\" = 2 ]\n"
+        "[ -z \"$(ls /jails/pjpool/*/pjother 2>/dev/null)\" ]\n"
+        + prepare + "[ \"$(ls /jails/pjpool | wc -l)\" = 2 ]\n"
+        "for d in /jails/pjpool/ready.*; do touch $d/pjmark; done\n";
+    jr.command = "[ -f /pjmark ] && echo pool:claimed";
+    expect_output("pool", jr, "pool:claimed");
+    printf("test-pa-jail: pool ok (topped up to N, run claims a prepared jail, "
+           "other manifest's jail unclaimed and removed)\n");
+}
+
+// `clone` copies a populated jail, hard-linking its root-owned files, and a run
+// in the clone works: the marker left in the golden jail is in the clone.
+static void test_clone() {
+    jail_run jr;
+    jr.conf = "enablejail /jails/**\n";
+    jr.user_shell = "/bin/sh";
+    jr.manifest = shell_manifest("/bin/sh");
+    jr.jaildir = "/jails/cj";
+    std::string pj = shq(pajail_path());
+    std::string add = pj + " add";
+    for (const std::string& f : jr.manifest) {
+        add += " -F " + shq(f);
+    }
+    jr.setup = pj + " rm -f /jails/cj; " + pj + " rm -f /jails/cg\n"
+        + add + " /jails/cg\n"
+        "echo golden > /jails/cg/cmark\n"
+        + pj + " clone /jails/cg /jails/cj\n"
+        "[ /jails/cj/cmark -ef /jails/cg/cmark ]\n"
+        "! " + pj + " clone /jails/cg /jails/cj 2>/dev/null\n";
+    jr.command = "read x < /cmark; echo \"clone:$x\"";
+    expect_output("clone", jr, "clone:golden");
+    printf("test-pa-jail: clone ok (golden jail cloned by hard links, run in clone)\n");
+}
+
+// `reap --once` removes the `~.` jails in a directory and leaves the others,
+// and its status file reports the work done.
+static void test_reap() {
+    jail_run jr;
+    jr.conf = "enablejail /jails/**\n";
+    jr.user_shell = "/bin/sh";
+    jr.manifest = shell_manifest("/bin/sh");
+    jr.jaildir = "/jails/rp/live";
+    std::string pj = shq(pajail_path());
+    jr.setup = pj + " rm -f /jails/rp/old~.1; " + pj + " rm -f /jails/rp/old~.2\n"
+        + pj + " add -F /bin/sh /jails/rp/old~.1\n"
+        + pj + " add -F /bin/sh /jails/rp/old~.2\n"
+        + pj + " add -F /bin/sh /jails/rp/live\n"
+        + pj + " reap --once --status /pajreap.json /jails/rp\n"
+        "[ ! -e /jails/rp/old~.1 ]\n"
+        "[ ! -e /jails/rp/old~.2 ]\n"
+        "[ -d /jails/rp/live ]\n"
+        "grep -q '\"backlog\":0,\"removed\":2,' /pajreap.json\n";
+    jr.command = "echo reap:ok";
+    expect_output("reap", jr, "reap:ok");
+    printf("test-pa-jail: reap ok (old jails removed, live jail kept, status written)\n");
+}
+
+// `pa-jail recycle` swaps a fresh jail into place and sets the old one aside
+// for removal.
+static void test_recycle() {
+    jail_run jr;
+    jr.conf = "enablejail /jails/**\n";
+    jr.user_shell = "/bin/sh";
+    jr.manifest = shell_manifest("/bin/sh");
+    jr.jaildir = "/jails/rc/live";
+    std::string pj = shq(pajail_path());
+    std::string add = pj + " add";
+    for (const std::string& f : jr.manifest) {
+        add += " -F " + shq(f);
+    }
+    jr.setup = pj + " rm -f /jails/rc\n"
+        + add + " /jails/rc/live\n"
+        "echo old > /jails/rc/live/marker\n"
+        + add + " /jails/rc/fresh\n"
+        "echo new > /jails/rc/fresh/marker\n"
+        + pj + " recycle --no-rm /jails/rc/live /jails/rc/fresh\n"
+        "[ ! -e /jails/rc/fresh ] && grep -q old /jails/rc/live~.*/marker\n"
+        + add + " /jails/rc/fresh\n"
+        "echo newer > /jails/rc/fresh/marker\n"
+        + pj + " recycle /jails/rc/live /jails/rc/fresh\n";
+    jr.command = "read x < /marker && echo \"recycle:$x\"";
+    expect_output("recycle", jr, "recycle:newer");
+    printf("test-pa-jail: recycle ok (fresh jail swapped in, old jail set aside)\n");
+}
+
+// `--chown-user` gives the jail user nested and sibling directories in one
+// walk, and leaves a file whose owner is already right unchanged. A target
+// on another file system is walked too.
+static void test_chown() {
+    jail_run jr;
+    jr.conf = "enablejail /jails/**\n";
+    jr.user_shell = "/bin/sh";
+    jr.manifest = shell_manifest("/bin/sh");
+    jr.jaildir = "/jails/cu";
+    std::string pj = shq(pajail_path());
+    std::string add = pj + " add";
+    for (const std::string& f : jr.manifest) {
+        add += " -F " + shq(f);
+    }
+    jr.setup = "umount /jails/cu/cd3 2>/dev/null || true\n"
+        + pj + " rm -f /jails/cu\n"
+        + add + " /jails/cu\n"
+        "mkdir -p /jails/cu/cd1/sub /jails/cu/cd2 /jails/cu/cd3\n"
+        "echo a > /jails/cu/cd1/sub/f; echo b > /jails/cu/cd2/f\n"
+        "chown pajtest /jails/cu/cd2/f\n"
+        "mount -t tmpfs -o size=1m none /jails/cu/cd3; mkdir /jails/cu/cd3/sub\n";
+    jr.options = "-u /jails/cu/cd1/sub -u /jails/cu/cd1 -u /jails/cu/cd2/f -u /jails/cu/cd3";
+    jr.command = "echo c >> /cd1/sub/f && echo > /cd1/new && echo d >> /cd2/f "
+        "&& ! (echo > /cd2/new) 2>/dev/null && echo > /cd3/sub/new && echo chown:ok";
+    expect_output("chown", jr, "chown:ok");
+    printf("test-pa-jail: chown ok (nested and file targets chowned in one walk, "
+           "target on another file system)\n");
+}
+
+// `--idmap-home` lets the user write a home directory that is owned by root
+// on disk (or, where idmapped mounts are unsupported, chowns it instead). A
+// file the user made setuid there, and a `chmod` of the home, are undone by
+// the next run.
+static void test_idmap_home() {
+    jail_run jr;
+    jr.conf = "enablejail /jails/**\n";
+    jr.user_shell = "/bin/sh";
+    jr.manifest = shell_manifest("/bin/sh");
+    jr.jaildir = "/jails/ih";
+    std::string pj = shq(pajail_path());
+    std::string add = pj + " add";
+    for (const std::string& f : jr.manifest) {
+        add += " -F " + shq(f);
+    }
+    for (const std::string& f : shell_manifest("/bin/chmod")) {
+        add += " -F " + shq(f);
+    }
+    std::string run = pj + " run -q -h --idmap-home --fg /jails/ih pajtest ";
+    jr.setup = pj + " rm -f /jails/ih\n"
+        + add + " /jails/ih\n"
+        "mkdir -p /jails/ih/home/pajtest && chmod 700 /jails/ih/home/pajtest\n"
+        "echo old > /jails/ih/home/pajtest/f\n"
+        + run + shq("echo > ~/s && chmod 4755 ~/s && chmod 755 ~") + "\n"
+        "[ -u /jails/ih/home/pajtest/s ]\n"
+        "[ \"$(stat -c %u /jails/ih/home/pajtest/s)\" = 0 ]\n"
+        + run + "true\n"
+        "[ ! -u /jails/ih/home/pajtest/s ]\n"
+        "[ \"$(stat -c %a /jails/ih/home/pajtest)\" = 700 ]\n";
+    jr.options = "-h --idmap-home";
+    jr.command = "read x < ~/f && echo new >> ~/f && echo > ~/g && echo \"idmap:$x\"";
+    expect_output("idmap-home", jr, "idmap:old");
+    printf("test-pa-jail: idmap-home ok (root-owned home writable by the user, "
+           "setuid bit and home mode reset)\n");
+}
+
+// Where the home cannot be idmapped (here, because the jail is on a ramfs),
+// `--idmap-home` chows it instead, and the run goes ahead.
+static void test_idmap_home_fallback() {
+    jail_run jr;
+    jr.conf = "enablejail /jails/**\n";
+    jr.user_shell = "/bin/sh";
+    jr.manifest = shell_manifest("/bin/sh");
+    jr.jaildir = "/jails/ihf";
+    std::string pj = shq(pajail_path());
+    std::string add = pj + " add";
+    for (const std::string& f : jr.manifest) {
+        add += " -F " + shq(f);
+    }
+    jr.setup = "umount /jails/ihf 2>/dev/null || true\n"
+        + pj + " rm -f /jails/ihf\n"
+        "mkdir -p /jails/ihf && mount -t ramfs -o mode=755 ramfs /jails/ihf\n"
+        + add + " /jails/ihf\n"
+        "mkdir -p /jails/ihf/home/pajtest && chmod 700 /jails/ihf/home/pajtest\n"
+        "echo old > /jails/ihf/home/pajtest/f\n";
+    jr.options = "-V -h --idmap-home";
+    jr.command = "read x < ~/f && echo new >> ~/f && echo > ~/g && echo \"idmap:$x\"";
+    auto [out, code] = run_jail(jr);
+    bool fellback = out.find("chowning instead") != std::string::npos;
+    bool ran = out.find("idmap:old") != std::string::npos;
+    if (!fellback || !ran || verbose || pa_verbose) {
+        fprintf(stderr, "[idmap-home-fallback] exit=%d, output:\n%s\n", code, out.c_str());
+    }
+    if (!fellback || !ran) {
+        fprintf(stderr, "test-pa-jail: idmap-home-fallback FAILED: fell-back=%d ran=%d\n",
+                fellback, ran);
+        exit(1);
+    }
+    printf("test-pa-jail: idmap-home-fallback ok (unmappable home chowned instead)\n");
+}
+
+// Runs `argv[1]` under a seccomp filter that fails `fsopen` and `open_tree`
+// with ENOSYS, as on a kernel without the file descriptor mount API (or under
+// an older container runtime's filter).
+static const char NOMOUNTAPI_SRC[] = R"NM(#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+int main(int argc, char** argv) {
+    struct sock_filter f[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SYS_fsopen, 1, 0),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SYS_open_tree, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | ENOSYS),
+        BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW)
+    };
+    struct sock_fprog prog = {sizeof(f) / sizeof(f[0]), f};
+    if (argc < 2 || prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0
+        || prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) != 0) {
+        perror("nomountapi");
+        return 1;
+    }
+    execv(argv[1], argv + 1);
+    perror(argv[1]);
+    return 1;
+}
+)NM";
+
+// `[bind-ro]` of a directory with a file system mounted below it makes both
+// read-only, whether the mounts are made with the file descriptor mount API
+// or, where that is unavailable, with `mount(2)` and remounts.
+static void test_bind_ro() {
+    jail_run jr;
+    jr.conf = "enablejail /jails/**\n";
+    jr.user_shell = "/bin/sh";
+    jr.manifest = shell_manifest("/bin/sh");
+    jr.manifest.push_back("/pajbro <- /pajbro [bind-ro]");
+    jr.options = "-V";
+    jr.command = "read g < /pajbro/sub/g; (echo > /pajbro/sub/new) 2>/dev/null "
+        "|| echo \"bindro:$g\"; while read d m t o r; do case \"$m\" in "
+        "/pajbro/sub) echo \"bindro-sub=$o\";; esac; done < /proc/mounts";
+    for (bool api : {true, false}) {
+        const char* name = api ? "bind-ro" : "bind-ro-fallback";
+        jr.jaildir = api ? "/jails/bro" : "/jails/brofb";
+        jr.setup = shq(pajail_path()) + " rm -f " + jr.jaildir + "\n"
+            "umount /pajbro/sub 2>/dev/null || true\n"
+            "rm -rf /pajbro; mkdir -p /pajbro/sub; "
+            "mount -t tmpfs tmpfs /pajbro/sub; echo g > /pajbro/sub/g\n";
+        if (!api) {
+            jr.setup += "cat > /tmp/nomountapi.c <<'NOMOUNTAPI_EOF'\n"
+                + std::string(NOMOUNTAPI_SRC) + "NOMOUNTAPI_EOF\n"
+                "cc -static -O2 -o /usr/local/bin/nomountapi /tmp/nomountapi.c\n";
+            jr.wrapper = "/usr/local/bin/nomountapi";
+        }
+        auto [out, code] = run_jail(jr);
+        bool ro = out.find("bindro:g") != std::string::npos
+            && out.find("bindro-sub=ro,") != std::string::npos;
+        // `-V` shows the calls each mount took
+        bool path = out.find("/pajbro: " + std::string(api ? "open_tree" : "mount ")) != std::string::npos;
+        if (!ro || !path || verbose || pa_verbose) {
+            fprintf(stderr, "[%s] exit=%d, output:\n%s\n", name, code, out.c_str());
+        }
+        if (!ro || !path) {
+            fprintf(stderr, "test-pa-jail: %s FAILED: submount-read-only=%d expected-mount-path=%d\n",
+                    name, ro, path);
+            exit(1);
+        }
+    }
+    printf("test-pa-jail: bind-ro ok (submount read-only with the mount API and with mount(2))\n");
+}
+
 // True if a running container is using `image` -- i.e. another test-pa-jail run.
 static bool image_in_use(const std::string& image) {
     auto [out, code] = capture("docker ps -q --filter ancestor=" + image);
@@ -746,6 +1317,24 @@ int main(int argc, char** argv) {
     test_dev_allowlist();
     test_default_limits();
     test_userns();
+    test_jobs();
+    test_alias();
+    test_jail_symlink();
+    test_symlink_chain();
+    test_manifest_cache();
+    test_plan();
+    test_linkstore();
+    test_overlay();
+    test_libs();
+    test_bind_auto();
+    test_bind_ro();
+    test_pool();
+    test_clone();
+    test_reap();
+    test_recycle();
+    test_chown();
+    test_idmap_home();
+    test_idmap_home_fallback();
     test_cgroup();
     test_rlimit();
     test_forkbomb();
@@ -1,10 +1,32 @@
 #undef NDEBUG
 #include "pa-jailconf.hh"
 #include "pa-jutil.hh"
+#include "pa-jbatch.hh"
+#include "pa-jdirfd.hh"
+#include "pa-jpath.hh"
+#include "pa-jmanifest.hh"
+#include "pa-jelf.hh"
+#include "pa-jfingerprint.hh"
+#include "pa-jpwcache.hh"
+#include "pa-jmountinfo.hh"
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
 #include <cstdio>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <string>
+#include <vector>
+#include <fcntl.h>
+#include <pwd.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if __APPLE__
+#define st_atim st_atimespec
+#define st_mtim st_mtimespec
+#endif
 
 // True if `f()` throws a `pajailconf_error`.
 template <typename F>
@@ -709,6 +731,49 @@ void test_pajailconf_cgroup() {
     assert(pool_of(jc,"/p")[JLIMIT_PIDS_MAX].value == 64);
 }
 
+void test_pajailconf_linkstore() {
+    // no `linkstore` directive -> no store
+    pajailconf jc("enablejail /jails/**\n");
+    assert(jc.get("/jails/a").linkstore.empty());
+
+    // scoped like `cgroupbase`: a top-level default, overridden in sections,
+    // and `none` turns it off
+    jc = pajailconf("enablejail /jails/**\n"
+                    "linkstore /jails-store\n"
+                    "[/jails/build/*]\nlinkstore /jails-store/build\n"
+                    "[/jails/private/*]\nlinkstore none\n");
+    assert(jc.get("/jails/a").linkstore == "/jails-store");
+    assert(jc.get("/jails/build/x").linkstore == "/jails-store/build");
+    assert(jc.get("/jails/private/x").linkstore.empty());
+
+    // the store must be an absolute path
+    assert(throws_config_error([] { pajailconf("linkstore store\n").get("/a"); }));
+    assert(throws_config_error([] { pajailconf("linkstore\n").get("/a"); }));
+}
+
+void test_pajailconf_pwcache() {
+    pajailconf jc("enablejail /jails/**\n");
+    assert(jc.get("/jails/a").pwcache.empty());
+    assert(jc.get("/jails/a").pwcache_ttl == default_pwcache_ttl);
+
+    // scoped like `linkstore`, with an optional lifetime
+    jc = pajailconf("enablejail /jails/**\n"
+                    "pwcache /var/cache/pa-jail.pw\n"
+                    "[/jails/ldap/*]\npwcache /var/cache/pa-jail-ldap.pw 3600\n"
+                    "[/jails/private/*]\npwcache none\n");
+    assert(jc.get("/jails/a").pwcache == "/var/cache/pa-jail.pw");
+    assert(jc.get("/jails/a").pwcache_ttl == default_pwcache_ttl);
+    assert(jc.get("/jails/ldap/x").pwcache == "/var/cache/pa-jail-ldap.pw");
+    assert(jc.get("/jails/ldap/x").pwcache_ttl == 3600);
+    assert(jc.get("/jails/private/x").pwcache.empty());
+
+    assert(throws_config_error([] { pajailconf("pwcache cache\n").get("/a"); }));
+    assert(throws_config_error([] { pajailconf("pwcache\n").get("/a"); }));
+    assert(throws_config_error([] { pajailconf("pwcache /c 0\n").get("/a"); }));
+    assert(throws_config_error([] { pajailconf("pwcache /c 10s\n").get("/a"); }));
+    assert(throws_config_error([] { pajailconf("pwcache none 10\n").get("/a"); }));
+}
+
 // The jaillimitinfo table: each row sits at its `jaillimit_id` index, its name
 // round-trips through lookup(), and the cgroup limits are exactly the contiguous
 // head `[JLIMIT_CGROUP_FIRST, JLIMIT_CGROUP_LAST)` (the rest are rlimits).
@@ -1143,6 +1208,15 @@ void test_path_pa_validate() {
     assert(path_pa_validate(std::string(1024, 'a')).empty());
 }
 
+void test_json_quote() {
+    assert(json_quote("") == "\"\"");
+    assert(json_quote("/usr/bin/a b") == "\"/usr/bin/a b\"");
+    assert(json_quote("a\"b\\c") == "\"a\\\"b\\\\c\"");
+    assert(json_quote("a\nb\tc\x01\x7F") == "\"a\\nb\\tc\\u0001\\u007f\"");
+    // other bytes pass through
+    assert(json_quote("caf\xc3\xa9") == "\"caf\xc3\xa9\"");
+}
+
 void test_shell_quote() {
     // entirely-safe strings are returned verbatim (no quoting)
     assert(shell_quote("abc") == "abc");
@@ -1324,6 +1398,629 @@ void fuzz_shell_quote() {
     }
 }
 
+// A fresh, empty scratch directory for filesystem tests (under $TMPDIR or
+// /tmp); `rm_scratch_dir` removes it and everything in it.
+static std::string scratch_dir() {
+    const char* tmp = getenv("TMPDIR");
+    std::string templ = std::string(tmp && *tmp ? tmp : "/tmp") + "/test-pa-jailconf.XXXXXX";
+    char* d = mkdtemp(templ.data());
+    assert(d != nullptr);
+    return templ;
+}
+
+static void rm_scratch_dir(const std::string& dir) {
+    std::string cmd = "rm -rf " + shell_quote(dir);
+    int r = system(cmd.c_str());
+    assert(r == 0);
+}
+
+static void write_at(int fd, off_t off, const char* s) {
+    assert(pwrite(fd, s, strlen(s), off) == (ssize_t) strlen(s));
+}
+
+void test_copy_file() {
+    std::string dir = scratch_dir();
+    std::string src = dir + "/src", dst = dir + "/dst";
+
+    // a sparse source: data, a 1 MiB hole, data, then a trailing hole
+    int fd = open(src.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+    assert(fd >= 0);
+    write_at(fd, 0, "hello");
+    write_at(fd, 1 << 20, "world");
+    assert(ftruncate(fd, 4 << 20) == 0);
+    close(fd);
+    assert(chmod(src.c_str(), 02751) == 0);
+    struct timespec ts[2] = {{1000000000, 123456789}, {1200000000, 987654321}};
+    assert(utimensat(AT_FDCWD, src.c_str(), ts, 0) == 0);
+
+    struct stat ss, ds;
+    assert(lstat(src.c_str(), &ss) == 0);
+    copy_result cr;
+    assert(copy_file_at(AT_FDCWD, src.c_str(), AT_FDCWD, dst.c_str(), &ss, cr) == 0);
+    assert(lstat(dst.c_str(), &ds) == 0);
+    // like `cp -p`: mode (with set-id bits), owner, times, size preserved
+    assert(ds.st_mode == ss.st_mode);
+    assert(ds.st_uid == ss.st_uid && ds.st_gid == ss.st_gid);
+    assert(ds.st_size == 4 << 20);
+    assert(ds.st_mtim.tv_sec == 1200000000 && ds.st_mtim.tv_nsec == 987654321);
+    assert(ds.st_atim.tv_sec == 1000000000 && ds.st_atim.tv_nsec == 123456789);
+    // the holes were not filled in (when the file system has holes at all)
+    assert(ss.st_blocks * 512 >= ss.st_size || ds.st_blocks <= ss.st_blocks + 16);
+    assert(cr.bytes <= (unsigned long long) ss.st_size);
+    assert(cr.method != COPY_EMPTY);
+    std::string sc = file_get_contents(src), dc = file_get_contents(dst);
+    assert(sc.size() == (size_t) (4 << 20) && sc == dc);
+
+    // reflink mode clones where the file system can, else copies; the result
+    // is the same file either way
+    std::string dst2 = dir + "/dst2";
+    assert(copy_file_at(AT_FDCWD, src.c_str(), AT_FDCWD, dst2.c_str(), &ss, cr, true) == 0);
+    assert(lstat(dst2.c_str(), &ds) == 0);
+    assert(ds.st_mode == ss.st_mode && ds.st_size == ss.st_size);
+    assert(ds.st_mtim.tv_sec == 1200000000 && ds.st_mtim.tv_nsec == 987654321);
+    assert(cr.method != COPY_REFLINK || cr.bytes == (unsigned long long) ss.st_size);
+    assert(file_get_contents(dst2) == sc);
+
+    // the destination must not already exist
+    assert(copy_file_at(AT_FDCWD, src.c_str(), AT_FDCWD, dst.c_str(), &ss, cr) == -1
+           && errno == EEXIST);
+    assert(unlink(dst.c_str()) == 0);
+
+    // a source replaced since it was examined is refused, and leaves no copy
+    struct stat other = ss;
+    ++other.st_ino;
+    assert(copy_file_at(AT_FDCWD, src.c_str(), AT_FDCWD, dst.c_str(), &other, cr) == -1
+           && errno == ESTALE);
+    assert(lstat(dst.c_str(), &ds) == -1 && errno == ENOENT);
+
+    // symbolic links are not followed, at either end
+    std::string lnk = dir + "/lnk";
+    assert(symlink("src", lnk.c_str()) == 0);
+    assert(copy_file_at(AT_FDCWD, lnk.c_str(), AT_FDCWD, dst.c_str(), nullptr, cr) == -1);
+    assert(copy_file_at(AT_FDCWD, src.c_str(), AT_FDCWD, lnk.c_str(), nullptr, cr) == -1);
+
+    // relative to directory fds; an empty file moves no data
+    int dirfd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    assert(dirfd >= 0);
+    fd = openat(dirfd, "empty", O_WRONLY | O_CREAT | O_EXCL, 0644);
+    assert(fd >= 0);
+    close(fd);
+    assert(copy_file_at(dirfd, "empty", dirfd, "empty2", nullptr, cr) == 0);
+    assert(cr.method == COPY_EMPTY && cr.bytes == 0);
+    assert(fstatat(dirfd, "empty2", &ds, AT_SYMLINK_NOFOLLOW) == 0
+           && S_ISREG(ds.st_mode) && ds.st_size == 0 && (ds.st_mode & 07777) == 0644);
+    close(dirfd);
+
+    rm_scratch_dir(dir);
+}
+
+// One `fsbatch` workload: make a small tree, stat it, link within it, and
+// remove it, checking each result.
+static void check_fsbatch(fsbatch& b) {
+    std::string dir = scratch_dir();
+    int dirfd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    assert(dirfd >= 0);
+    int fd = openat(dirfd, "f", O_WRONLY | O_CREAT | O_EXCL, 0644);
+    assert(fd >= 0);
+    write_at(fd, 0, "data");
+    close(fd);
+
+    int r[8];
+    b.mkdirat(dirfd, "d", 0750, &r[0]);
+    b.then();
+    b.symlinkat("../f", dirfd, "d/s", &r[1]);
+    b.linkat(dirfd, "f", dirfd, "g", &r[2]);
+    b.mkdirat(dirfd, "f", 0755, &r[3]);         // fails: exists
+    b.submit();
+    assert(r[0] == 0 && r[1] == 0 && r[2] == 0 && r[3] == -EEXIST);
+
+    struct stat st[3];
+    b.lstat(dirfd, "d", &st[0], &r[0]);
+    b.lstat(dirfd, "d/s", &st[1], &r[1]);
+    b.lstat(AT_FDCWD, dir + "/g", &st[2], &r[2]);
+    b.lstat(dirfd, "nonexistent", &st[0] + 0, &r[3]);
+    b.submit();
+    assert(r[0] == 0 && S_ISDIR(st[0].st_mode) && (st[0].st_mode & 0777) == 0750);
+    assert(r[1] == 0 && S_ISLNK(st[1].st_mode) && st[1].st_size == 4);
+    assert(r[2] == 0 && S_ISREG(st[2].st_mode) && st[2].st_nlink == 2 && st[2].st_size == 4);
+    assert(r[3] == -ENOENT);
+    struct stat fst;
+    assert(fstatat(dirfd, "f", &fst, 0) == 0);
+    assert(fst.st_dev == st[2].st_dev && fst.st_ino == st[2].st_ino);
+    assert(fst.st_mtim.tv_sec == st[2].st_mtim.tv_sec
+           && fst.st_mtim.tv_nsec == st[2].st_mtim.tv_nsec);
+
+    // a chained call runs after its predecessor even if that failed
+    b.unlinkat(dirfd, "d/s", 0, &r[0]);
+    b.then();
+    b.unlinkat(dirfd, "d", AT_REMOVEDIR, &r[1]);
+    b.unlinkat(dirfd, "missing", 0, &r[2]);
+    b.then();
+    b.unlinkat(dirfd, "g", 0, &r[3]);
+    b.submit();
+    assert(r[0] == 0 && r[1] == 0 && r[2] == -ENOENT && r[3] == 0);
+    assert(b.size() == 0);
+
+    // a batch larger than any ring
+    std::vector<int> rs(600);
+    for (int i = 0; i != 300; ++i) {
+        b.mkdirat(dirfd, "m" + std::to_string(i), 0700, &rs[2 * i]);
+        b.then();
+        b.unlinkat(dirfd, "m" + std::to_string(i), AT_REMOVEDIR, &rs[2 * i + 1]);
+    }
+    b.submit();
+    for (int x : rs) {
+        assert(x == 0);
+    }
+
+    close(dirfd);
+    rm_scratch_dir(dir);
+}
+
+static void test_fsbatch() {
+    fsbatch sync;
+    check_fsbatch(sync);
+    assert(!sync.uring() && sync.nops == 612 && sync.nsyscalls == 612);
+
+    fsbatch ring;
+    if (ring.init_uring(64)) {
+        check_fsbatch(ring);
+        assert(ring.nops == 612 && ring.nsyscalls < 612);
+    }
+}
+
+static void test_dirfd_cache() {
+    std::string dir = scratch_dir();
+    std::string a = dir + "/a";
+    assert(mkdir(a.c_str(), 0755) == 0);
+    assert(mkdir((a + "/b").c_str(), 0755) == 0);
+    assert(mkdir((a + "/b/c").c_str(), 0755) == 0);
+    int fd = open((a + "/b/c/f").c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    assert(fd >= 0);
+    close(fd);
+    assert(symlink("b", (a + "/rel").c_str()) == 0);
+    assert(symlink("/a/b", (a + "/abs").c_str()) == 0);      // within the root
+    assert(symlink("../../../a", (a + "/up").c_str()) == 0); // clamped at the root
+    assert(symlink("loop", (dir + "/loop").c_str()) == 0);
+
+    dirfd_cache dc(2);
+    dc.set_root(dir + "/");
+    assert(dc.root() == dir);
+    struct stat st;
+    std::string name;
+    int pfd = dc.parent(a + "/b/c/f", name);
+    assert(pfd >= 0 && name == "f");
+    assert(fstatat(pfd, "f", &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISREG(st.st_mode));
+    assert(dc.nopens == 4);             // root, a, b, c
+    assert(dc.lstat(a + "/b/c/f", &st) == 0 && S_ISREG(st.st_mode));
+    assert(dc.nopens == 4);
+    dc.release();
+
+    // symbolic links resolve within the root; a final one is not followed
+    assert(dc.lstat(a + "/rel/c/f", &st) == 0 && S_ISREG(st.st_mode));
+    assert(dc.lstat(a + "/abs/c/f", &st) == 0 && S_ISREG(st.st_mode));
+    assert(dc.lstat(a + "/up/b/c/./f", &st) == 0 && S_ISREG(st.st_mode));
+    assert(dc.lstat(a + "/b/../rel", &st) == 0 && S_ISLNK(st.st_mode));
+    assert(dc.lstat(dir + "/loop/f", &st) == -1 && errno == ELOOP);
+    assert(dc.lstat(a + "/b/c/f/g", &st) == -1 && errno == ENOTDIR);
+    assert(dc.lstat(a + "/missing/f", &st) == -1 && errno == ENOENT);
+    dc.release();
+
+    // outside the root, the kernel resolves the whole path
+    assert(dc.parent("/tmp/x", name) == AT_FDCWD && name == "/tmp/x");
+
+    // without a root, directories resolve as the kernel would
+    dirfd_cache host;
+    pfd = host.dir(a + "/rel/c");
+    assert(pfd >= 0 && fstatat(pfd, "f", &st, 0) == 0 && S_ISREG(st.st_mode));
+    pfd = host.dir(a + "/rel/c/../c");
+    assert(pfd >= 0 && host.nopens == 2 && host.nlookups == 2);
+    assert(host.dir(a + "/rel/c") >= 0 && host.nopens == 2);
+
+    // a root descriptor stands for the root's name
+    int rfd = open(a.c_str(), O_RDONLY | O_DIRECTORY);
+    assert(rfd >= 0);
+    dirfd_cache byfd;
+    byfd.set_root(dir, rfd);
+    close(rfd);
+    assert(byfd.root_fd() >= 0);
+    assert(byfd.lstat(dir + "/b/c/f", &st) == 0 && S_ISREG(st.st_mode));
+    assert(byfd.lstat(dir + "/a", &st) == -1 && errno == ENOENT);
+
+    // `openat_beneath` refuses symbolic links and `..`
+    int dfd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    assert(dfd >= 0);
+    fd = openat_beneath(dfd, "a/b/c", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0 || errno != ENOSYS) {
+        assert(fd >= 0 && fstatat(fd, "f", &st, 0) == 0);
+        close(fd);
+        assert(openat_beneath(dfd, "a/rel/c", O_RDONLY) == -1 && errno == ELOOP);
+        assert(openat_beneath(dfd, "a/../../x", O_RDONLY) == -1 && errno == EXDEV);
+    }
+    close(dfd);
+
+    rm_scratch_dir(dir);
+}
+
+static void test_dir_reader() {
+    std::string dir = scratch_dir();
+    std::vector<std::string> names;
+    // enough long names to take several minimum-size reads
+    for (int i = 0; i != 300; ++i) {
+        names.push_back(std::string(40, 'a' + i % 26) + std::to_string(i));
+        int fd = open((dir + "/" + names.back()).c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+        assert(fd >= 0);
+        close(fd);
+    }
+    names.push_back("sub");
+    assert(mkdir((dir + "/sub").c_str(), 0755) == 0);
+    std::sort(names.begin(), names.end());
+
+    dir_reader reader(4096);
+    for (int pass = 0; pass != 2; ++pass) {
+        int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+        assert(fd >= 0);
+        reader.open(fd);
+        std::vector<std::string> seen;
+        unsigned char type;
+        while (const char* name = reader.next(&type)) {
+            seen.push_back(name);
+            assert(type == DT_UNKNOWN
+                   || type == (seen.back() == "sub" ? DT_DIR : DT_REG));
+        }
+        assert(errno == 0);
+        close(fd);
+        std::sort(seen.begin(), seen.end());
+        assert(seen == names);
+    }
+    assert(reader.nreads > 4);
+
+    rm_scratch_dir(dir);
+}
+
+static void test_mount_index() {
+    mount_index mi;
+    mi.load_mountinfo(
+        "22 1 0:21 / / rw,relatime shared:1 - ext4 /dev/sda1 rw,errors=remount-ro\n"
+        "23 22 0:22 / /proc rw,nosuid,nodev,noexec,relatime shared:2 - proc proc rw\n"
+        "24 22 0:23 / /tmp rw,nosuid,nodev shared:3 - tmpfs tmpfs rw,size=1024k\n"
+        "30 22 0:30 / /jails/a/proc rw,nosuid master:2 - proc proc rw\n"
+        "31 22 0:31 / /jails/a/home\\040dir rw - tmpfs none rw\n"
+        "32 30 0:32 / /jails/a/proc/sys ro - sysfs sysfs rw\n"
+        "33 22 0:33 / /jails/ab rw - tmpfs tmpfs rw\n"
+        "34 24 0:34 / /tmp rw - tmpfs tmpfs2 ro\n");
+    assert(mi.size() == 8);
+    assert(mi.nparsed == 0);
+
+    // lookups parse only what they find; trailing slashes are ignored
+    const mountinfo_entry* e = mi.find("/proc/");
+    assert(e && e->id == 23 && e->parent_id == 22);
+    assert(e->fstype == "proc" && e->source == "proc");
+    assert(e->options == "rw,nosuid,nodev,noexec,relatime,rw");
+    assert(mi.nparsed == 1);
+    assert(!mi.find("/proc/self"));
+    assert(mi.find("/")->fstype == "ext4");
+    assert(mi.find("/jails/a/home dir")->source == "none");
+    assert(mi.contains("/jails/a/proc/") && !mi.contains("/jails/a"));
+
+    // the topmost of stacked mounts wins
+    e = mi.find("/tmp");
+    assert(e->id == 34 && e->source == "tmpfs2" && e->options == "rw,ro");
+    assert(mi.find_id(24)->options == "rw,nosuid,nodev,rw,size=1024k");
+    assert(!mi.find_id(99));
+
+    // `below` is strict, by directory, parents first
+    auto v = mi.below("/jails/a/");
+    assert(v.size() == 3);
+    assert(v[0]->id == 30 && v[1]->id == 31 && v[2]->id == 32);
+    assert(mi.below("/jails/a/proc/sys/").empty());
+
+    // the running system's table has a root
+    mount_index live;
+    assert(live.load() && live.loaded);
+    assert(live.size() > 0 && live.contains("/"));
+}
+
+static void test_passwd_cache() {
+    std::string dir = scratch_dir();
+    std::string file = dir + "/pw";
+    struct passwd* pw = getpwuid(geteuid());
+    assert(pw);
+    std::string me = pw->pw_name;
+    uid_t myuid = pw->pw_uid;
+    gid_t mygid = pw->pw_gid;
+    std::string nobody = "pa-jail-no-such-user";
+    uid_t u;
+    gid_t g;
+
+    // without a file, every lookup asks
+    passwd_cache pwc;
+    assert(pwc.lookup(me, &u, &g) && u == myuid && g == mygid);
+    assert(!pwc.lookup(nobody, &u, &g));
+    pwc.save();
+    assert(access(file.c_str(), F_OK) != 0);
+
+    // answers, found or not, persist in the file
+    pwc.open(file, 60);
+    assert(pwc.lookup(me, &u, &g) && !pwc.lookup(nobody, &u, &g));
+    assert(pwc.ncached == 0);
+    pwc.save();
+    passwd_cache pwc2;
+    pwc2.open(file, 60);
+    assert(pwc2.lookup(me, &u, &g) && u == myuid && g == mygid);
+    assert(!pwc2.lookup(nobody, &u, &g));
+    assert(pwc2.nlookups == 2 && pwc2.ncached == 2);
+
+    // a file others may write is ignored
+    assert(chmod(file.c_str(), 0622) == 0);
+    passwd_cache pwc3;
+    pwc3.open(file, 60);
+    assert(pwc3.lookup(me, &u, &g) && pwc3.ncached == 0);
+    assert(chmod(file.c_str(), 0600) == 0);
+
+    // an entry that outlives a shorter lifetime is dropped
+    int fd = open(file.c_str(), O_WRONLY | O_TRUNC);
+    std::string text = "pa-jail passwd cache 1\n"
+        + std::to_string(time(nullptr) + 1000) + " 1 1 " + me + "\n";
+    assert(write(fd, text.data(), text.length()) == (ssize_t) text.length());
+    close(fd);
+    passwd_cache pwc4;
+    pwc4.open(file, 60);
+    assert(pwc4.lookup(me, &u, &g) && u == myuid && pwc4.ncached == 0);
+
+    // a temporary name planted beside the file is not written through
+    int vfd = open((dir + "/victim").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert(vfd >= 0 && write(vfd, "v\n", 2) == 2);
+    close(vfd);
+    std::string prefix = file + "." + std::to_string(getpid()) + ".";
+    assert(link((dir + "/victim").c_str(), (prefix + "tmp").c_str()) == 0);
+    for (int i = 0; i != 32; ++i) {
+        assert(link((dir + "/victim").c_str(), (prefix + std::to_string(i) + ".tmp").c_str()) == 0);
+    }
+    pwc4.save();
+    struct stat vst;
+    assert(stat((dir + "/victim").c_str(), &vst) == 0 && vst.st_size == 2);
+
+    rm_scratch_dir(dir);
+}
+
+static void test_path_table() {
+    path_arena a;
+    std::string buf = "/usr/lib";
+    std::string_view v = a.intern(buf);
+    buf[1] = 'x';
+    assert(v == "/usr/lib" && a.nbytes == 8 && a.nchunks() == 1);
+    std::string big(100000, 'b');
+    assert(a.intern(big) == big && a.nchunks() == 2);
+    assert(a.intern("") == "" && v.data()[v.length()] == '\0');
+    a.clear();
+    assert(a.nbytes == 0 && a.nchunks() == 0);
+
+    // keys are copied on first insert; lookups borrow
+    path_table<int> t;
+    std::string key;
+    for (int i = 0; i != 5000; ++i) {
+        key = "/jails/j/d" + std::to_string(i % 97) + "/f" + std::to_string(i);
+        auto [v, inserted] = t.insert(key, i);
+        assert(inserted && *v == i);
+    }
+    key = "/jails/j/d3/f3";
+    assert(!t.insert(key, -1).second && *t.find(key) == 3);
+    key[0] = 'x';
+    assert(!t.find(key) && !t.contains("/jails/j/d3/f5000"));
+    assert(t.size() == 5000 && t.arena().nchunks() < 10);
+    for (int i = 0; i < 5000; i += 7) {
+        assert(*t.find("/jails/j/d" + std::to_string(i % 97) + "/f" + std::to_string(i)) == i);
+    }
+    t["/jails/j/d3/f3"] = 30;
+    assert(*t.find("/jails/j/d3/f3") == 30 && t.size() == 5000);
+    ++t["/new"];
+    assert(*t.find("/new") == 1 && t.size() == 5001);
+    t.clear();
+    assert(t.size() == 0 && !t.find("/new"));
+
+    // integer keys whose hash is the identity still spread out
+    flat_table<unsigned long, unsigned long> ft;
+    for (unsigned long i = 0; i != 100000; ++i) {
+        ft.insert(i << 12, i);
+    }
+    assert(ft.size() == 100000 && *ft.find(4095UL << 12) == 4095 && !ft.find(1));
+}
+
+static void test_sha256() {
+    assert(sha256_hex("") == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    assert(sha256_hex("abc") == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    assert(sha256_hex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq")
+           == "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    // a million `a`s, in uneven pieces that straddle blocks
+    sha256 h;
+    std::string a(997, 'a');
+    size_t n = 0;
+    for (; n + a.size() <= 1000000; n += a.size()) {
+        h.update(a);
+    }
+    h.update(a.data(), 1000000 - n);
+    auto d = h.digest();
+    assert(d[0] == 0xcd && d[1] == 0xc7 && d[30] == 0x2c && d[31] == 0xd0);
+}
+
+static void test_manifest_parse() {
+    std::string text =
+        "# comment\n"
+        "\n"
+        "/etc/passwd\n"
+        "  /usr/bin/env   \n"
+        "bin/sh\n"
+        "/usr/lib:\n"
+        "libc.so.6\n"
+        "/lib64/ld.so\n"
+        "ld.so <- /opt/ld.so\n"
+        "usr//:\n"
+        "share/ [cp]\n"
+        "/home/a <- /srv/a [bind-ro tag1 /srv/a.files]\n"
+        "/proc [mount proc rw,nosuid]\n"
+        "/sys [ bind x y ; mount sysfs ro ]\n"
+        "/x [cp; unknown words; libs]\n"
+        "[cp]\n"
+        "not a flag]\n"
+        ".:\n"
+        "a <- b\n";
+    manifest m;
+    m.parse(text);
+    auto& e = m.entries;
+    assert(e.size() == 13);
+    assert(e[0].src == "/etc/passwd" && e[0].dst == "/etc/passwd" && e[0].flags == 0);
+    assert(e[0].is_copy());
+    // at top level, an absolute destination is the text itself
+    assert(e[0].dst.data() == text.data() + text.find("/etc/passwd"));
+    assert(e[1].src == "/usr/bin/env" && e[1].dst == "/usr/bin/env");
+    assert(e[2].src == "/bin/sh" && e[2].dst == "/bin/sh");
+    assert(e[3].src == "/usr/lib/libc.so.6" && e[3].dst == "/usr/lib/libc.so.6");
+    assert(e[3].src.data() == e[3].dst.data());
+    // an absolute source keeps its destination under `DIR:`
+    assert(e[4].src == "/lib64/ld.so" && e[4].dst == "/usr/lib/lib64/ld.so");
+    assert(e[5].src == "/opt/ld.so" && e[5].dst == "/usr/lib/ld.so");
+    assert(e[6].src == "/usr/share/" && e[6].dst == "/usr/share/" && e[6].flags == FLAG_CP);
+    assert(e[7].src == "/srv/a" && e[7].dst == "/usr/home/a" && e[7].flags == FLAG_BIND_RO);
+    assert(e[7].bind_tag == "tag1" && e[7].bind_files == "/srv/a.files");
+    assert(!e[7].is_copy());
+    assert(e[8].src == "/proc" && e[8].flags == FLAG_MOUNT);
+    assert(e[8].mount_dst == "proc" && e[8].mount_args == "rw,nosuid");
+    assert(e[8].bind_tag.empty());
+    // a bind entry ignores `[mount]`
+    assert(e[9].flags == (FLAG_BIND | FLAG_MOUNT));
+    assert(e[9].bind_tag == "x" && e[9].bind_files == "y" && e[9].mount_dst.empty());
+    assert(e[10].src == "/x" && e[10].flags == (FLAG_CP | FLAG_LIBS));
+    // options with no path name the current directory
+    assert(e[11].src == "/usr/" && e[11].dst == "/usr/" && e[11].flags == FLAG_CP);
+    // a line ending in `]` without `[` is ignored
+    assert(e[12].src == "b" && e[12].dst == "/a");
+
+    // appending a second manifest
+    m.parse("/one\n/two/:\nthree\n");
+    assert(e.size() == 15 && e[13].dst == "/one" && e[14].dst == "/two/three");
+    m.add(std::string("/lib/x.so"), "/lib/x.so");
+    assert(e.size() == 16 && e[15].src == "/lib/x.so" && e[15].dst.data() == e[15].src.data());
+}
+
+static bool has_suffix(const std::vector<std::string>& v, std::string_view suffix) {
+    for (auto& s : v) {
+        if (s.ends_with(suffix)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void test_elf_resolver() {
+#if __linux__
+    int fd = open("/bin/sh", O_RDONLY | O_CLOEXEC);
+    assert(fd >= 0);
+    elf_info ei;
+    assert(elf_read(fd, ei));
+    close(fd);
+    assert(ei.elfclass != 0 && ei.machine != 0 && ei.interp.starts_with("/"));
+    assert(std::find(ei.needed.begin(), ei.needed.end(), "libc.so.6") != ei.needed.end());
+
+    elf_resolver r;
+    std::vector<std::string> out, missing;
+    assert(r.closure("/bin/sh", out, missing) && missing.empty());
+    assert(out[0] == ei.interp && has_suffix(out, "/libc.so.6"));
+    std::sort(out.begin(), out.end());
+    assert(std::adjacent_find(out.begin(), out.end()) == out.end());
+    // a second closure reads nothing new
+    auto nread = r.nread;
+    std::vector<std::string> out2;
+    assert(r.closure("/bin/sh", out2, missing) && r.nread == nread && r.ncached > 0);
+    assert(out2.size() == out.size());
+
+    // a script needs its interpreter and the interpreter's libraries
+    char fn[] = "/tmp/test-pa-jailconf-XXXXXX";
+    fd = mkstemp(fn);
+    assert(fd >= 0 && write(fd, "#!/bin/sh -e\necho\n", 17) == 17);
+    close(fd);
+    out2.clear();
+    assert(r.closure(fn, out2, missing) && out2[0] == "/bin/sh" && has_suffix(out2, "/libc.so.6"));
+    fd = open(fn, O_RDONLY | O_CLOEXEC);
+    assert(!elf_read(fd, ei));
+    close(fd);
+    unlink(fn);
+
+    // libraries are found only on the search path
+    r = elf_resolver();
+    r.set_search_dirs({"/nonexistent"});
+    out.clear();
+    assert(r.closure("/bin/sh", out, missing) && has_suffix(missing, "libc.so.6"));
+    assert(!r.closure("/nonexistent/sh", out, missing));
+#endif
+}
+
+static void write_file(const std::string& fn, const char* s) {
+    int fd = open(fn.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert(fd >= 0 && write(fd, s, strlen(s)) == (ssize_t) strlen(s));
+    close(fd);
+}
+
+static void test_manifest_fingerprint() {
+    std::string dir = scratch_dir();
+    std::string mf = dir + "/manifest", cache = dir + "/cache";
+    assert(mkdir((dir + "/d").c_str(), 0755) == 0);
+    write_file(dir + "/d/a", "a\n");
+    write_file(dir + "/d/b", "b\n");
+    assert(symlink("d/b", (dir + "/l").c_str()) == 0);
+    write_file(mf, (dir + "/d/a\n" + dir + "/l\n").c_str());
+
+    elf_resolver r;
+    manifest_fingerprint fp(r);
+    assert(fp.compute(mf) && fp.hex.length() == 64 && !fp.cached);
+    std::string h0 = fp.hex;
+    // the cache changes nothing but the work
+    assert(fp.compute(mf, cache) && fp.hex == h0 && !fp.cached);
+    assert(fp.compute(mf, cache) && fp.hex == h0 && fp.cached);
+
+    // a changed file changes the fingerprint, even one reached by a link
+    struct timespec ts[2] = {{1000000000, 0}, {1000000000, 0}};
+    assert(utimensat(AT_FDCWD, (dir + "/d/b").c_str(), ts, AT_SYMLINK_NOFOLLOW) == 0);
+    assert(fp.compute(mf, cache) && fp.hex != h0 && !fp.cached);
+    std::string h1 = fp.hex;
+    assert(fp.compute(mf, cache) && fp.hex == h1 && fp.cached);
+
+    // a new file in a directory does not; a changed directory mode does
+    write_file(dir + "/d/c", "c\n");
+    assert(fp.compute(mf, cache) && fp.hex == h1 && fp.cached);
+    assert(chmod((dir + "/d").c_str(), 0711) == 0);
+    assert(fp.compute(mf, cache) && fp.hex != h1 && !fp.cached);
+    std::string h2 = fp.hex;
+
+    // so does the manifest text, and a file that disappears
+    write_file(mf, (dir + "/d/a\n" + dir + "/l\n" + dir + "/d/c\n").c_str());
+    assert(fp.compute(mf, cache) && fp.hex != h2 && !fp.cached);
+    std::string h3 = fp.hex;
+    assert(unlink((dir + "/d/c").c_str()) == 0);
+    assert(fp.compute(mf, cache) && fp.hex != h3 && !fp.cached);
+
+    // a garbled cache is ignored
+    write_file(cache, "pa-jail fingerprint 1\nxyz\n");
+    assert(fp.compute(mf, cache) && !fp.cached);
+    assert(fp.compute(mf, cache) && fp.cached);
+
+    // a temporary name planted beside the cache is not written through
+    write_file(dir + "/victim", "v\n");
+    std::string prefix = cache + "." + std::to_string(getpid()) + ".";
+    assert(link((dir + "/victim").c_str(), (prefix + "tmp").c_str()) == 0);
+    for (int i = 0; i != 32; ++i) {
+        assert(link((dir + "/victim").c_str(), (prefix + std::to_string(i) + ".tmp").c_str()) == 0);
+    }
+    assert(unlink(cache.c_str()) == 0);
+    assert(fp.compute(mf, cache) && !fp.cached);
+    struct stat vst;
+    assert(stat((dir + "/victim").c_str(), &vst) == 0 && vst.st_size == 2);
+
+    assert(!fp.compute(dir + "/nonexistent", cache) && errno == ENOENT);
+    rm_scratch_dir(dir);
+}
+
+
 int main() {
     test_pathmatch();
     test_pathmatch_literal_prefix();
@@ -1333,11 +2030,25 @@ int main() {
     test_pajailconf_query();
     test_pajailconf_limit();
     test_pajailconf_cgroup();
+    test_pajailconf_linkstore();
+    test_pajailconf_pwcache();
     test_jaillimitinfo();
     test_limit_override();
     test_path_absolute();
     test_path_pa_validate();
     test_shell_quote();
+    test_json_quote();
     fuzz_shell_quote();
+    test_copy_file();
+    test_fsbatch();
+    test_dirfd_cache();
+    test_dir_reader();
+    test_passwd_cache();
+    test_mount_index();
+    test_path_table();
+    test_manifest_parse();
+    test_elf_resolver();
+    test_manifest_fingerprint();
+    test_sha256();
     fprintf(stderr, "test-pa-jailconf: all tests passed\n");
 }
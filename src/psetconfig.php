@@ -198,6 +198,10 @@ class Pset {
     /** @var ?string */
     public $run_binddir;
     /** @var ?string */
+    public $run_pooldir;
+    /** @var ?int */
+    public $run_poolsize;
+    /** @var ?string */
     public $run_jailfiles;
     /** @var null|string|list<string> */
     public $run_jailmanifest;
@@ -523,6 +527,8 @@ class Pset {
         $this->run_idle_timeout = self::cinterval($p, "run_idle_timeout") ?? 180 /* 3m default */;
         $this->run_skeletondir = self::cstr($p, "run_skeletondir");
         $this->run_binddir = self::cstr($p, "run_binddir");
+        $this->run_pooldir = self::cstr($p, "run_pooldir");
+        $this->run_poolsize = self::cint($p, "run_poolsize");
 
         // diffs
         if (isset($p->diff_base) && $p->diff_base !== "handout") {
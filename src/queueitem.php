@@ -1074,12 +1074,37 @@ class QueueItem {
         // print json to first line
         $this->log_identifier($esid);
 
-        // create jail
-        $this->remove_old_jails();
-        if ($this->run_and_log(["jail/pa-jail", "add", $this->_jaildir, $username])) {
+        // jail population
+        $skeletondir = $pset->run_skeletondir ? : $this->conf->opt("run_skeletondir");
+        $binddir = $pset->run_binddir ? : $this->conf->opt("run_binddir");
+        if ($skeletondir && $binddir && !is_dir("{$skeletondir}/proc")) {
+            $binddir = false;
+        }
+        $jfiles = $runner->jailfiles();
+        $pooldir = $pset->run_pooldir ? : $this->conf->opt("run_pooldir");
+        if (!$jfiles || ($skeletondir && $binddir)) {
+            $pooldir = false;
+        }
+
+        // create jail next to the old one, starting from a prepared one if
+        // possible, then swap it into place
+        $freshdir = "{$this->_jaildir}.new" . getmypid();
+        $addarg = ["jail/pa-jail", "add"];
+        if ($pooldir) {
+            $addarg[] = "--pool={$pooldir}";
+        }
+        array_push($addarg, $freshdir, $username);
+        if ($this->run_and_log($addarg)) {
+            $this->run_and_log(["jail/pa-jail", "rm", "-f", "--bg", $freshdir]);
             $this->cleanup();
             throw new RunnerException("Can’t initialize jail");
         }
+        $this->recycle_jail($freshdir);
+        if ($pooldir) {
+            $poolsize = $pset->run_poolsize ?? $this->conf->opt("run_poolsize") ?? 2;
+            $this->run_and_log(["jail/pa-jail", "prepare", "--bg", "-f{$jfiles}",
+                                $pooldir, (string) $poolsize]);
+        }
 
         // check out code
         $this->checkout_code();
@@ -1099,20 +1124,14 @@ class QueueItem {
             $cmdarg[] = "--event-source={$esfile}";
         }
 
-        $skeletondir = $pset->run_skeletondir ? : $this->conf->opt("run_skeletondir");
-        $binddir = $pset->run_binddir ? : $this->conf->opt("run_binddir");
-        if ($skeletondir && $binddir && !is_dir("{$skeletondir}/proc")) {
-            $binddir = false;
-        }
-        $jfiles = $runner->jailfiles();
-
         if ($skeletondir && $binddir) {
             $binddir = preg_replace('/\/+\z/', '', $binddir);
             $contents = "/ <- {$skeletondir} [bind-ro";
             if ($jfiles
                 && !preg_match('/[\s\];]/', $jfiles)
-                && ($jhash = hash_file("sha256", $jfiles)) !== false) {
-                $contents .= " {$jhash} {$jfiles}";
+                && is_readable($jfiles)) {
+                // pa-jail fingerprints the manifest and the files it names
+                $contents .= " auto {$jfiles}";
             }
             $contents .= "]\n{$userhome} <- {$this->_jailhomedir} [bind]";
             $cmdarg[] = "-F{$contents}";
@@ -1231,25 +1250,19 @@ class QueueItem {
         return proc_close($proc);
     }
 
-    private function remove_old_jails() {
-        $newdirpfx = $this->_jaildir . "~." . gmdate("Ymd\\THis", Conf::$now);
-        $tries = 0;
-        while (is_dir($this->_jaildir)) {
-            if ($tries > 10) {
-                throw new RunnerException("Can’t remove old jail");
-            } else if ($tries > 0) {
-                usleep(100000 * (1 << min($tries, 4)));
-                Conf::set_current_time(time());
-            }
-
-            $newdir = $newdirpfx . ($tries ? ".{$tries}" : "");
-            if ($this->run_and_log(["jail/pa-jail", "mv", $this->_jaildir, $newdir])) {
-                throw new RunnerException("Can’t remove old jail");
-            }
-
-            $this->run_and_log(["jail/pa-jail", "rm", "--bg", $newdir]);
-            clearstatcache(true, $this->_jaildir);
-            ++$tries;
+    /** @param string $freshdir */
+    private function recycle_jail($freshdir) {
+        // the old jail becomes `{$this->_jaildir}~.TIMESTAMP`; with a
+        // `pa-jail reap` daemon watching, the rename suffices
+        $recyclearg = ["jail/pa-jail", "recycle"];
+        if ($this->conf->opt("run_jailreaper")) {
+            $recyclearg[] = "--no-rm";
+        }
+        array_push($recyclearg, $this->_jaildir, $freshdir);
+        if ($this->run_and_log($recyclearg)) {
+            $this->run_and_log(["jail/pa-jail", "rm", "-f", "--bg", $freshdir]);
+            $this->cleanup();
+            throw new RunnerException("Can’t replace old jail");
         }
     }
 